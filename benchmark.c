@@ -0,0 +1,382 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/*BENCHMARK FOR THE CORE DATA-STRUCTURE OPERATIONS*/
+// Build: gcc -O2 benchmark.c -pthread -o benchmark
+// Runs every operation on synthetic workspaces at several sizes and reports ops/s, p50/p99 latency and peak RSS.
+// Exits with status 1 when an operation's per-call cost grows close to linearly with the input size (O(n^2) overall).
+#define NOTEMAKER_NO_MAIN
+#include "notemaker.c"
+
+#include <dirent.h>
+#include <sys/resource.h>
+
+#define BENCH_MAX_SIZES 16
+
+enum PriorityDistribution{
+    PRIORITIES_RANDOM,     // Unique priorities in shuffled order
+    PRIORITIES_ASCENDING,  // Every new task becomes the last one out
+    PRIORITIES_DESCENDING  // Every new task becomes the next one out
+};
+
+// Structure to represent the command-line settings of a run
+struct BenchSettings{
+    size_t sizes[BENCH_MAX_SIZES];
+    int sizeCount;
+    size_t fanout;         // Child folders per folder in the synthetic tree
+    size_t depth;          // Levels below the root in the synthetic tree
+    size_t notesPerFolder; // 0 spreads the input size evenly over the tree's folders
+    size_t tasks;          // 0 uses the input size
+    enum PriorityDistribution priorities;
+    unsigned seed;
+};
+
+// Structure to represent the latencies of one operation at one input size
+struct BenchResult{
+    const char *operation;
+    size_t size;
+    size_t calls;
+    size_t nodes;          // Nodes touched, used for the per-node cost of freeFolderTree
+    uint64_t totalNanoseconds;
+    uint64_t p50;
+    uint64_t p99;
+    long peakRssKb;
+};
+
+// Structure to represent the latency samples being collected for an operation
+struct BenchTimer{
+    uint64_t *samples;
+    size_t count;
+    struct timespec start;
+};
+
+FILE *benchReport;
+struct BenchResult benchResults[BENCH_MAX_SIZES * 8];
+int benchResultCount;
+
+uint64_t nanosecondsBetween(const struct timespec *start, const struct timespec *end){
+    return (uint64_t)(end->tv_sec - start->tv_sec) * 1000000000u + (uint64_t)(end->tv_nsec - start->tv_nsec);
+}
+
+void startTimer(struct BenchTimer *timer){
+    clock_gettime(CLOCK_MONOTONIC, &timer->start);
+}
+
+void stopTimer(struct BenchTimer *timer){
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    timer->samples[timer->count++] = nanosecondsBetween(&timer->start, &end);
+}
+
+int compareSamples(const void *a, const void *b){
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+long peakRssKb(void){
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+// Function to turn the collected samples into a result row
+void recordResult(const char *operation, size_t size, struct BenchTimer *timer, size_t nodes){
+    struct BenchResult *result = &benchResults[benchResultCount++];
+    result->operation = operation;
+    result->size = size;
+    result->calls = timer->count;
+    result->nodes = nodes;
+    result->totalNanoseconds = 0;
+    for (size_t i = 0; i < timer->count; i++){
+        result->totalNanoseconds += timer->samples[i];
+    }
+    qsort(timer->samples, timer->count, sizeof(uint64_t), compareSamples);
+    result->p50 = timer->count == 0 ? 0 : timer->samples[timer->count / 2];
+    result->p99 = timer->count == 0 ? 0 : timer->samples[(timer->count * 99) / 100];
+    result->peakRssKb = peakRssKb();
+    timer->count = 0;
+}
+
+// Function to shuffle an array of indexes in place
+void shuffleIndexes(size_t *indexes, size_t count){
+    for (size_t i = count; i > 1; i--){
+        size_t j = (size_t)rand() % i;
+        size_t temp = indexes[i - 1];
+        indexes[i - 1] = indexes[j];
+        indexes[j] = temp;
+    }
+}
+
+// Function to add fanout^level folders and their notes below a folder; returns the number of nodes created
+size_t buildSyntheticTree(struct FolderNode *folder, size_t level, const struct BenchSettings *settings, size_t notesPerFolder){
+    char name[64];
+    size_t nodes = 1;
+    for (size_t i = 0; i < notesPerFolder; i++){
+        snprintf(name, sizeof(name), "bench-note-%zu", i);
+        addFileToList(folder, name);
+        nodes++;
+    }
+    if (level == settings->depth){
+        return nodes;
+    }
+    for (size_t i = 0; i < settings->fanout; i++){
+        snprintf(name, sizeof(name), "bench-folder-%zu", i);
+        nodes += buildSyntheticTree(addFolderToTree(folder, name), level + 1, settings, notesPerFolder);
+    }
+    return nodes;
+}
+
+// Function to benchmark every operation at one input size
+void benchmarkSize(size_t size, const struct BenchSettings *settings){
+    struct BenchTimer timer;
+    timer.samples = (uint64_t *)malloc(sizeof(uint64_t) * (size + 1));
+    timer.count = 0;
+    size_t *order = (size_t *)malloc(sizeof(size_t) * size);
+    if (timer.samples == NULL || order == NULL){
+        fprintf(stderr, "Memory allocation failed.\n");
+        exit(1);
+    }
+    for (size_t i = 0; i < size; i++){
+        order[i] = i;
+    }
+    char name[64];
+
+    // Notes: grow one folder to size notes, then delete them in random order
+    struct FolderNode *root = createFolderNode(internName("Root"), NULL);
+    for (size_t i = 0; i < size; i++){
+        snprintf(name, sizeof(name), "bench-note-%zu", i);
+        startTimer(&timer);
+        addFileToList(root, name);
+        stopTimer(&timer);
+    }
+    recordResult("addFileToList", size, &timer, size);
+    waitForFileIo(); // Let the background creates finish so they do not compete with the next phase
+    shuffleIndexes(order, size);
+    for (size_t i = 0; i < size; i++){
+        snprintf(name, sizeof(name), "bench-note-%zu", order[i]);
+        startTimer(&timer);
+        deleteFile(root, name);
+        stopTimer(&timer);
+    }
+    recordResult("deleteFile", size, &timer, size);
+    waitForFileIo();
+
+    // Folders: size children under one parent, then look them up in random order
+    for (size_t i = 0; i < size; i++){
+        snprintf(name, sizeof(name), "bench-folder-%zu", i);
+        addFolderToTree(root, name);
+    }
+    shuffleIndexes(order, size);
+    for (size_t i = 0; i < size; i++){
+        snprintf(name, sizeof(name), "bench-folder-%zu", order[i]);
+        startTimer(&timer);
+        struct FolderNode *child = navigateToChildFolder(root, name);
+        stopTimer(&timer);
+        if (child == NULL){
+            fprintf(stderr, "Lookup of %s failed.\n", name);
+            exit(1);
+        }
+    }
+    recordResult("navigateToChildFolder", size, &timer, size);
+    freeFolderTree(root);
+
+    // Tasks: push with the chosen priority distribution, then pop them all
+    size_t taskCount = settings->tasks != 0 ? settings->tasks : size;
+    if (taskCount > size){
+        taskCount = size; // The sample buffer holds one latency per input element
+    }
+    for (size_t i = 0; i < taskCount; i++){
+        order[i] = i;
+    }
+    if (settings->priorities == PRIORITIES_RANDOM){
+        shuffleIndexes(order, taskCount);
+    }
+    struct TaskQueue queue = {0};
+    for (size_t i = 0; i < taskCount; i++){
+        int priority = settings->priorities == PRIORITIES_DESCENDING ? (int)(taskCount - i) : (int)order[i];
+        snprintf(name, sizeof(name), "bench-task-%zu", i);
+        startTimer(&timer);
+        addTaskToQueue(&queue, name, priority, TASK_NO_DEADLINE, 0);
+        stopTimer(&timer);
+    }
+    recordResult("addTaskToQueue", size, &timer, taskCount);
+    for (size_t i = 0; i < taskCount; i++){
+        startTimer(&timer);
+        executeHighestPriorityTask(&queue);
+        stopTimer(&timer);
+    }
+    recordResult("executeHighestPriorityTask", size, &timer, taskCount);
+    freeTaskQueue(&queue);
+
+    // Whole tree: a synthetic workspace of roughly size notes, freed in one call
+    size_t folders = 1;
+    size_t levelFolders = 1;
+    for (size_t level = 0; level < settings->depth; level++){
+        levelFolders *= settings->fanout;
+        folders += levelFolders;
+    }
+    size_t notesPerFolder = settings->notesPerFolder != 0 ? settings->notesPerFolder : (size + folders - 1) / folders;
+    root = createFolderNode(internName("Root"), NULL);
+    size_t nodes = buildSyntheticTree(root, 0, settings, notesPerFolder);
+    waitForFileIo();
+    startTimer(&timer);
+    freeFolderTree(root);
+    stopTimer(&timer);
+    recordResult("freeFolderTree", size, &timer, nodes);
+
+    free(order);
+    free(timer.samples);
+}
+
+// Function to print the results and flag operations whose per-call cost grows with the input size
+int printBenchResults(const struct BenchSettings *settings){
+    int regressions = 0;
+    fprintf(benchReport, "%-28s %10s %10s %14s %10s %10s %12s %10s %8s\n",
+            "operation", "size", "calls", "ops/s", "p50 (ns)", "p99 (ns)", "ns/node", "RSS (KB)", "growth");
+    for (int i = 0; i < benchResultCount; i++){
+        struct BenchResult *result = &benchResults[i];
+        double seconds = (double)result->totalNanoseconds / 1e9;
+        double perNode = result->nodes == 0 ? 0.0 : (double)result->totalNanoseconds / (double)result->nodes;
+
+        // Compare with the same operation at the smallest size: the median call for repeated operations, which
+        // time slices lost to the background file workers cannot skew, and the per-node cost for single calls
+        const struct BenchResult *first = result;
+        for (int j = 0; j < i; j++){
+            if (strcmp(benchResults[j].operation, result->operation) == 0){
+                first = &benchResults[j];
+                break;
+            }
+        }
+        double firstPerNode = first->nodes == 0 ? 0.0 : (double)first->totalNanoseconds / (double)first->nodes;
+        double growth = 1.0;
+        if (result->calls > 1 && first->p50 != 0){
+            growth = (double)result->p50 / (double)first->p50;
+        }
+        else if (result->calls <= 1 && firstPerNode > 0.0){
+            growth = perNode / firstPerNode;
+        }
+        double sizeRatio = (double)result->size / (double)first->size;
+        int suspicious = sizeRatio >= 10.0 && growth > sizeRatio / 2.0;
+        regressions += suspicious;
+
+        fprintf(benchReport, "%-28s %10zu %10zu %14.0f %10llu %10llu %12.1f %10ld %7.2fx%s\n",
+                result->operation, result->size, result->calls, seconds > 0.0 ? (double)result->calls / seconds : 0.0,
+                (unsigned long long)result->p50, (unsigned long long)result->p99, perNode, result->peakRssKb, growth,
+                suspicious ? "  <- superlinear" : "");
+    }
+    fprintf(benchReport, "\nfan-out %zu, depth %zu, priorities %s, seed %u; peak RSS is cumulative over the run.\n",
+            settings->fanout, settings->depth,
+            settings->priorities == PRIORITIES_RANDOM ? "random" : settings->priorities == PRIORITIES_ASCENDING ? "ascending" : "descending",
+            settings->seed);
+    if (regressions != 0){
+        fprintf(benchReport, "%d operation(s) grew close to O(n^2).\n", regressions);
+    }
+    return regressions;
+}
+
+void printBenchUsage(const char *program){
+    fprintf(stderr,
+            "Usage: %s [--sizes 1000,10000,100000] [--fanout 8] [--depth 3] [--notes-per-folder N]\n"
+            "          [--tasks N] [--priorities random|ascending|descending] [--seed N]\n", program);
+}
+
+int main(int argc, char **argv){
+    struct BenchSettings settings = {{1000, 10000, 100000}, 3, 8, 3, 0, 0, PRIORITIES_RANDOM, 1};
+    for (int i = 1; i < argc; i++){
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+        if (value == NULL){
+            printBenchUsage(argv[0]);
+            return 2;
+        }
+        if (strcmp(argv[i], "--sizes") == 0){
+            settings.sizeCount = 0;
+            char *cursor = (char *)value;
+            while (*cursor != '\0' && settings.sizeCount < BENCH_MAX_SIZES){
+                size_t size = (size_t)strtoull(cursor, &cursor, 10);
+                if (size != 0){
+                    settings.sizes[settings.sizeCount++] = size;
+                }
+                while (*cursor == ','){
+                    cursor++;
+                }
+                if (*cursor != '\0' && (*cursor < '0' || *cursor > '9')){
+                    printBenchUsage(argv[0]);
+                    return 2;
+                }
+            }
+        }
+        else if (strcmp(argv[i], "--fanout") == 0){
+            settings.fanout = (size_t)strtoull(value, NULL, 10);
+        }
+        else if (strcmp(argv[i], "--depth") == 0){
+            settings.depth = (size_t)strtoull(value, NULL, 10);
+        }
+        else if (strcmp(argv[i], "--notes-per-folder") == 0){
+            settings.notesPerFolder = (size_t)strtoull(value, NULL, 10);
+        }
+        else if (strcmp(argv[i], "--tasks") == 0){
+            settings.tasks = (size_t)strtoull(value, NULL, 10);
+        }
+        else if (strcmp(argv[i], "--seed") == 0){
+            settings.seed = (unsigned)strtoul(value, NULL, 10);
+        }
+        else if (strcmp(argv[i], "--priorities") == 0 && strcmp(value, "random") == 0){
+            settings.priorities = PRIORITIES_RANDOM;
+        }
+        else if (strcmp(argv[i], "--priorities") == 0 && strcmp(value, "ascending") == 0){
+            settings.priorities = PRIORITIES_ASCENDING;
+        }
+        else if (strcmp(argv[i], "--priorities") == 0 && strcmp(value, "descending") == 0){
+            settings.priorities = PRIORITIES_DESCENDING;
+        }
+        else{
+            printBenchUsage(argv[0]);
+            return 2;
+        }
+        i++;
+    }
+    if (settings.sizeCount == 0){
+        printBenchUsage(argv[0]);
+        return 2;
+    }
+    srand(settings.seed);
+
+    // The operations print their own messages and create and unlink note files, so run in a scratch directory with stdout muted
+    char scratch[] = "/tmp/notemaker-bench-XXXXXX";
+    if (mkdtemp(scratch) == NULL || chdir(scratch) != 0){
+        fprintf(stderr, "Could not create a scratch directory: %s\n", strerror(errno));
+        return 1;
+    }
+    benchReport = fdopen(dup(STDOUT_FILENO), "w");
+    if (benchReport == NULL || freopen("/dev/null", "w", stdout) == NULL){
+        fprintf(stderr, "Could not redirect the operations' output: %s\n", strerror(errno));
+        return 1;
+    }
+
+    for (int i = 0; i < settings.sizeCount; i++){
+        benchmarkSize(settings.sizes[i], &settings);
+    }
+    int regressions = printBenchResults(&settings);
+    fclose(benchReport);
+
+    // Notes left behind by freeFolderTree are still on disk once the background creates finish
+    stopFileIo();
+    DIR *directory = opendir(".");
+    struct dirent *entry;
+    while (directory != NULL && (entry = readdir(directory)) != NULL){
+        if (strncmp(entry->d_name, "bench-", 6) == 0){
+            unlink(entry->d_name);
+        }
+    }
+    if (directory != NULL){
+        closedir(directory);
+    }
+    if (chdir("/") == 0){
+        rmdir(scratch);
+    }
+    releaseWorkspaceArena(&workspaceArena);
+    releaseNamePool(&namePool);
+    free(folderRegistry.byId);
+    free(noteRegistry.byId);
+    free(noteNameUses.slots);
+    return regressions != 0;
+}
@@ -1,539 +1,8531 @@
-//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-/*LIBRARY IMPORTS*/
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-
-//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-/*STRUCTURES FOR EACH FILES FOLDERS AND TASKS*/
-// Structure to represent a file node
-struct FileNode{
-    char filename[256];
-    struct FileNode *next;
-    struct FileNode *prev;
-};
-
-// Structure to represent a folder node
-struct FolderNode{
-    char foldername[256];
-    struct FileNode *fileList;
-    struct FolderNode *parentFolder;
-    struct FolderNode *nextFolder;
-    struct FolderNode *prevFolder;
-};
-// Structure to represent a task node
-struct TaskNode{
-    char taskname[256];
-    int priority;
-    struct TaskNode *next;
-};
-
-//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-/*CREATING FILE, FOLDER AND TASK NODES*/
-// Function to create a new note node
-struct FileNode *createFileNode(const char *filename){
-    struct FileNode *newNode = (struct FileNode *)malloc(sizeof(struct FileNode));
-    if (newNode == NULL){
-        fprintf(stderr, "Memory allocation failed.\n");
-        exit(1);
-    }
-    strncpy(newNode->filename, filename, sizeof(newNode->filename));
-    newNode->next = NULL;
-    newNode->prev = NULL;
-    return newNode;
-}
-//Function to create a new folder node
-struct FolderNode *createFolderNode(const char *foldername, struct FolderNode *parentFolder){
-    struct FolderNode *newNode = (struct FolderNode *)malloc(sizeof(struct FolderNode));
-    if (newNode == NULL){
-        fprintf(stderr, "Memory allocation failed.\n");
-        exit(1);
-    }
-    strncpy(newNode->foldername, foldername, sizeof(newNode->foldername));
-    newNode->fileList = NULL;
-    newNode->nextFolder = NULL;
-    newNode->prevFolder = NULL;
-    newNode->parentFolder = parentFolder;
-    return newNode;
-}
-//Function to create a new task node
-struct TaskNode *createTaskNode(const char *taskname, int priority){
-    struct TaskNode *newNode = (struct TaskNode *)malloc(sizeof(struct TaskNode));
-    if (newNode == NULL){
-        fprintf(stderr, "Memory allocation failed.\n");
-        exit(1);
-    }
-    strncpy(newNode->taskname, taskname, sizeof(newNode->taskname));
-    newNode->priority = priority;
-    newNode->next = NULL;
-    return newNode;
-}
-
-//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-/*MENU FUNCTIONALITIES*/
-// 1) Function to add a note to the doubly linked list
-void addFileToList(struct FileNode **head, const char *filename){
-    struct FileNode *newNode = createFileNode(filename);
-
-    if (*head == NULL){
-        *head = newNode;
-    }
-    else{
-        struct FileNode *current = *head;
-        while (current->next != NULL){
-            current = current->next;
-        }
-        current->next = newNode;
-        newNode->prev = current;
-    }
-}
-
-// 2) Function to open a note in Notepad
-void openFileInNotepad(const char *filename){
-    char command[256];
-    snprintf(command, sizeof(command), "notepad %s", filename);
-    system(command);
-}
-
-// 3) Function to print the list of files
-void printFileList(struct FileNode *head){
-    struct FileNode *current = head;
-    int index = 1;
-    while (current != NULL){
-        printf("%d. %s\n", index, current->filename);
-        current = current->next;
-        index++;
-    }
-}
-
-// 4) Function to delete a file from the doubly linked list and the file system
-void deleteFile(struct FileNode **head, const char *filename){
-    struct FileNode *current = *head;
-
-    while (current != NULL){
-        if (strcmp(current->filename, filename) == 0){
-            if (current->prev != NULL){
-                current->prev->next = current->next;
-            }
-            else{
-                *head = current->next;
-            }
-
-            if (current->next != NULL){
-                current->next->prev = current->prev;
-            }
-
-            remove(filename); // Delete the file from the file system
-            free(current);
-            return;
-        }
-        current = current->next;
-    }
-}
-
-// 5) Function to add a folder to the doubly linked list of folders
-void addFolderToTree(struct FolderNode **root, const char *foldername, struct FolderNode *parentFolder){
-    struct FolderNode *newNode = createFolderNode(foldername, parentFolder);
-    if (*root == NULL){
-        *root = newNode;
-    }
-    else{
-        struct FolderNode *current = *root;
-        while (current->nextFolder != NULL){
-            current = current->nextFolder;
-        }
-        current->nextFolder = newNode;
-        newNode->prevFolder = current;
-    }
-}
-
-// 6) Function to navigate to a child folder
-struct FolderNode *navigateToChildFolder(struct FolderNode *currentFolder, const char *foldername){
-    struct FolderNode *newFolder = currentFolder->nextFolder;
-    while (newFolder != NULL){
-        if (strcmp(newFolder->foldername, foldername) == 0){
-            return newFolder;
-        }
-        newFolder = newFolder->nextFolder;
-    }
-    return NULL; // Folder not found
-}
-
-// 7) Function to navigate to the parent folder
-struct FolderNode *navigateToParentFolder(struct FolderNode *currentFolder){
-    return currentFolder->parentFolder;
-}
-
-// 8) Function to delete a folder and its contents, including files
-void deleteFolder(struct FolderNode **root, const char *foldername){
-    struct FolderNode *current = *root;
-    while (current != NULL){
-        if (strcmp(current->foldername, foldername) == 0){
-            if (current->prevFolder != NULL){
-                current->prevFolder->nextFolder = current->nextFolder;
-            }
-            else{
-                *root = current->nextFolder;
-            }
-
-            if (current->nextFolder != NULL){
-                current->nextFolder->prevFolder = current->prevFolder;
-            }
-
-            // Delete the files in the folder
-            struct FileNode *fileList = current->fileList;
-            while (fileList != NULL){
-                remove(fileList->filename); // Delete the file from the file system
-                struct FileNode *tempFile = fileList;
-                fileList = fileList->next;
-                free(tempFile);
-            }
-
-            free(current);
-            return;
-        }
-        current = current->nextFolder;
-    }
-}
-
-// 9) Add task to task list
-void addTaskToQueue(struct TaskNode **head, const char *taskname, int priority){
-    // Check if a task with the given priority already exists
-    struct TaskNode *current = *head;
-    while (current != NULL){
-        if (current->priority == priority){
-            printf("Priority %d already has a task: %s\n", priority, current->taskname);
-            return;
-        }
-        current = current->next;
-    }
-
-    // If no task with the given priority exists, add the new task
-    struct TaskNode *newNode = createTaskNode(taskname, priority);
-
-    if (*head == NULL || priority < (*head)->priority){
-        newNode->next = *head;
-        *head = newNode;
-    }
-    else{
-        current = *head;
-        while (current->next != NULL && current->next->priority <= priority){
-            current = current->next;
-        }
-        newNode->next = current->next;
-        current->next = newNode;
-    }
-}
-
-// 10) Remove prioritized task upon completion
-void executeHighestPriorityTask(struct TaskNode **head){
-    if (*head != NULL){
-        struct TaskNode *taskToExecute = *head;
-        printf("Executing task with priority %d: %s\n", taskToExecute->priority, taskToExecute->taskname);
-        *head = taskToExecute->next;
-        free(taskToExecute);
-    }
-    else{
-        printf("No tasks in the priority queue.\n");
-    }
-}
-
-// 11) View the task list
-void printTaskQueue(struct TaskNode *head){
-    struct TaskNode *current = head;
-    int index = 1;
-    while (current != NULL){
-        printf("%d. Priority %d: %s\n", index, current->priority, current->taskname);
-        current = current->next;
-        index++;
-    }
-}
-
-// 12) Delete a task from the task list
-void deleteTask(struct TaskNode **head, int taskIndex){
-    struct TaskNode *current = *head;
-    struct TaskNode *prev = NULL;
-    int index = 1;
-
-    while (current != NULL && index < taskIndex){
-        prev = current;
-        current = current->next;
-        index++;
-    }
-
-    if (current != NULL){
-        if (prev != NULL){
-            prev->next = current->next;
-        }
-        else{
-            *head = current->next;
-        }
-
-        free(current);
-        printf("\n");
-        printf(" Task deleted.\n");
-    }
-    else{
-        printf("\n");
-        printf(" Invalid task index.\n");
-    }
-}
-
-//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-/*FREE THE FILE, FOLDER AND TASKS LIST*/
-// Function to free the memory allocated for the doubly linked list of files
-void freeFileList(struct FileNode *head){
-    while (head != NULL){
-        struct FileNode *temp = head;
-        head = head->next;
-        free(temp);
-    }
-}
-
-// Function to free the memory allocated for the doubly linked list of folders
-void freeFolderTree(struct FolderNode *root){
-    while (root != NULL){
-        struct FolderNode *currentFolder = root;
-        root = root->nextFolder;
-        freeFileList(currentFolder->fileList);
-        freeFolderTree(currentFolder->nextFolder);
-        free(currentFolder);
-    }
-}
-
-//Function to free the queue alloted to task manager
-void freeTaskQueue(struct TaskNode *head){
-    while (head != NULL){
-        struct TaskNode *temp = head;
-        head = head->next;
-        free(temp);
-    }
-}
-
-//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-/*MAIN FUNCTION*/
-int main(){
-    struct FolderNode *rootFolder = createFolderNode("Root", NULL);
-    struct FolderNode *currentFolder = rootFolder;
-    struct TaskNode *priorityQueue = NULL;
-
-    int choice;
-    char filename[256];
-    char foldername[256];
-    char taskname[256];
-    int priority;
-    while (1){
-        printf("\n");
-        printf("++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++\n");
-        printf("__________________________________________________________________\n");
-        printf("| NOTE MAKER APPLICATION                                         |\n");
-        printf("|----------------------------------------------------------------|\n");
-        printf("| Current Topic Folder: %s                                     |\n", currentFolder->foldername);
-        printf("|----------------------------------------------------------------|\n");
-        printf("| NOTES MANAGER                                                  |\n");
-        printf("|----------------------------------------------------------------|\n");
-        printf("| 1. Add a Note to the current Topic Folder                      |\n");
-        printf("| 2. Open a Note                                                 |\n");
-        printf("| 3. View all the Notes in the current Topic Folder              |\n");
-        printf("| 4. Delete a Note from the current Topic Folder                 |\n");
-        printf("|----------------------------------------------------------------|\n");
-        printf("| TOPIC FOLDER MANAGER                                           |\n");
-        printf("|----------------------------------------------------------------|\n");
-        printf("| 5. Create a new Topic Folder in the current Topic Folder       |\n");
-        printf("| 6. Navigate to a child Topic Folder                            |\n");
-        printf("| 7. Navigate to the parent Topic Folder                         |\n");
-        printf("| 8. Delete the Topic Folder of your choice                      |\n");
-        printf("|----------------------------------------------------------------|\n");
-        printf("| TASK MANAGER                                                   |\n");
-        printf("|----------------------------------------------------------------|\n");
-        printf("|  9. Add a Task                                                 |\n");
-        printf("| 10. Execute Highest Priority Task                              |\n");
-        printf("| 11. View Task List                                             |\n");
-        printf("| 12. Delete a Task                                              |\n");
-        printf("|----------------------------------------------------------------|\n");
-        printf("|----------------------------------------------------------------|\n");
-        printf("| 13. Exit                                                       |\n");
-        printf("__________________________________________________________________\n");
-        printf("++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++\n");
-        printf(" Choose an option: ");
-        scanf("%d", &choice);
-
-        switch (choice){
-        case 1:
-            printf("\n");
-            printf(" Enter the Note Title (e.g., mynote): ");
-            scanf("%s", filename);
-            addFileToList(&(currentFolder->fileList), filename);
-            break;
-        case 2:
-            if (currentFolder->fileList != NULL){
-                printFileList(currentFolder->fileList);
-                printf("\n");
-                printf(" Enter the index of the Note to open: ");
-                int fileIndex;
-                scanf("%d", &fileIndex);
-                struct FileNode *current = currentFolder->fileList;
-                int currentIndex = 1;
-                while (current != NULL && currentIndex < fileIndex){
-                    current = current->next;
-                    currentIndex++;
-                }
-
-                if (current != NULL){
-                    openFileInNotepad(current->filename);
-                }
-                else{
-                    printf("\n");
-                    printf(" Invalid index.\n");
-                }
-            }
-            else{
-                printf("\n");
-                printf(" The Topic Folder is empty.\n");
-            }
-            break;
-        case 3:
-            if (currentFolder->fileList != NULL){
-                printf("\n");
-                printf(" List of Notes in %s:\n", currentFolder->foldername);
-                printFileList(currentFolder->fileList);
-            }
-            else{
-                printf("\n");
-                printf(" The Topic Folder is empty.\n");
-            }
-            break;
-        case 4:
-            if (currentFolder->fileList != NULL){
-                printFileList(currentFolder->fileList);
-                printf("\n");
-                printf(" Enter the index of the Note to delete: ");
-                int fileIndex;
-                scanf("%d", &fileIndex);
-
-                struct FileNode *current = currentFolder->fileList;
-                int currentIndex = 1;
-                while (current != NULL && currentIndex < fileIndex){
-                    current = current->next;
-                    currentIndex++;
-                }
-
-                if (current != NULL){
-                    deleteFile(&(currentFolder->fileList), current->filename);
-                    printf("\n");
-                    printf(" Note deleted.\n");
-                }
-                else{
-                    printf("\n");
-                    printf(" Invalid index.\n");
-                }
-            }
-            else{
-                printf("\n");
-                printf(" The Topic Folder is empty.\n");
-            }
-            break;
-        case 5:
-            printf("\n");
-            printf(" Enter the name of the new Topic Folder: ");
-            scanf("%s", foldername);
-            addFolderToTree(&(currentFolder->nextFolder), foldername, currentFolder);
-            break;
-        case 6:
-            printf("\n");
-            printf(" Enter the name of the Topic Folder to navigate to: ");
-            scanf("%s", foldername);
-            struct FolderNode *childFolder = navigateToChildFolder(currentFolder, foldername);
-            if (childFolder != NULL){
-                currentFolder = childFolder;
-            }
-            else{
-                printf("\n");
-                printf(" Topic Folder not found.\n");
-            }
-            break;
-        case 7:;
-            struct FolderNode *parentFolder = navigateToParentFolder(currentFolder);
-            if (parentFolder != NULL){
-                currentFolder = parentFolder;
-            }
-            else{
-                printf("\n");
-                printf(" You are already in the Default Workspace.\n");
-            }
-            break;
-        case 8:
-            printf("\n");
-            printf(" Enter the name of the Topic Folder to delete: ");
-            scanf("%s", foldername);
-
-            if (currentFolder->nextFolder != NULL){
-                struct FolderNode *folderToDelete = currentFolder->nextFolder;
-                while (folderToDelete != NULL){
-                    if (strcmp(folderToDelete->foldername, foldername) == 0){
-                        deleteFolder(&(currentFolder->nextFolder), foldername);
-                        printf(" Topic Folder deleted.\n");
-                        break;
-                    }
-                    folderToDelete = folderToDelete->nextFolder;
-                }
-                if (folderToDelete == NULL){
-                    printf(" Topic Folder not found.\n");
-                }
-            }
-            else{
-                printf(" No Topic Folders to delete.\n");
-            }
-            break;
-        case 9:
-            printf("\n");
-            printf(" Enter the Task Name and Description: ");
-            scanf(" %255[^\n]", taskname);
-            int w = 9;
-            printf(" Enter the Task Priority (an integer): ");
-            scanf("%d", &priority);
-            addTaskToQueue(&priorityQueue, taskname, priority);
-            break;
-        case 10:
-            executeHighestPriorityTask(&priorityQueue);
-            break;
-        case 11:
-            if (priorityQueue != NULL){
-                printf("\n");
-                printf(" Task List:\n");
-                printTaskQueue(priorityQueue);
-            }
-            else{
-                printf("\n");
-                printf(" The Task List is empty.\n");
-            }
-            break;
-        case 12:
-            if (priorityQueue != NULL){
-                printf("\n");
-                printf(" Task List:\n");
-                printTaskQueue(priorityQueue);
-                printf(" Enter the index of the Task to delete: ");
-                int taskIndex;
-                scanf("%d", &taskIndex);
-                deleteTask(&priorityQueue, taskIndex);
-            }
-            else{
-                printf("\n");
-                printf(" The Task List is empty.\n");
-            }
-            break;
-
-        case 13:
-            // Free memory used by the tree and exit
-            freeTaskQueue(priorityQueue);
-            freeFolderTree(rootFolder);
-            exit(0);
-        default:
-            printf("\n");
-            printf(" Invalid Menu Choice.\n");
-        }
-    }return 0;
-}
-
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/*LIBRARY IMPORTS*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <limits.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/syscall.h>
+#include <dirent.h>
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/*STRUCTURES FOR EACH FILES FOLDERS AND TASKS*/
+// Structure to represent a handle to an interned name in the name pool
+struct NameRef{
+    uint32_t offset; // Start of the name's bytes in the pool; the bytes are followed by a '\0'
+    uint32_t length;
+    uint32_t hash;   // Precomputed hashName() of the bytes
+};
+
+// Structure to represent a file node
+struct FileNode{
+    struct NameRef filename;
+    struct FileNode *next;
+    struct FileNode *prev;
+    size_t position;           // Slot of the note in its list's position array
+    struct FolderNode *folder; // Folder whose list holds the note
+    uint32_t fileId;           // Search index document id; a fresh one is issued whenever the content is re-indexed
+    uint32_t finderSlot;       // Position among the nodes the name finder lists under this name
+    uint64_t byteSize;         // Size of the note file when it was last measured
+};
+
+// Structure to represent one slot of a name index
+struct NameIndexEntry{
+    struct NameRef name;
+    void *node; // NULL marks an empty slot
+};
+
+// Structure to represent an open-addressing hash index from names to nodes
+struct NameIndex{
+    struct NameIndexEntry *slots;
+    size_t count;
+    size_t capacity; // Always a power of two
+};
+
+// Structure to represent the notes of a folder: ordered list, name index and position array
+struct FileList{
+    struct FileNode *head;
+    struct FileNode *tail;
+    struct NameIndex index;
+    struct FileNode **slots; // Notes by position; deletions leave NULL holes that are compacted lazily
+    size_t slotCount;
+    size_t slotCapacity;
+    size_t count;
+};
+
+// Structure to represent totals over a folder and everything below it, kept up to date along the parent chain as
+// notes and folders change. Atomic because server clients working in different folders share the ancestors.
+struct FolderStats{
+    atomic_llong noteCount;
+    atomic_llong folderCount;  // Folders below this one
+    atomic_llong totalBytes;   // Sizes of the note files as last measured
+    atomic_int deepestLevel;   // Levels of folders below this one; 0 without child folders
+    atomic_llong lastModified; // Latest change anywhere inside, in seconds since the epoch; 0 if none is known
+};
+
+// Structure to represent a folder node
+struct FolderNode{
+    struct NameRef foldername;
+    struct FileList fileList;
+    struct FolderNode *parentFolder;
+    struct FolderNode *firstChild;
+    struct FolderNode *lastChild;
+    struct FolderNode *nextFolder; // Next sibling under the same parent
+    struct FolderNode *prevFolder; // Previous sibling under the same parent
+    struct NameIndex childIndex;   // Child folders by name
+    struct FolderStats stats;      // Totals over this folder and its subtree
+    uint32_t folderId;             // Stable handle used by the journal; reassigned in preorder at every snapshot
+    uint32_t finderSlot;           // Position among the nodes the name finder lists under this name
+    int inTrash;                   // Set on the top folder of a deleted subtree that is kept so it can be undone
+    pthread_rwlock_t lock;         // Orders server clients working inside this folder
+};
+// Structure to represent a task node
+#define TASK_NO_DEADLINE INT64_MAX
+struct TaskNode{
+    struct NameRef taskname;
+    int priority;
+    int64_t dueTime;          // Seconds since the epoch, TASK_NO_DEADLINE if the task has none
+    uint32_t repeatSeconds;   // Recurrence interval, 0 for a one-off task
+    uint64_t seq;             // Insertion sequence: stable task id and last tie-break in queue order
+    size_t heapIndex;         // Position of the task in the queue's heap array
+    struct TaskNode *timerNext; // Neighbours in the timer wheel bucket
+    struct TaskNode *timerPrev;
+    struct TaskNode **timerBucket; // Bucket head holding the task, NULL when no timer is pending
+};
+
+// Structure to represent the task queue: a binary min-heap on (due time, priority, sequence) plus a sequence -> task hash index
+struct TaskQueue{
+    struct TaskNode **heap;
+    size_t count;
+    size_t capacity;
+    struct TaskNode **seqIndex; // Open-addressing table, NULL marks an empty slot
+    size_t indexCapacity;       // Always a power of two
+};
+
+// Stream the note, folder and task functions answer on: a server thread points it at its client
+_Thread_local FILE *sessionOutput;
+
+FILE *sessionStream(void){
+    return sessionOutput != NULL ? sessionOutput : stdout;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/*OPERATION METRICS*/
+// Every thread counts into its own shard, so recording a sample costs two clock reads and a few uncontended stores and
+// can stay on all the time. A report adds the shards up; the shard of a thread that exits is folded into a retired
+// total and handed to the next new thread.
+#define METRIC_BUCKETS 32 // Bucket b counts samples under 2^b ns (bucket 0: under 1 ns); the last one takes the rest
+
+// Kinds of timed operations
+enum Metric{
+    METRIC_ADD_NOTE,
+    METRIC_OPEN_NOTE,
+    METRIC_LIST_NOTES,
+    METRIC_DELETE_NOTE,
+    METRIC_ADD_FOLDER,
+    METRIC_RESOLVE_PATH,
+    METRIC_DELETE_FOLDER,
+    METRIC_ADD_TASK,
+    METRIC_EXECUTE_TASK,
+    METRIC_LIST_TASKS,
+    METRIC_DELETE_TASK,
+    METRIC_NEXT_DUE,
+    METRIC_SEARCH,
+    METRIC_FILE_CREATE,
+    METRIC_FILE_UNLINK,
+    METRIC_JOURNAL_WRITE,
+    METRIC_JOURNAL_SYNC,
+    METRIC_SNAPSHOT_WRITE,
+    METRIC_IMPORT,
+    METRIC_CLONE_FOLDER,
+    METRIC_FIND_NAME,
+    METRIC_COUNT
+};
+
+const char *metricNames[METRIC_COUNT] = {
+    "add_note", "open_note", "list_notes", "delete_note", "add_folder", "resolve_path", "delete_folder",
+    "add_task", "execute_task", "list_tasks", "delete_task", "next_due", "search",
+    "file_create", "file_unlink", "journal_write", "journal_sync", "snapshot_write", "import", "clone_folder",
+    "find_name"
+};
+
+// Structure to represent the samples of one operation; only the owning thread writes them
+struct MetricSlot{
+    atomic_ullong count;
+    atomic_ullong totalNanoseconds;
+    atomic_ullong maxNanoseconds;
+    atomic_ullong buckets[METRIC_BUCKETS];
+};
+
+// Structure to represent one thread's counters
+struct MetricsShard{
+    struct MetricSlot slots[METRIC_COUNT];
+    struct MetricsShard *next;
+    int inUse;
+};
+
+// Structure to represent every shard handed out so far
+struct MetricsRegistry{
+    struct MetricsShard *shards;
+    struct MetricsShard retired; // Samples of threads that have exited
+    pthread_mutex_t lock;
+    pthread_key_t exitKey;       // Its destructor retires the shard of an exiting thread
+    pthread_once_t started;
+};
+
+struct MetricsRegistry metricsRegistry = {.lock = PTHREAD_MUTEX_INITIALIZER, .started = PTHREAD_ONCE_INIT};
+_Thread_local struct MetricsShard *metricsShard;
+
+// Bytes held by the name indexes and position arrays of all folders, kept up to date where they grow and shrink
+atomic_llong nameIndexBytes = 0;
+atomic_llong positionArrayBytes = 0;
+
+// Function to add to a counter only the calling thread writes (a plain load and store, no locked instruction)
+void bumpMetric(atomic_ullong *counter, unsigned long long amount){
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + amount, memory_order_relaxed);
+}
+
+// Function to add one shard's samples into another; the caller holds the registry lock
+void mergeMetricsShard(struct MetricsShard *into, struct MetricsShard *from){
+    for (int m = 0; m < METRIC_COUNT; m++){
+        struct MetricSlot *target = &into->slots[m];
+        struct MetricSlot *source = &from->slots[m];
+        bumpMetric(&target->count, atomic_load_explicit(&source->count, memory_order_relaxed));
+        bumpMetric(&target->totalNanoseconds, atomic_load_explicit(&source->totalNanoseconds, memory_order_relaxed));
+        unsigned long long max = atomic_load_explicit(&source->maxNanoseconds, memory_order_relaxed);
+        if (max > atomic_load_explicit(&target->maxNanoseconds, memory_order_relaxed)){
+            atomic_store_explicit(&target->maxNanoseconds, max, memory_order_relaxed);
+        }
+        for (int b = 0; b < METRIC_BUCKETS; b++){
+            bumpMetric(&target->buckets[b], atomic_load_explicit(&source->buckets[b], memory_order_relaxed));
+        }
+    }
+}
+
+// Function to fold the shard of an exiting thread into the retired total and free it for the next thread
+void retireMetricsShard(void *argument){
+    struct MetricsShard *shard = (struct MetricsShard *)argument;
+    pthread_mutex_lock(&metricsRegistry.lock);
+    mergeMetricsShard(&metricsRegistry.retired, shard);
+    memset(shard->slots, 0, sizeof(shard->slots));
+    shard->inUse = 0;
+    pthread_mutex_unlock(&metricsRegistry.lock);
+    metricsShard = NULL; // Destructors run on the exiting thread itself
+}
+
+void startMetrics(void){
+    pthread_key_create(&metricsRegistry.exitKey, retireMetricsShard);
+}
+
+// Function to give the calling thread a shard, reusing one retired by an exited thread when possible
+struct MetricsShard *attachMetricsShard(void){
+    pthread_once(&metricsRegistry.started, startMetrics);
+    pthread_mutex_lock(&metricsRegistry.lock);
+    struct MetricsShard *shard = metricsRegistry.shards;
+    while (shard != NULL && shard->inUse){
+        shard = shard->next;
+    }
+    if (shard == NULL){
+        shard = (struct MetricsShard *)calloc(1, sizeof(struct MetricsShard));
+        if (shard == NULL){
+            fprintf(stderr, "Memory allocation failed.\n");
+            exit(1);
+        }
+        shard->next = metricsRegistry.shards;
+        metricsRegistry.shards = shard;
+    }
+    shard->inUse = 1;
+    pthread_mutex_unlock(&metricsRegistry.lock);
+    pthread_setspecific(metricsRegistry.exitKey, shard);
+    metricsShard = shard;
+    return shard;
+}
+
+// Function to read the monotonic clock in nanoseconds; pass the result to recordMetric when the operation ends
+uint64_t metricsNow(void){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+
+// Function to record one operation that began at started (a metricsNow() reading)
+void recordMetric(enum Metric metric, uint64_t started){
+    uint64_t elapsed = metricsNow() - started;
+    struct MetricsShard *shard = metricsShard != NULL ? metricsShard : attachMetricsShard();
+    struct MetricSlot *slot = &shard->slots[metric];
+    int bucket = elapsed == 0 ? 0 : 64 - __builtin_clzll(elapsed);
+    if (bucket >= METRIC_BUCKETS){
+        bucket = METRIC_BUCKETS - 1;
+    }
+    bumpMetric(&slot->count, 1);
+    bumpMetric(&slot->totalNanoseconds, elapsed);
+    bumpMetric(&slot->buckets[bucket], 1);
+    if (elapsed > atomic_load_explicit(&slot->maxNanoseconds, memory_order_relaxed)){
+        atomic_store_explicit(&slot->maxNanoseconds, elapsed, memory_order_relaxed);
+    }
+}
+
+// Function to add up the samples of every thread, live and exited
+void collectMetrics(struct MetricsShard *totals){
+    memset(totals, 0, sizeof(*totals));
+    pthread_mutex_lock(&metricsRegistry.lock);
+    mergeMetricsShard(totals, &metricsRegistry.retired);
+    for (struct MetricsShard *shard = metricsRegistry.shards; shard != NULL; shard = shard->next){
+        mergeMetricsShard(totals, shard);
+    }
+    pthread_mutex_unlock(&metricsRegistry.lock);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/*SLAB POOLS FOR FILE, FOLDER AND TASK NODES*/
+#define POOL_SLAB_BYTES 65536        // Target size of one slab
+#define MALLOC_CHUNK_OVERHEAD 16     // Approximate per-allocation bookkeeping of the system allocator
+
+// Structure to represent the header of one slab; its nodes follow it in the same allocation
+struct PoolSlab{
+    struct PoolSlab *next;
+};
+
+// Structure to represent a typed node pool: nodes are carved out of slabs and recycled through a free list
+struct NodePool{
+    const char *typeName;
+    size_t nodeSize;
+    struct PoolSlab *slabs;
+    char *bumpNext;         // Next never-used node in the newest slab
+    size_t bumpRemaining;
+    void *freeList;         // Released nodes, linked through their first word
+    size_t slabCount;
+    size_t liveNodes;
+    size_t allocations;     // Node allocations served over the pool's lifetime
+    size_t reusedNodes;     // Allocations served from the free list
+    pthread_mutex_t lock;   // Held by allocateFromPool and releaseToPool
+};
+
+// Structure to represent the workspace arena: every node of the workspace lives in one of these pools
+struct WorkspaceArena{
+    struct NodePool filePool;
+    struct NodePool folderPool;
+    struct NodePool taskPool;
+};
+
+struct WorkspaceArena workspaceArena = {
+    {"FileNode", sizeof(struct FileNode), NULL, NULL, 0, NULL, 0, 0, 0, 0, PTHREAD_MUTEX_INITIALIZER},
+    {"FolderNode", sizeof(struct FolderNode), NULL, NULL, 0, NULL, 0, 0, 0, 0, PTHREAD_MUTEX_INITIALIZER},
+    {"TaskNode", sizeof(struct TaskNode), NULL, NULL, 0, NULL, 0, 0, 0, 0, PTHREAD_MUTEX_INITIALIZER},
+};
+
+// Function to take a node from a pool, reusing a released node when one is available
+void *allocateFromPool(struct NodePool *pool){
+    void *node;
+    pthread_mutex_lock(&pool->lock);
+    if (pool->freeList != NULL){
+        node = pool->freeList;
+        pool->freeList = *(void **)node;
+        pool->reusedNodes++;
+    }
+    else{
+        if (pool->bumpRemaining == 0){
+            size_t nodesPerSlab = POOL_SLAB_BYTES / pool->nodeSize;
+            if (nodesPerSlab < 16){
+                nodesPerSlab = 16;
+            }
+            // Keep the nodes after the header aligned for any member type
+            size_t headerSize = (sizeof(struct PoolSlab) + 15) & ~(size_t)15;
+            struct PoolSlab *slab = (struct PoolSlab *)malloc(headerSize + nodesPerSlab * pool->nodeSize);
+            if (slab == NULL){
+                fprintf(stderr, "Memory allocation failed.\n");
+                exit(1);
+            }
+            slab->next = pool->slabs;
+            pool->slabs = slab;
+            pool->slabCount++;
+            pool->bumpNext = (char *)slab + headerSize;
+            pool->bumpRemaining = nodesPerSlab;
+        }
+        node = pool->bumpNext;
+        pool->bumpNext += pool->nodeSize;
+        pool->bumpRemaining--;
+    }
+    pool->allocations++;
+    pool->liveNodes++;
+    pthread_mutex_unlock(&pool->lock);
+    return node;
+}
+
+// Function to hand a node back to its pool's free list
+void releaseToPool(struct NodePool *pool, void *node){
+    pthread_mutex_lock(&pool->lock);
+    *(void **)node = pool->freeList;
+    pool->freeList = node;
+    pool->liveNodes--;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+// Function to move every slab of a private pool, and the nodes carved from them, into a shared pool of the same type.
+// The shared pool carries on carving from whichever of the two has more unused nodes in its newest slab.
+void adoptPoolSlabs(struct NodePool *into, struct NodePool *from){
+    if (from->slabs == NULL){
+        return;
+    }
+    struct PoolSlab *last = from->slabs;
+    while (last->next != NULL){
+        last = last->next;
+    }
+    pthread_mutex_lock(&into->lock);
+    last->next = into->slabs;
+    into->slabs = from->slabs;
+    into->slabCount += from->slabCount;
+    into->liveNodes += from->liveNodes;
+    into->allocations += from->allocations;
+    into->reusedNodes += from->reusedNodes;
+    if (from->bumpRemaining > into->bumpRemaining){
+        into->bumpNext = from->bumpNext;
+        into->bumpRemaining = from->bumpRemaining;
+    }
+    pthread_mutex_unlock(&into->lock);
+    from->slabs = NULL;
+    from->bumpNext = NULL;
+    from->bumpRemaining = 0;
+    from->slabCount = from->liveNodes = from->allocations = from->reusedNodes = 0;
+}
+
+// Function to free every slab of a pool at once, dropping all of its nodes
+void releasePool(struct NodePool *pool){
+    while (pool->slabs != NULL){
+        struct PoolSlab *slab = pool->slabs;
+        pool->slabs = slab->next;
+        free(slab);
+    }
+    pool->bumpNext = NULL;
+    pool->bumpRemaining = 0;
+    pool->freeList = NULL;
+    pool->slabCount = 0;
+    pool->liveNodes = 0;
+}
+
+// Function to tear down the whole workspace arena in one operation
+void releaseWorkspaceArena(struct WorkspaceArena *arena){
+    releasePool(&arena->filePool);
+    releasePool(&arena->folderPool);
+    releasePool(&arena->taskPool);
+}
+
+// Function to report how many allocator calls and bytes the pools saved compared to one malloc per node
+void printPoolSavings(struct WorkspaceArena *arena){
+    struct NodePool *pools[] = {&arena->filePool, &arena->folderPool, &arena->taskPool};
+    size_t savedCalls = 0;
+    for (int i = 0; i < 3; i++){
+        struct NodePool *pool = pools[i];
+        size_t saved = pool->allocations > pool->slabCount ? pool->allocations - pool->slabCount : 0;
+        printf(" %-10s %zu allocations (%zu reused) served by %zu slabs, %zu malloc calls saved\n",
+               pool->typeName, pool->allocations, pool->reusedNodes, pool->slabCount, saved);
+        savedCalls += saved;
+    }
+    printf(" Node pools saved %zu malloc/free pairs and about %zu bytes of allocator overhead.\n",
+           savedCalls, savedCalls * MALLOC_CHUNK_OVERHEAD);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/*INTERNED NAME POOL*/
+#define NAME_POOL_RESERVE ((size_t)1 << 32) // Address space reserved for names; NameRef offsets are 32-bit
+
+// Structure to represent the name pool: every distinct name stored once in one contiguous, never-moving block
+struct NamePool{
+    char *data;             // Reserved up front, so pointers returned by nameText() stay valid
+    size_t used;
+    size_t reserved;
+    struct NameRef *table;  // Open-addressing dedup table; length 0 marks an empty slot
+    size_t count;
+    size_t capacity;        // Always a power of two
+    pthread_mutex_t lock;   // Held while interning; reading through a handle needs no lock
+};
+
+struct NamePool namePool = {NULL, 0, 0, NULL, 0, 0, PTHREAD_MUTEX_INITIALIZER};
+
+// Function to hash a name (32-bit FNV-1a)
+uint32_t hashName(const char *name, size_t length){
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++){
+        hash ^= (unsigned char)name[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Function to get the '\0'-terminated text behind a name handle
+const char *nameText(struct NameRef name){
+    return name.length == 0 ? "" : namePool.data + name.offset;
+}
+
+// Function to check whether a handle names the given bytes: hash first, memcmp only on a hash match
+int nameEquals(struct NameRef name, const char *text, size_t length, uint32_t hash){
+    return name.hash == hash && name.length == length && memcmp(nameText(name), text, length) == 0;
+}
+
+// Function to reserve the pool's address space; the kernel only backs the pages that get written
+void initNamePool(struct NamePool *pool){
+    size_t reserve = NAME_POOL_RESERVE;
+    void *data = MAP_FAILED;
+    while (data == MAP_FAILED && reserve >= ((size_t)1 << 26)){
+        data = mmap(NULL, reserve, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (data == MAP_FAILED){
+            reserve /= 2;
+        }
+    }
+    if (data == MAP_FAILED){
+        fprintf(stderr, "Memory allocation failed.\n");
+        exit(1);
+    }
+    pool->data = (char *)data;
+    pool->reserved = reserve;
+    pool->data[0] = '\0'; // Offset 0 is the empty name
+    pool->used = 1;
+}
+
+// Function to place a handle into the dedup table without growing it
+void placeInternedName(struct NameRef *table, size_t capacity, struct NameRef name){
+    size_t slot = name.hash & (capacity - 1);
+    while (table[slot].length != 0){
+        slot = (slot + 1) & (capacity - 1);
+    }
+    table[slot] = name;
+}
+
+// Function to intern a non-empty name of the given length and hash; the caller holds the pool's lock, so a batch of
+// names can be interned under one acquisition
+struct NameRef internNameLocked(struct NamePool *pool, const char *text, size_t length, uint32_t hash){
+    struct NameRef name = {0, 0, hash};
+    if (pool->data == NULL){
+        initNamePool(pool);
+    }
+    if (pool->capacity != 0){
+        size_t slot = hash & (pool->capacity - 1);
+        while (pool->table[slot].length != 0){
+            if (nameEquals(pool->table[slot], text, length, hash)){
+                return pool->table[slot];
+            }
+            slot = (slot + 1) & (pool->capacity - 1);
+        }
+    }
+
+    if (length > UINT32_MAX || pool->used + length + 1 > pool->reserved){
+        fprintf(stderr, "Name pool exhausted.\n");
+        exit(1);
+    }
+    name.offset = (uint32_t)pool->used;
+    name.length = (uint32_t)length;
+    memcpy(pool->data + pool->used, text, length + 1);
+    pool->used += length + 1;
+
+    if ((pool->count + 1) * 2 > pool->capacity){
+        size_t newCapacity = pool->capacity == 0 ? 1024 : pool->capacity * 2;
+        struct NameRef *newTable = (struct NameRef *)calloc(newCapacity, sizeof(struct NameRef));
+        if (newTable == NULL){
+            fprintf(stderr, "Memory allocation failed.\n");
+            exit(1);
+        }
+        for (size_t i = 0; i < pool->capacity; i++){
+            if (pool->table[i].length != 0){
+                placeInternedName(newTable, newCapacity, pool->table[i]);
+            }
+        }
+        free(pool->table);
+        pool->table = newTable;
+        pool->capacity = newCapacity;
+    }
+    placeInternedName(pool->table, pool->capacity, name);
+    pool->count++;
+    return name;
+}
+
+// Function to intern a name: returns the existing handle for these bytes or appends them to the pool
+struct NameRef internName(const char *text){
+    size_t length = strlen(text);
+    uint32_t hash = hashName(text, length);
+    if (length == 0){
+        struct NameRef empty = {0, 0, hash};
+        return empty;
+    }
+    pthread_mutex_lock(&namePool.lock);
+    struct NameRef name = internNameLocked(&namePool, text, length, hash);
+    pthread_mutex_unlock(&namePool.lock);
+    return name;
+}
+
+// Function to drop the whole name pool
+void releaseNamePool(struct NamePool *pool){
+    if (pool->data != NULL){
+        munmap(pool->data, pool->reserved);
+    }
+    free(pool->table);
+    pool->data = NULL;
+    pool->table = NULL;
+    pool->used = pool->reserved = pool->count = pool->capacity = 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/*FOLDER IDS*/
+// Structure to represent the table from folder ids to live folders
+struct FolderRegistry{
+    struct FolderNode **byId; // NULL for ids of deleted folders
+    uint32_t count;           // Next id to hand out
+    uint32_t capacity;
+};
+
+struct FolderRegistry folderRegistry = {NULL, 0, 0};
+pthread_mutex_t registryLock = PTHREAD_MUTEX_INITIALIZER; // Held while either id registry hands out or retires an id
+
+// Function to give a folder the next free id
+void registerFolder(struct FolderNode *folder){
+    pthread_mutex_lock(&registryLock);
+    if (folderRegistry.count == folderRegistry.capacity){
+        uint32_t newCapacity = folderRegistry.capacity == 0 ? 64 : folderRegistry.capacity * 2;
+        struct FolderNode **newById = (struct FolderNode **)realloc(folderRegistry.byId, newCapacity * sizeof(struct FolderNode *));
+        if (newById == NULL){
+            fprintf(stderr, "Memory allocation failed.\n");
+            exit(1);
+        }
+        folderRegistry.byId = newById;
+        folderRegistry.capacity = newCapacity;
+    }
+    folder->folderId = folderRegistry.count;
+    folderRegistry.byId[folderRegistry.count++] = folder;
+    pthread_mutex_unlock(&registryLock);
+}
+
+// Function to give a folder the id a journal record names, as replay does; ids skipped so far stay empty until their
+// own records come. Returns 0, or -1 (giving the folder the next free id instead) if that id is already taken.
+int registerFolderAs(struct FolderNode *folder, uint32_t folderId){
+    pthread_mutex_lock(&registryLock);
+    if (folderId < folderRegistry.count && folderRegistry.byId[folderId] != NULL){
+        pthread_mutex_unlock(&registryLock);
+        registerFolder(folder);
+        return -1;
+    }
+    if (folderId >= folderRegistry.capacity){
+        uint32_t newCapacity = folderRegistry.capacity == 0 ? 64 : folderRegistry.capacity;
+        while (newCapacity <= folderId){
+            newCapacity *= 2;
+        }
+        struct FolderNode **newById = (struct FolderNode **)realloc(folderRegistry.byId, newCapacity * sizeof(struct FolderNode *));
+        if (newById == NULL){
+            fprintf(stderr, "Memory allocation failed.\n");
+            exit(1);
+        }
+        folderRegistry.byId = newById;
+        folderRegistry.capacity = newCapacity;
+    }
+    while (folderRegistry.count <= folderId){
+        folderRegistry.byId[folderRegistry.count++] = NULL;
+    }
+    folder->folderId = folderId;
+    folderRegistry.byId[folderId] = folder;
+    pthread_mutex_unlock(&registryLock);
+    return 0;
+}
+
+// Function to find a live folder by id, or NULL
+struct FolderNode *findFolderById(uint32_t folderId){
+    return folderId < folderRegistry.count ? folderRegistry.byId[folderId] : NULL;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/*NOTE IDS*/
+// Structure to represent the table from note ids to live notes; ids are never reused
+struct NoteRegistry{
+    struct FileNode **byId; // NULL for ids of deleted or re-indexed notes
+    uint32_t count;
+    uint32_t capacity;
+};
+
+struct NoteRegistry noteRegistry = {NULL, 0, 0};
+
+// Structure to represent how many live notes carry one name
+struct NoteNameUse{
+    struct NameRef name; // Length 0 marks an empty slot
+    uint32_t count;
+};
+
+// Structure to represent the use counts of note names. A note's file (or store entry) belongs to its name, and several
+// folders can hold a note of the same name, so the file is only removed with the last of them.
+struct NoteNameUses{
+    struct NoteNameUse *slots;
+    size_t used;
+    size_t capacity; // Always a power of two
+};
+
+struct NoteNameUses noteNameUses = {NULL, 0, 0};
+
+// Function to place a use count into the slots without growing them
+void placeNoteNameUse(struct NoteNameUse *slots, size_t capacity, struct NoteNameUse use){
+    size_t slot = use.name.hash & (capacity - 1);
+    while (slots[slot].name.length != 0){
+        slot = (slot + 1) & (capacity - 1);
+    }
+    slots[slot] = use;
+}
+
+// Function to find the use count of a name, adding it at 0 if it is new; the caller holds the registry lock
+uint32_t *findNoteNameUses(struct NoteNameUses *uses, struct NameRef name){
+    if ((uses->used + 1) * 2 > uses->capacity){
+        size_t newCapacity = uses->capacity == 0 ? 1024 : uses->capacity * 2;
+        struct NoteNameUse *newSlots = (struct NoteNameUse *)calloc(newCapacity, sizeof(struct NoteNameUse));
+        if (newSlots == NULL){
+            fprintf(stderr, "Memory allocation failed.\n");
+            exit(1);
+        }
+        for (size_t i = 0; i < uses->capacity; i++){
+            if (uses->slots[i].name.length != 0){
+                placeNoteNameUse(newSlots, newCapacity, uses->slots[i]);
+            }
+        }
+        free(uses->slots);
+        uses->slots = newSlots;
+        uses->capacity = newCapacity;
+    }
+    size_t slot = name.hash & (uses->capacity - 1);
+    while (uses->slots[slot].name.length != 0 && uses->slots[slot].name.offset != name.offset){
+        slot = (slot + 1) & (uses->capacity - 1);
+    }
+    if (uses->slots[slot].name.length == 0){
+        uses->slots[slot].name = name;
+        uses->used++;
+    }
+    return &uses->slots[slot].count;
+}
+
+// Function to give a note the next free id; the caller holds the registry lock
+void issueNoteId(struct FileNode *note){
+    if (noteRegistry.count == noteRegistry.capacity){
+        uint32_t newCapacity = noteRegistry.capacity == 0 ? 1024 : noteRegistry.capacity * 2;
+        struct FileNode **newById = (struct FileNode **)realloc(noteRegistry.byId, newCapacity * sizeof(struct FileNode *));
+        if (newById == NULL){
+            fprintf(stderr, "Memory allocation failed.\n");
+            exit(1);
+        }
+        noteRegistry.byId = newById;
+        noteRegistry.capacity = newCapacity;
+    }
+    note->fileId = noteRegistry.count;
+    noteRegistry.byId[noteRegistry.count++] = note;
+}
+
+// Function to give a new note its id and count it as a user of its name
+void registerNote(struct FileNode *note){
+    pthread_mutex_lock(&registryLock);
+    (*findNoteNameUses(&noteNameUses, note->filename))++;
+    issueNoteId(note);
+    pthread_mutex_unlock(&registryLock);
+}
+
+// Function to take a note's id away while the note is kept for undo; its name stays in use
+void retireNoteId(struct FileNode *note){
+    pthread_mutex_lock(&registryLock);
+    noteRegistry.byId[note->fileId] = NULL;
+    pthread_mutex_unlock(&registryLock);
+}
+
+// Function to give a note a fresh id after its content changed; its old id stops resolving
+void renumberNote(struct FileNode *note){
+    pthread_mutex_lock(&registryLock);
+    noteRegistry.byId[note->fileId] = NULL;
+    issueNoteId(note);
+    pthread_mutex_unlock(&registryLock);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/*CREATING FILE, FOLDER AND TASK NODES*/
+// Function to fill in a freshly allocated note node, leaving it without an id
+void initFileNode(struct FileNode *newNode, struct NameRef filename){
+    newNode->filename = filename;
+    newNode->next = NULL;
+    newNode->prev = NULL;
+    newNode->position = 0;
+    newNode->folder = NULL;
+    newNode->byteSize = 0;
+    newNode->finderSlot = UINT32_MAX; // Not listed by the name finder
+}
+// Function to create a new note node
+struct FileNode *createFileNode(struct NameRef filename){
+    struct FileNode *newNode = (struct FileNode *)allocateFromPool(&workspaceArena.filePool);
+    initFileNode(newNode, filename);
+    registerNote(newNode);
+    return newNode;
+}
+// Function to retire a note node: its id stops resolving and the node goes back to the pool. Returns 1 if no other
+// note has its name, so its file can go.
+int releaseFileNode(struct FileNode *note){
+    pthread_mutex_lock(&registryLock);
+    noteRegistry.byId[note->fileId] = NULL;
+    int lastUse = --*findNoteNameUses(&noteNameUses, note->filename) == 0;
+    pthread_mutex_unlock(&registryLock);
+    releaseToPool(&workspaceArena.filePool, note);
+    return lastUse;
+}
+// Function to fill in a freshly allocated folder node, leaving it without an id
+void initFolderNode(struct FolderNode *newNode, struct NameRef foldername, struct FolderNode *parentFolder){
+    newNode->foldername = foldername;
+    memset(&newNode->fileList, 0, sizeof(newNode->fileList));
+    newNode->firstChild = NULL;
+    newNode->lastChild = NULL;
+    newNode->nextFolder = NULL;
+    newNode->prevFolder = NULL;
+    memset(&newNode->childIndex, 0, sizeof(newNode->childIndex));
+    memset(&newNode->stats, 0, sizeof(newNode->stats));
+    newNode->parentFolder = parentFolder;
+    newNode->inTrash = 0;
+    newNode->finderSlot = UINT32_MAX; // Not listed by the name finder
+    pthread_rwlock_init(&newNode->lock, NULL);
+}
+//Function to create a new folder node
+struct FolderNode *createFolderNode(struct NameRef foldername, struct FolderNode *parentFolder){
+    struct FolderNode *newNode = (struct FolderNode *)allocateFromPool(&workspaceArena.folderPool);
+    initFolderNode(newNode, foldername, parentFolder);
+    registerFolder(newNode);
+    return newNode;
+}
+//Function to create a folder node under the id a journal record gave it
+struct FolderNode *createFolderNodeWithId(struct NameRef foldername, struct FolderNode *parentFolder, uint32_t folderId){
+    struct FolderNode *newNode = (struct FolderNode *)allocateFromPool(&workspaceArena.folderPool);
+    initFolderNode(newNode, foldername, parentFolder);
+    registerFolderAs(newNode, folderId);
+    return newNode;
+}
+// Sequence number handed to the next new task; restored tasks push it past their own
+atomic_ullong nextTaskSeq = 1;
+
+//Function to create a new task node (seq 0 assigns a fresh sequence number)
+struct TaskNode *createTaskNode(struct NameRef taskname, int priority, int64_t dueTime, uint32_t repeatSeconds, uint64_t seq){
+    struct TaskNode *newNode = (struct TaskNode *)allocateFromPool(&workspaceArena.taskPool);
+    if (seq == 0){
+        seq = atomic_fetch_add(&nextTaskSeq, 1);
+    }
+    else{
+        unsigned long long next = atomic_load(&nextTaskSeq);
+        while (next <= seq && !atomic_compare_exchange_weak(&nextTaskSeq, &next, seq + 1)){
+        }
+    }
+    newNode->taskname = taskname;
+    newNode->priority = priority;
+    newNode->dueTime = dueTime;
+    newNode->repeatSeconds = repeatSeconds;
+    newNode->seq = seq;
+    newNode->heapIndex = 0;
+    newNode->timerNext = NULL;
+    newNode->timerPrev = NULL;
+    newNode->timerBucket = NULL;
+    return newNode;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/*NAME INDEX AND NOTE POSITION ARRAY*/
+// Function to find the node stored under a name given by its bytes, or NULL if the name is not indexed
+void *findInNameIndexBytes(struct NameIndex *index, const char *name, size_t length){
+    if (index->capacity == 0){
+        return NULL;
+    }
+    uint32_t hash = hashName(name, length);
+    size_t slot = hash & (index->capacity - 1);
+    while (index->slots[slot].node != NULL){
+        if (nameEquals(index->slots[slot].name, name, length, hash)){
+            return index->slots[slot].node;
+        }
+        slot = (slot + 1) & (index->capacity - 1);
+    }
+    return NULL;
+}
+
+// Function to find the node stored under a name, or NULL if the name is not indexed
+void *findInNameIndex(struct NameIndex *index, const char *name){
+    return findInNameIndexBytes(index, name, strlen(name));
+}
+
+// Function to place an entry into a name index table without growing it
+void placeNameIndexEntry(struct NameIndexEntry *slots, size_t capacity, struct NameIndexEntry entry){
+    size_t slot = entry.name.hash & (capacity - 1);
+    while (slots[slot].node != NULL){
+        slot = (slot + 1) & (capacity - 1);
+    }
+    slots[slot] = entry;
+}
+
+// Function to add a node to a name index, doubling the table to keep the load factor under one half
+void addToNameIndex(struct NameIndex *index, struct NameRef name, void *node){
+    if ((index->count + 1) * 2 > index->capacity){
+        size_t newCapacity = index->capacity == 0 ? 16 : index->capacity * 2;
+        struct NameIndexEntry *newSlots = (struct NameIndexEntry *)calloc(newCapacity, sizeof(struct NameIndexEntry));
+        if (newSlots == NULL){
+            fprintf(stderr, "Memory allocation failed.\n");
+            exit(1);
+        }
+        for (size_t i = 0; i < index->capacity; i++){
+            if (index->slots[i].node != NULL){
+                placeNameIndexEntry(newSlots, newCapacity, index->slots[i]);
+            }
+        }
+        free(index->slots);
+        atomic_fetch_add(&nameIndexBytes, (long long)((newCapacity - index->capacity) * sizeof(struct NameIndexEntry)));
+        index->slots = newSlots;
+        index->capacity = newCapacity;
+    }
+    struct NameIndexEntry entry = {name, node};
+    placeNameIndexEntry(index->slots, index->capacity, entry);
+    index->count++;
+}
+
+// Function to remove a node from a name index, shifting later entries back so no tombstones are needed
+void removeFromNameIndex(struct NameIndex *index, void *node, struct NameRef name){
+    size_t mask = index->capacity - 1;
+    size_t slot = name.hash & mask;
+    while (index->slots[slot].node != node){
+        slot = (slot + 1) & mask;
+    }
+    size_t hole = slot;
+    slot = (slot + 1) & mask;
+    while (index->slots[slot].node != NULL){
+        size_t home = index->slots[slot].name.hash & mask;
+        // Move the entry into the hole unless its home lies cyclically in (hole, slot]
+        if (((slot - home) & mask) >= ((slot - hole) & mask)){
+            index->slots[hole] = index->slots[slot];
+            hole = slot;
+        }
+        slot = (slot + 1) & mask;
+    }
+    index->slots[hole].node = NULL;
+    index->count--;
+}
+
+// Function to release the table of a name index
+void freeNameIndex(struct NameIndex *index){
+    atomic_fetch_sub(&nameIndexBytes, (long long)(index->capacity * sizeof(struct NameIndexEntry)));
+    free(index->slots);
+    index->slots = NULL;
+    index->count = index->capacity = 0;
+}
+
+// Function to release the position array of a note list
+void freePositionArray(struct FileList *list){
+    atomic_fetch_sub(&positionArrayBytes, (long long)(list->slotCapacity * sizeof(struct FileNode *)));
+    free(list->slots);
+    list->slots = NULL;
+    list->slotCount = list->slotCapacity = 0;
+}
+
+// Function to link a note node at the tail of a list and register it in the name index and position array
+void appendFileNode(struct FolderNode *folder, struct FileNode *newNode){
+    struct FileList *list = &folder->fileList;
+    newNode->folder = folder;
+    if (list->tail == NULL){
+        list->head = newNode;
+    }
+    else{
+        list->tail->next = newNode;
+        newNode->prev = list->tail;
+    }
+    list->tail = newNode;
+
+    if (list->slotCount == list->slotCapacity){
+        size_t newCapacity = list->slotCapacity == 0 ? 16 : list->slotCapacity * 2;
+        struct FileNode **newSlots = (struct FileNode **)realloc(list->slots, newCapacity * sizeof(struct FileNode *));
+        if (newSlots == NULL){
+            fprintf(stderr, "Memory allocation failed.\n");
+            exit(1);
+        }
+        atomic_fetch_add(&positionArrayBytes, (long long)((newCapacity - list->slotCapacity) * sizeof(struct FileNode *)));
+        list->slots = newSlots;
+        list->slotCapacity = newCapacity;
+    }
+    newNode->position = list->slotCount;
+    list->slots[list->slotCount++] = newNode;
+    addToNameIndex(&list->index, newNode->filename, newNode);
+    list->count++;
+}
+
+// Function to unlink a note node from its list, name index and position array
+void unlinkFileNode(struct FileList *list, struct FileNode *current){
+    if (current->prev != NULL){
+        current->prev->next = current->next;
+    }
+    else{
+        list->head = current->next;
+    }
+
+    if (current->next != NULL){
+        current->next->prev = current->prev;
+    }
+    else{
+        list->tail = current->prev;
+    }
+
+    removeFromNameIndex(&list->index, current, current->filename);
+    list->slots[current->position] = NULL;
+    list->count--;
+}
+
+// Function to squeeze the NULL holes out of a note list's position array
+void compactFileSlots(struct FileList *list){
+    size_t kept = 0;
+    for (size_t i = 0; i < list->slotCount; i++){
+        if (list->slots[i] != NULL){
+            list->slots[kept] = list->slots[i];
+            list->slots[kept]->position = kept;
+            kept++;
+        }
+    }
+    list->slotCount = kept;
+}
+
+// Function to get the note at a 1-based index, or NULL if the index is out of range
+struct FileNode *getFileAtIndex(struct FileList *list, int fileIndex){
+    if (fileIndex < 1 || (size_t)fileIndex > list->count){
+        return NULL;
+    }
+    // Holes are only squeezed out when an index lookup needs it, so runs of deletions stay O(1) each
+    if (list->slotCount != list->count){
+        compactFileSlots(list);
+    }
+    return list->slots[fileIndex - 1];
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/*MANAGED NOTE STORE*/
+// Optional home for note contents, switched on by the store command. A note's content is cut into chunks where a gear
+// rolling hash hits a boundary pattern, so an insertion only changes the chunks around it. Each chunk is named by its
+// SHA-256 and kept once, LZ-compressed, in the append-only pack file; the list of a note's chunk hashes (its recipe)
+// is stored the same way, and the recipe's hash is the note's content hash. The catalog maps each note file name, the
+// key plain note files use too, to the content hash of its latest version, so identical notes cost one catalog record
+// each and near-duplicates share most of their chunks. Readers stream a note chunk by chunk through a small cache of
+// decompressed chunks. A note without a catalog entry is read from its plain file as before.
+#define STORE_PACK_PATH "notemaker.pack"
+#define STORE_CATALOG_PATH "notemaker.catalog"
+#define STORE_PACK_MAGIC "NMPACK\0"
+#define STORE_CATALOG_MAGIC "NMCTLG\0"
+#define STORE_PACK_VERSION 1
+#define STORE_CATALOG_VERSION 2     // Version 1 catalog records had no checksum
+#define STORE_HASH_BYTES 32
+#define STORE_MIN_CHUNK 2048
+#define STORE_MAX_CHUNK 65536
+#define STORE_CHUNK_MASK ((1u << 13) - 1)  // A boundary every 8 KiB on average past the minimum
+#define STORE_CACHE_CHUNKS 64
+#define LZ_HASH_BITS 12
+#define LZ_MIN_MATCH 4
+
+// Kinds of objects in the pack
+enum StoreObjectType{
+    STORE_CHUNK = 1,
+    STORE_RECIPE
+};
+
+// Structure to represent the header of the pack file and of the catalog file
+struct StoreFileHeader{
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+};
+
+// Structure to represent the header in front of every object in the pack; the stored bytes follow it
+struct StoreObjectHeader{
+    unsigned char hash[STORE_HASH_BYTES]; // SHA-256 of the uncompressed bytes
+    uint8_t type;
+    uint8_t compressed;
+    uint16_t reserved;
+    uint32_t rawLength;
+    uint32_t storedLength;
+};
+
+// Structure to represent the fixed part of a catalog record; the name bytes follow it, then a checksumBytes() of both
+struct StoreCatalogRecord{
+    unsigned char hash[STORE_HASH_BYTES]; // Content hash (a recipe); ignored in a removal
+    uint32_t nameLength;
+    uint32_t removed;
+    uint64_t size;
+    int64_t modified;
+};
+
+// Structure to represent the fixed part of a recipe; the chunk hashes follow it
+struct StoreRecipeHeader{
+    uint64_t size;
+    uint32_t chunkCount;
+    uint32_t reserved;
+};
+
+// Structure to represent an object of the pack
+struct StoreObject{
+    unsigned char hash[STORE_HASH_BYTES];
+    uint64_t offset;        // Of the stored bytes
+    uint32_t rawLength;
+    uint32_t storedLength;
+    uint8_t type;
+    uint8_t compressed;
+};
+
+// Structure to represent the current version of a note in the catalog
+struct StoreNote{
+    struct NameRef name;    // Length 0 marks an empty slot
+    uint32_t recipe;        // Object number + 1; 0 once the note was removed
+    uint64_t size;
+    int64_t modified;
+};
+
+// Structure to represent a decompressed chunk in the cache
+struct StoreCacheEntry{
+    uint32_t object;        // Object number + 1; 0 marks an empty entry
+    unsigned char *data;
+    uint32_t length;
+    uint64_t lastUse;
+};
+
+// Structure to represent the note store
+struct NoteStore{
+    int active;
+    int packFd;
+    int catalogFd;
+    uint64_t packSize;
+    uint64_t catalogSize;
+    struct StoreObject *objects;
+    size_t objectCount;
+    size_t objectCapacity;
+    uint32_t *objectSlots;  // Object number + 1 by hash; 0 marks an empty slot
+    size_t slotCapacity;    // Always a power of two
+    struct StoreNote *notes;
+    size_t noteSlots;       // Always a power of two
+    size_t noteCount;       // Slots in use, removed notes included
+    size_t liveNotes;
+    uint64_t liveBytes;     // Content size of the notes in the catalog
+    size_t catalogRecords;
+    struct StoreCacheEntry cache[STORE_CACHE_CHUNKS];
+    uint64_t useClock;
+    size_t cacheHits;
+    size_t cacheMisses;
+    pthread_mutex_t lock;   // Held for the tables; chunks are read and decompressed outside it
+    pthread_mutex_t cacheLock;
+};
+
+struct NoteStore noteStore = {.packFd = -1, .catalogFd = -1, .lock = PTHREAD_MUTEX_INITIALIZER, .cacheLock = PTHREAD_MUTEX_INITIALIZER};
+
+// SHA-256 round constants
+const uint32_t sha256Constants[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+uint32_t rotateRight(uint32_t value, int bits){
+    return (value >> bits) | (value << (32 - bits));
+}
+
+// Function to run the SHA-256 compression function over one 64-byte block
+void sha256Block(uint32_t state[8], const unsigned char *block){
+    uint32_t w[64];
+    for (int i = 0; i < 16; i++){
+        w[i] = (uint32_t)block[i * 4] << 24 | (uint32_t)block[i * 4 + 1] << 16 | (uint32_t)block[i * 4 + 2] << 8 | block[i * 4 + 3];
+    }
+    for (int i = 16; i < 64; i++){
+        uint32_t s0 = rotateRight(w[i - 15], 7) ^ rotateRight(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = rotateRight(w[i - 2], 17) ^ rotateRight(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4], f = state[5], g = state[6], h = state[7];
+    for (int i = 0; i < 64; i++){
+        uint32_t t1 = h + (rotateRight(e, 6) ^ rotateRight(e, 11) ^ rotateRight(e, 25)) + ((e & f) ^ (~e & g)) + sha256Constants[i] + w[i];
+        uint32_t t2 = (rotateRight(a, 2) ^ rotateRight(a, 13) ^ rotateRight(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+    state[5] += f;
+    state[6] += g;
+    state[7] += h;
+}
+
+// Function to compute the SHA-256 of a buffer
+void sha256(const void *data, size_t length, unsigned char digest[STORE_HASH_BYTES]){
+    uint32_t state[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+    const unsigned char *bytes = (const unsigned char *)data;
+    size_t full = length & ~(size_t)63;
+    for (size_t i = 0; i < full; i += 64){
+        sha256Block(state, bytes + i);
+    }
+    // The tail, the 0x80 marker and the bit length fill one or two final blocks
+    unsigned char tail[128];
+    size_t rest = length - full;
+    memset(tail, 0, sizeof(tail));
+    memcpy(tail, bytes + full, rest);
+    tail[rest] = 0x80;
+    size_t tailLength = rest + 9 <= 64 ? 64 : 128;
+    uint64_t bits = (uint64_t)length * 8;
+    for (int i = 0; i < 8; i++){
+        tail[tailLength - 1 - i] = (unsigned char)(bits >> (8 * i));
+    }
+    for (size_t i = 0; i < tailLength; i += 64){
+        sha256Block(state, tail + i);
+    }
+    for (int i = 0; i < 8; i++){
+        digest[i * 4] = (unsigned char)(state[i] >> 24);
+        digest[i * 4 + 1] = (unsigned char)(state[i] >> 16);
+        digest[i * 4 + 2] = (unsigned char)(state[i] >> 8);
+        digest[i * 4 + 3] = (unsigned char)state[i];
+    }
+}
+
+// Gear table of the chunker: fixed pseudo-random values, so chunk boundaries are the same in every run
+uint64_t chunkGear[256];
+pthread_once_t chunkGearReady = PTHREAD_ONCE_INIT;
+
+void fillChunkGear(void){
+    uint64_t seed = 0x9e3779b97f4a7c15u;
+    for (int i = 0; i < 256; i++){
+        uint64_t z = (seed += 0x9e3779b97f4a7c15u); // splitmix64
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9u;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebu;
+        chunkGear[i] = z ^ (z >> 31);
+    }
+}
+
+// Function to find the length of the next chunk: the first boundary past the minimum, or the maximum size
+size_t nextChunkLength(const unsigned char *data, size_t length){
+    if (length <= STORE_MIN_CHUNK){
+        return length;
+    }
+    size_t limit = length < STORE_MAX_CHUNK ? length : STORE_MAX_CHUNK;
+    uint64_t fingerprint = 0;
+    for (size_t i = STORE_MIN_CHUNK; i < limit; i++){
+        fingerprint = (fingerprint << 1) + chunkGear[data[i]];
+        if ((fingerprint >> 40 & STORE_CHUNK_MASK) == 0){
+            return i + 1;
+        }
+    }
+    return limit;
+}
+
+// Function to write a length beyond a 4-bit token field as a run of 255s and a final byte
+unsigned char *writeLzLength(unsigned char *out, size_t extra){
+    while (extra >= 255){
+        *out++ = 255;
+        extra -= 255;
+    }
+    *out++ = (unsigned char)extra;
+    return out;
+}
+
+// Function to emit one sequence: a token, the literals, and (unless it is the last sequence) the match
+unsigned char *writeLzSequence(unsigned char *out, const unsigned char *literals, size_t literalLength, size_t offset, size_t matchLength){
+    unsigned char *token = out++;
+    *token = (unsigned char)((literalLength < 15 ? literalLength : 15) << 4);
+    if (literalLength >= 15){
+        out = writeLzLength(out, literalLength - 15);
+    }
+    memcpy(out, literals, literalLength);
+    out += literalLength;
+    if (matchLength != 0){
+        *out++ = (unsigned char)offset;
+        *out++ = (unsigned char)(offset >> 8);
+        size_t code = matchLength - LZ_MIN_MATCH;
+        *token |= (unsigned char)(code < 15 ? code : 15);
+        if (code >= 15){
+            out = writeLzLength(out, code - 15);
+        }
+    }
+    return out;
+}
+
+// Function to LZ-compress a buffer into a block of literal runs and back-references up to 64 KiB away. Returns the
+// compressed length, or 0 if it would not be smaller than the input; out must hold length + length / 255 + 16 bytes.
+size_t compressLz(const unsigned char *in, size_t length, unsigned char *out){
+    int32_t table[1 << LZ_HASH_BITS];
+    memset(table, -1, sizeof(table));
+    unsigned char *cursor = out;
+    size_t anchor = 0;
+    size_t i = 0;
+    while (length >= 12 && i + 12 <= length){ // The last bytes always go out as literals
+        uint32_t sequence;
+        memcpy(&sequence, in + i, 4);
+        uint32_t slot = (sequence * 2654435761u) >> (32 - LZ_HASH_BITS);
+        int32_t candidate = table[slot];
+        table[slot] = (int32_t)i;
+        uint32_t previous;
+        if (candidate < 0 || i - (size_t)candidate > 65535 || (memcpy(&previous, in + candidate, 4), previous != sequence)){
+            i++;
+            continue;
+        }
+        size_t match = LZ_MIN_MATCH;
+        while (i + match < length - 5 && in[candidate + match] == in[i + match]){
+            match++;
+        }
+        cursor = writeLzSequence(cursor, in + anchor, i - anchor, i - (size_t)candidate, match);
+        i += match;
+        anchor = i;
+    }
+    cursor = writeLzSequence(cursor, in + anchor, length - anchor, 0, 0);
+    size_t compressed = (size_t)(cursor - out);
+    return compressed < length ? compressed : 0;
+}
+
+// Function to read an extended length field; returns 0 if the block ends inside it
+int readLzLength(const unsigned char **in, const unsigned char *end, size_t *length){
+    unsigned char byte;
+    do{
+        if (*in >= end){
+            return 0;
+        }
+        byte = *(*in)++;
+        *length += byte;
+    } while (byte == 255);
+    return 1;
+}
+
+// Function to expand an LZ block into exactly length bytes; returns 0 on success, -1 if the block is malformed
+int decompressLz(const unsigned char *in, size_t inLength, unsigned char *out, size_t length){
+    const unsigned char *end = in + inLength;
+    size_t produced = 0;
+    while (in < end){
+        unsigned char token = *in++;
+        size_t literals = token >> 4;
+        if (literals == 15 && !readLzLength(&in, end, &literals)){
+            return -1;
+        }
+        if (literals > (size_t)(end - in) || literals > length - produced){
+            return -1;
+        }
+        memcpy(out + produced, in, literals);
+        in += literals;
+        produced += literals;
+        if (in == end){
+            break; // The last sequence has no match
+        }
+        if (end - in < 2){
+            return -1;
+        }
+        size_t offset = in[0] | (size_t)in[1] << 8;
+        in += 2;
+        size_t match = token & 15;
+        if (match == 15 && !readLzLength(&in, end, &match)){
+            return -1;
+        }
+        match += LZ_MIN_MATCH;
+        if (offset == 0 || offset > produced || match > length - produced){
+            return -1;
+        }
+        for (size_t i = 0; i < match; i++){ // Byte by byte: the match may overlap the bytes it produces
+            out[produced + i] = out[produced - offset + i];
+        }
+        produced += match;
+    }
+    return produced == length ? 0 : -1;
+}
+
+// Function to write all of a buffer to a file descriptor, retrying short writes
+int writeAllBytes(int fd, const void *bytes, size_t size){
+    const char *cursor = (const char *)bytes;
+    while (size > 0){
+        ssize_t written = write(fd, cursor, size);
+        if (written < 0){
+            if (errno == EINTR){
+                continue;
+            }
+            return -1;
+        }
+        cursor += written;
+        size -= (size_t)written;
+    }
+    return 0;
+}
+
+// Function to checksum a block of bytes a word at a time
+uint64_t checksumBytes(const unsigned char *data, size_t size){
+    uint64_t hash = 0x9E3779B97F4A7C15ull ^ size;
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8){
+        uint64_t word;
+        memcpy(&word, data + i, 8);
+        hash = (hash ^ word) * 0xFF51AFD7ED558CCDull;
+        hash ^= hash >> 29;
+    }
+    for (; i < size; i++){
+        hash = (hash ^ data[i]) * 0x100000001B3ull;
+    }
+    return hash ^ (hash >> 32);
+}
+
+// Function to find an object by hash; returns its number + 1, or 0. The caller holds the store lock.
+uint32_t findStoreObject(struct NoteStore *store, const unsigned char hash[STORE_HASH_BYTES]){
+    if (store->slotCapacity == 0){
+        return 0;
+    }
+    uint64_t key;
+    memcpy(&key, hash, sizeof(key));
+    size_t slot = (size_t)key & (store->slotCapacity - 1);
+    while (store->objectSlots[slot] != 0){
+        if (memcmp(store->objects[store->objectSlots[slot] - 1].hash, hash, STORE_HASH_BYTES) == 0){
+            return store->objectSlots[slot];
+        }
+        slot = (slot + 1) & (store->slotCapacity - 1);
+    }
+    return 0;
+}
+
+// Function to place an object number into the hash slots without growing them
+void placeStoreObject(uint32_t *slots, size_t capacity, const struct StoreObject *object, uint32_t number){
+    uint64_t key;
+    memcpy(&key, object->hash, sizeof(key));
+    size_t slot = (size_t)key & (capacity - 1);
+    while (slots[slot] != 0){
+        slot = (slot + 1) & (capacity - 1);
+    }
+    slots[slot] = number;
+}
+
+// Function to add an object to the tables; returns its number + 1. The caller holds the store lock.
+uint32_t addStoreObject(struct NoteStore *store, const struct StoreObject *object){
+    if (store->objectCount == store->objectCapacity){
+        size_t newCapacity = store->objectCapacity == 0 ? 1024 : store->objectCapacity * 2;
+        struct StoreObject *newObjects = (struct StoreObject *)realloc(store->objects, newCapacity * sizeof(struct StoreObject));
+        if (newObjects == NULL){
+            fprintf(stderr, "Memory allocation failed.\n");
+            exit(1);
+        }
+        store->objects = newObjects;
+        store->objectCapacity = newCapacity;
+    }
+    if ((store->objectCount + 1) * 2 > store->slotCapacity){
+        size_t newCapacity = store->slotCapacity == 0 ? 2048 : store->slotCapacity * 2;
+        uint32_t *newSlots = (uint32_t *)calloc(newCapacity, sizeof(uint32_t));
+        if (newSlots == NULL){
+            fprintf(stderr, "Memory allocation failed.\n");
+            exit(1);
+        }
+        for (size_t i = 0; i < store->objectCount; i++){
+            placeStoreObject(newSlots, newCapacity, &store->objects[i], (uint32_t)i + 1);
+        }
+        free(store->objectSlots);
+        store->objectSlots = newSlots;
+        store->slotCapacity = newCapacity;
+    }
+    store->objects[store->objectCount] = *object;
+    uint32_t number = (uint32_t)++store->objectCount;
+    placeStoreObject(store->objectSlots, store->slotCapacity, object, number);
+    return number;
+}
+
+// Function to find a note's catalog slot, or the empty slot where it would go. The caller holds the store lock.
+struct StoreNote *findStoreNoteSlot(struct NoteStore *store, const char *name, size_t length, uint32_t hash){
+    size_t slot = hash & (store->noteSlots - 1);
+    while (store->notes[slot].name.length != 0 && !nameEquals(store->notes[slot].name, name, length, hash)){
+        slot = (slot + 1) & (store->noteSlots - 1);
+    }
+    return &store->notes[slot];
+}
+
+// Function to find a note in the catalog, or NULL if it is not there (or was removed). The caller holds the store lock.
+struct StoreNote *findStoreNote(struct NoteStore *store, const char *name){
+    if (store->noteSlots == 0){
+        return NULL;
+    }
+    size_t length = strlen(name);
+    struct StoreNote *note = findStoreNoteSlot(store, name, length, hashName(name, length));
+    return note->name.length != 0 && note->recipe != 0 ? note : NULL;
+}
+
+// Function to record a note's new version (recipe 0 removes it) in the catalog table. The caller holds the store lock.
+void setStoreNote(struct NoteStore *store, struct NameRef name, uint32_t recipe, uint64_t size, int64_t modified){
+    if ((store->noteCount + 1) * 2 > store->noteSlots){
+        size_t newSlots = store->noteSlots == 0 ? 1024 : store->noteSlots * 2;
+        struct StoreNote *newNotes = (struct StoreNote *)calloc(newSlots, sizeof(struct StoreNote));
+        if (newNotes == NULL){
+            fprintf(stderr, "Memory allocation failed.\n");
+            exit(1);
+        }
+        struct StoreNote *oldNotes = store->notes;
+        size_t oldSlots = store->noteSlots;
+        store->notes = newNotes;
+        store->noteSlots = newSlots;
+        for (size_t i = 0; i < oldSlots; i++){
+            if (oldNotes[i].name.length != 0){
+                *findStoreNoteSlot(store, nameText(oldNotes[i].name), oldNotes[i].name.length, oldNotes[i].name.hash) = oldNotes[i];
+            }
+        }
+        free(oldNotes);
+    }
+    struct StoreNote *note = findStoreNoteSlot(store, nameText(name), name.length, name.hash);
+    if (note->name.length == 0){
+        note->name = name;
+        store->noteCount++;
+    }
+    if (note->recipe != 0){
+        store->liveNotes--;
+        store->liveBytes -= note->size;
+    }
+    note->recipe = recipe;
+    note->size = recipe != 0 ? size : 0;
+    note->modified = modified;
+    if (recipe != 0){
+        store->liveNotes++;
+        store->liveBytes += size;
+    }
+}
+
+// Function to append an object to the pack unless one with the same hash is there; returns its number + 1.
+// The caller holds the store lock.
+uint32_t writeStoreObject(struct NoteStore *store, enum StoreObjectType type, const unsigned char *data, size_t length){
+    struct StoreObject object;
+    memset(&object, 0, sizeof(object));
+    sha256(data, length, object.hash);
+    uint32_t existing = findStoreObject(store, object.hash);
+    if (existing != 0){
+        return existing;
+    }
+    unsigned char *packed = (unsigned char *)malloc(sizeof(struct StoreObjectHeader) + length + length / 255 + 16);
+    if (packed == NULL){
+        fprintf(stderr, "Memory allocation failed.\n");
+        exit(1);
+    }
+    unsigned char *body = packed + sizeof(struct StoreObjectHeader);
+    size_t stored = type == STORE_CHUNK ? compressLz(data, length, body) : 0;
+    object.compressed = stored != 0;
+    if (stored == 0){
+        memcpy(body, data, length);
+        stored = length;
+    }
+    struct StoreObjectHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.hash, object.hash, STORE_HASH_BYTES);
+    header.type = (uint8_t)type;
+    header.compressed = object.compressed;
+    header.rawLength = (uint32_t)length;
+    header.storedLength = (uint32_t)stored;
+    memcpy(packed, &header, sizeof(header));
+    if (writeAllBytes(store->packFd, packed, sizeof(header) + stored) != 0){
+        fprintf(stderr, "Could not write the note store: %s\n", strerror(errno));
+        exit(1);
+    }
+    free(packed);
+    object.offset = store->packSize + sizeof(header);
+    object.rawLength = header.rawLength;
+    object.storedLength = header.storedLength;
+    object.type = header.type;
+    store->packSize += sizeof(header) + stored;
+    return addStoreObject(store, &object);
+}
+
+// Function to chunk a note's content into the pack and store its recipe; returns the recipe's number + 1.
+// The caller holds the store lock.
+uint32_t writeStoreContent(struct NoteStore *store, const unsigned char *data, size_t length){
+    pthread_once(&chunkGearReady, fillChunkGear);
+    size_t capacity = sizeof(struct StoreRecipeHeader) + (length / STORE_MIN_CHUNK + 1) * STORE_HASH_BYTES;
+    unsigned char *recipe = (unsigned char *)malloc(capacity);
+    if (recipe == NULL){
+        fprintf(stderr, "Memory allocation failed.\n");
+        exit(1);
+    }
+    struct StoreRecipeHeader header = {length, 0, 0};
+    size_t used = sizeof(header);
+    for (size_t offset = 0; offset < length;){
+        size_t chunk = nextChunkLength(data + offset, length - offset);
+        uint32_t number = writeStoreObject(store, STORE_CHUNK, data + offset, chunk);
+        memcpy(recipe + used, store->objects[number - 1].hash, STORE_HASH_BYTES);
+        used += STORE_HASH_BYTES;
+        header.chunkCount++;
+        offset += chunk;
+    }
+    memcpy(recipe, &header, sizeof(header));
+    uint32_t number = writeStoreObject(store, STORE_RECIPE, recipe, used);
+    free(recipe);
+    return number;
+}
+
+// Function to append a catalog record; the caller holds the store lock
+void writeStoreCatalogRecord(struct NoteStore *store, const char *name, uint32_t recipe, uint64_t size, int64_t modified){
+    size_t length = strlen(name);
+    size_t recordSize = sizeof(struct StoreCatalogRecord) + length + sizeof(uint64_t);
+    unsigned char *record = (unsigned char *)malloc(recordSize);
+    if (record == NULL){
+        fprintf(stderr, "Memory allocation failed.\n");
+        exit(1);
+    }
+    struct StoreCatalogRecord fixed;
+    memset(&fixed, 0, sizeof(fixed));
+    if (recipe != 0){
+        memcpy(fixed.hash, store->objects[recipe - 1].hash, STORE_HASH_BYTES);
+    }
+    fixed.nameLength = (uint32_t)length;
+    fixed.removed = recipe == 0;
+    fixed.size = size;
+    fixed.modified = modified;
+    memcpy(record, &fixed, sizeof(fixed));
+    memcpy(record + sizeof(fixed), name, length);
+    uint64_t checksum = checksumBytes(record, sizeof(fixed) + length);
+    memcpy(record + sizeof(fixed) + length, &checksum, sizeof(checksum));
+    if (writeAllBytes(store->catalogFd, record, recordSize) != 0){
+        fprintf(stderr, "Could not write the note store: %s\n", strerror(errno));
+        exit(1);
+    }
+    free(record);
+    store->catalogSize += recordSize;
+    store->catalogRecords++;
+}
+
+// Function to open a store file, creating it with its header if it does not exist; fileVersion receives the format of
+// the file (1 up to version). Returns the descriptor, -1 if it cannot be opened, or -2 (after saying why) if it is not a
+// store file this version can read; such a file is left as is.
+int openStoreFile(const char *path, const char *magic, uint32_t version, uint32_t *fileVersion, uint64_t *size){
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0){
+        if (fd >= 0){
+            close(fd);
+        }
+        return -1;
+    }
+    *size = (uint64_t)info.st_size;
+    struct StoreFileHeader expected;
+    memset(&expected, 0, sizeof(expected));
+    memcpy(expected.magic, magic, sizeof(expected.magic));
+    expected.version = version;
+    struct StoreFileHeader header;
+    memset(&header, 0, sizeof(header));
+    size_t present = *size < sizeof(header) ? (size_t)*size : sizeof(header);
+    if (pread(fd, &header, present, 0) != (ssize_t)present){
+        close(fd);
+        return -1;
+    }
+    const char *problem = NULL;
+    if (memcmp(header.magic, expected.magic, present < sizeof(header.magic) ? present : sizeof(header.magic)) != 0){
+        problem = "not a note store file";
+    }
+    else if (present == sizeof(header) && (header.version < 1 || header.version > version)){
+        problem = "unsupported note store version";
+    }
+    if (problem != NULL){
+        fprintf(stderr, "Ignoring %s: %s.\n", path, problem);
+        close(fd);
+        return -2;
+    }
+    if (present < sizeof(header)){ // New, or a crash cut its header short while it was being created
+        if (ftruncate(fd, 0) != 0 || pwrite(fd, &expected, sizeof(expected), 0) != (ssize_t)sizeof(expected) || fsync(fd) != 0){
+            close(fd);
+            return -1;
+        }
+        *size = sizeof(expected);
+        header.version = version;
+    }
+    *fileVersion = header.version;
+    return fd;
+}
+
+// Function to load the object table from a pack whose header has been checked; an object cut short by a crash is
+// dropped with everything after it
+void loadStorePack(struct NoteStore *store){
+    unsigned char *file = (unsigned char *)mmap(NULL, store->packSize, PROT_READ, MAP_PRIVATE, store->packFd, 0);
+    if (file == MAP_FAILED){
+        fprintf(stderr, "Could not read the note store: %s\n", strerror(errno));
+        exit(1);
+    }
+    uint64_t offset = sizeof(struct StoreFileHeader);
+    while (offset + sizeof(struct StoreObjectHeader) <= store->packSize){
+        struct StoreObjectHeader header;
+        memcpy(&header, file + offset, sizeof(header));
+        if ((header.type != STORE_CHUNK && header.type != STORE_RECIPE) ||
+            offset + sizeof(header) + header.storedLength > store->packSize){
+            break;
+        }
+        struct StoreObject object;
+        memset(&object, 0, sizeof(object));
+        memcpy(object.hash, header.hash, STORE_HASH_BYTES);
+        object.offset = offset + sizeof(header);
+        object.rawLength = header.rawLength;
+        object.storedLength = header.storedLength;
+        object.type = header.type;
+        object.compressed = header.compressed;
+        if (findStoreObject(store, object.hash) == 0){
+            addStoreObject(store, &object);
+        }
+        offset += sizeof(header) + header.storedLength;
+    }
+    munmap(file, store->packSize);
+    if (offset != store->packSize && ftruncate(store->packFd, (off_t)offset) != 0){
+        fprintf(stderr, "Could not repair the note store: %s\n", strerror(errno));
+        exit(1);
+    }
+    store->packSize = offset;
+}
+
+// Function to replay a catalog of the given version whose header has been checked. Replay stops at the first torn or
+// corrupt record, as the journal's does; records naming content the pack lost in a crash are skipped.
+void loadStoreCatalog(struct NoteStore *store, uint32_t version){
+    unsigned char *file = (unsigned char *)mmap(NULL, store->catalogSize, PROT_READ, MAP_PRIVATE, store->catalogFd, 0);
+    if (file == MAP_FAILED){
+        fprintf(stderr, "Could not read the note store: %s\n", strerror(errno));
+        exit(1);
+    }
+    uint64_t offset = sizeof(struct StoreFileHeader);
+    char *name = NULL;
+    size_t nameCapacity = 0;
+    size_t checksumSize = version >= 2 ? sizeof(uint64_t) : 0;
+    while (offset + sizeof(struct StoreCatalogRecord) + checksumSize <= store->catalogSize){
+        struct StoreCatalogRecord record;
+        memcpy(&record, file + offset, sizeof(record));
+        uint64_t recordSize = sizeof(record) + (uint64_t)record.nameLength + checksumSize;
+        if (record.nameLength == 0 || offset + recordSize > store->catalogSize){
+            break;
+        }
+        if (checksumSize != 0){
+            uint64_t checksum;
+            memcpy(&checksum, file + offset + sizeof(record) + record.nameLength, sizeof(checksum));
+            if (checksum != checksumBytes(file + offset, sizeof(record) + record.nameLength)){
+                break;
+            }
+        }
+        if (record.nameLength + 1 > nameCapacity){
+            nameCapacity = record.nameLength + 1;
+            free(name);
+            name = (char *)malloc(nameCapacity);
+            if (name == NULL){
+                fprintf(stderr, "Memory allocation failed.\n");
+                exit(1);
+            }
+        }
+        memcpy(name, file + offset + sizeof(record), record.nameLength);
+        name[record.nameLength] = '\0';
+        uint32_t recipe = record.removed ? 0 : findStoreObject(store, record.hash);
+        setStoreNote(store, internName(name), recipe, record.size, record.modified);
+        store->catalogRecords++;
+        offset += recordSize;
+    }
+    free(name);
+    munmap(file, store->catalogSize);
+    if (offset != store->catalogSize && ftruncate(store->catalogFd, (off_t)offset) != 0){
+        fprintf(stderr, "Could not repair the note store: %s\n", strerror(errno));
+        exit(1);
+    }
+    store->catalogSize = offset;
+}
+
+// Function to write the catalog afresh in the current format, one record per note it holds, and swap it in for the
+// old file; returns 0 on success. The caller holds the store lock.
+int rewriteStoreCatalog(struct NoteStore *store){
+    const char *tempPath = STORE_CATALOG_PATH ".tmp";
+    int fd = open(tempPath, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0){
+        return -1;
+    }
+    struct StoreFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, STORE_CATALOG_MAGIC, sizeof(header.magic));
+    header.version = STORE_CATALOG_VERSION;
+    if (writeAllBytes(fd, &header, sizeof(header)) != 0){
+        close(fd);
+        unlink(tempPath);
+        return -1;
+    }
+    int oldFd = store->catalogFd;
+    store->catalogFd = fd;
+    store->catalogSize = sizeof(header);
+    store->catalogRecords = 0;
+    for (size_t i = 0; i < store->noteSlots; i++){
+        struct StoreNote *note = &store->notes[i];
+        if (note->name.length != 0 && note->recipe != 0){
+            writeStoreCatalogRecord(store, nameText(note->name), note->recipe, note->size, note->modified);
+        }
+    }
+    if (fsync(fd) != 0 || rename(tempPath, STORE_CATALOG_PATH) != 0){
+        close(fd);
+        unlink(tempPath);
+        store->catalogFd = oldFd;
+        return -1;
+    }
+    close(oldFd);
+    return 0;
+}
+
+// Function to open the note store: load it if it exists, or create it when create is set. Returns 0 once it is active,
+// or -1 if there is no store or its files are not ones this version can read; the store then stays inactive.
+int openNoteStore(struct NoteStore *store, int create){
+    pthread_mutex_lock(&store->lock);
+    if (store->active){
+        pthread_mutex_unlock(&store->lock);
+        return 0;
+    }
+    if (!create && access(STORE_PACK_PATH, F_OK) != 0){
+        pthread_mutex_unlock(&store->lock);
+        return -1;
+    }
+    uint32_t packVersion;
+    uint32_t catalogVersion;
+    store->packFd = openStoreFile(STORE_PACK_PATH, STORE_PACK_MAGIC, STORE_PACK_VERSION, &packVersion, &store->packSize);
+    if (store->packFd >= 0){
+        store->catalogFd = openStoreFile(STORE_CATALOG_PATH, STORE_CATALOG_MAGIC, STORE_CATALOG_VERSION, &catalogVersion, &store->catalogSize);
+    }
+    if (store->packFd == -2 || store->catalogFd == -2){
+        if (store->packFd >= 0){
+            close(store->packFd);
+        }
+        store->packFd = store->catalogFd = -1;
+        fprintf(stderr, "The note store is not in use; notes kept in it cannot be opened.\n");
+        pthread_mutex_unlock(&store->lock);
+        return -1;
+    }
+    if (store->packFd < 0 || store->catalogFd < 0){
+        fprintf(stderr, "Could not open the note store: %s\n", strerror(errno));
+        exit(1);
+    }
+    loadStorePack(store);
+    loadStoreCatalog(store, catalogVersion);
+    if (catalogVersion < STORE_CATALOG_VERSION && rewriteStoreCatalog(store) != 0){ // New records never go into an older format
+        fprintf(stderr, "Could not rewrite the note store catalog: %s\n", strerror(errno));
+        exit(1);
+    }
+    if (lseek(store->packFd, 0, SEEK_END) < 0 || lseek(store->catalogFd, 0, SEEK_END) < 0){
+        fprintf(stderr, "Could not open the note store: %s\n", strerror(errno));
+        exit(1);
+    }
+    store->active = 1;
+    pthread_mutex_unlock(&store->lock);
+    return 0;
+}
+
+// Function to check whether new notes go to the store rather than to plain files
+int noteStoreActive(void){
+    pthread_mutex_lock(&noteStore.lock);
+    int active = noteStore.active;
+    pthread_mutex_unlock(&noteStore.lock);
+    return active;
+}
+
+// Function to store a new version of a note from a buffer. The pack is made durable before the catalog record that
+// names its content is written; with sync set, the catalog record is made durable too.
+void storeNoteContent(struct NoteStore *store, const char *name, const unsigned char *data, size_t length, int64_t modified, int sync){
+    pthread_mutex_lock(&store->lock);
+    uint32_t recipe = writeStoreContent(store, data, length);
+    if (sync){
+        fdatasync(store->packFd);
+    }
+    writeStoreCatalogRecord(store, name, recipe, length, modified);
+    setStoreNote(store, internName(name), recipe, length, modified);
+    if (sync){
+        fdatasync(store->catalogFd);
+    }
+    pthread_mutex_unlock(&store->lock);
+}
+
+// Function to drop a note from the catalog; returns 1 if it was there. Its chunks stay in the pack.
+int removeStoredNote(struct NoteStore *store, const char *name){
+    pthread_mutex_lock(&store->lock);
+    int found = store->active && findStoreNote(store, name) != NULL;
+    if (found){
+        writeStoreCatalogRecord(store, name, 0, 0, (int64_t)time(NULL));
+        setStoreNote(store, internName(name), 0, 0, (int64_t)time(NULL));
+    }
+    pthread_mutex_unlock(&store->lock);
+    return found;
+}
+
+// Function to get the size and modification time of a stored note; returns 0 if the store does not hold it
+int findStoredNoteInfo(struct NoteStore *store, const char *name, uint64_t *size, int64_t *modified){
+    pthread_mutex_lock(&store->lock);
+    struct StoreNote *note = store->active ? findStoreNote(store, name) : NULL;
+    if (note != NULL){
+        *size = note->size;
+        *modified = note->modified;
+    }
+    pthread_mutex_unlock(&store->lock);
+    return note != NULL;
+}
+
+// Function to read an object's stored bytes and expand them into a new buffer; NULL if it is damaged
+unsigned char *loadStoreObject(struct NoteStore *store, const struct StoreObject *object){
+    unsigned char *stored = (unsigned char *)malloc(object->storedLength + 1);
+    unsigned char *raw = object->compressed ? (unsigned char *)malloc(object->rawLength + 1) : stored;
+    if (stored == NULL || raw == NULL){
+        fprintf(stderr, "Memory allocation failed.\n");
+        exit(1);
+    }
+    size_t done = 0;
+    while (done < object->storedLength){
+        ssize_t got = pread(store->packFd, stored + done, object->storedLength - done, (off_t)(object->offset + done));
+        if (got < 0 && errno == EINTR){
+            continue;
+        }
+        if (got <= 0){
+            break;
+        }
+        done += (size_t)got;
+    }
+    unsigned char hash[STORE_HASH_BYTES];
+    int intact = done == object->storedLength &&
+                 (!object->compressed || decompressLz(stored, object->storedLength, raw, object->rawLength) == 0);
+    if (intact){
+        sha256(raw, object->rawLength, hash);
+        intact = memcmp(hash, object->hash, STORE_HASH_BYTES) == 0;
+    }
+    if (raw != stored){
+        free(stored);
+    }
+    if (!intact){
+        free(raw);
+        return NULL;
+    }
+    return raw;
+}
+
+// Function to pass one chunk to a reader through the cache of decompressed chunks; returns 0, or -1 if it is damaged
+int readStoreChunk(struct NoteStore *store, uint32_t number, struct StoreObject object,
+                   void (*consume)(void *context, const unsigned char *bytes, size_t length), void *context){
+    pthread_mutex_lock(&store->cacheLock);
+    for (int i = 0; i < STORE_CACHE_CHUNKS; i++){
+        if (store->cache[i].object == number){
+            store->cache[i].lastUse = ++store->useClock;
+            store->cacheHits++;
+            consume(context, store->cache[i].data, store->cache[i].length);
+            pthread_mutex_unlock(&store->cacheLock);
+            return 0;
+        }
+    }
+    store->cacheMisses++;
+    pthread_mutex_unlock(&store->cacheLock);
+
+    unsigned char *data = loadStoreObject(store, &object); // Read and expanded without holding the cache
+    if (data == NULL){
+        return -1;
+    }
+    pthread_mutex_lock(&store->cacheLock);
+    int victim = 0;
+    for (int i = 1; i < STORE_CACHE_CHUNKS; i++){
+        if (store->cache[i].lastUse < store->cache[victim].lastUse){
+            victim = i;
+        }
+    }
+    free(store->cache[victim].data);
+    store->cache[victim].object = number;
+    store->cache[victim].data = data;
+    store->cache[victim].length = object.rawLength;
+    store->cache[victim].lastUse = ++store->useClock;
+    consume(context, data, object.rawLength);
+    pthread_mutex_unlock(&store->cacheLock);
+    return 0;
+}
+
+// Function to stream a stored note to consume, chunk by chunk. Returns the bytes passed on, or -1 if the store does
+// not hold the note (a damaged chunk ends the stream early).
+long long readStoredNote(struct NoteStore *store, const char *name,
+                         void (*consume)(void *context, const unsigned char *bytes, size_t length), void *context){
+    pthread_mutex_lock(&store->lock);
+    struct StoreNote *note = store->active ? findStoreNote(store, name) : NULL;
+    if (note == NULL){
+        pthread_mutex_unlock(&store->lock);
+        return -1;
+    }
+    struct StoreObject recipeObject = store->objects[note->recipe - 1];
+    pthread_mutex_unlock(&store->lock);
+
+    unsigned char *recipe = loadStoreObject(store, &recipeObject);
+    if (recipe == NULL){
+        fprintf(stderr, "The note store copy of %s is damaged.\n", name);
+        return 0;
+    }
+    struct StoreRecipeHeader header;
+    memcpy(&header, recipe, sizeof(header));
+    long long passed = 0;
+    for (uint32_t i = 0; i < header.chunkCount; i++){
+        pthread_mutex_lock(&store->lock);
+        uint32_t number = findStoreObject(store, recipe + sizeof(header) + (size_t)i * STORE_HASH_BYTES);
+        struct StoreObject chunk;
+        if (number != 0){
+            chunk = store->objects[number - 1];
+        }
+        pthread_mutex_unlock(&store->lock);
+        if (number == 0 || readStoreChunk(store, number, chunk, consume, context) != 0){
+            fprintf(stderr, "The note store copy of %s is damaged.\n", name);
+            break;
+        }
+        passed += chunk.rawLength;
+    }
+    free(recipe);
+    return passed;
+}
+
+// Function to pass streamed bytes on to a file descriptor
+void writeChunkToFile(void *context, const unsigned char *bytes, size_t length){
+    int *fd = (int *)context;
+    if (*fd >= 0 && writeAllBytes(*fd, bytes, length) != 0){
+        close(*fd);
+        *fd = -1;
+    }
+}
+
+// Function to write a stored note out to a plain file for editing; returns 0, or -1 if the file could not be written
+int checkOutStoredNote(struct NoteStore *store, const char *name){
+    int fd = open(name, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0){
+        return -1;
+    }
+    readStoredNote(store, name, writeChunkToFile, &fd);
+    if (fd < 0){
+        unlink(name);
+        return -1;
+    }
+    close(fd);
+    return 0;
+}
+
+// Function to read a plain note file into a new buffer; returns NULL if it does not exist
+unsigned char *readWholeFile(const char *path, size_t *length){
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0){
+        return NULL;
+    }
+    size_t capacity = 65536;
+    size_t used = 0;
+    unsigned char *data = (unsigned char *)malloc(capacity);
+    while (data != NULL){
+        if (used == capacity){
+            capacity *= 2;
+            unsigned char *newData = (unsigned char *)realloc(data, capacity);
+            if (newData == NULL){
+                free(data);
+                data = NULL;
+                break;
+            }
+            data = newData;
+        }
+        ssize_t got = read(fd, data + used, capacity - used);
+        if (got < 0 && errno == EINTR){
+            continue;
+        }
+        if (got <= 0){
+            break;
+        }
+        used += (size_t)got;
+    }
+    close(fd);
+    if (data == NULL){
+        fprintf(stderr, "Memory allocation failed.\n");
+        exit(1);
+    }
+    *length = used;
+    return data;
+}
+
+// Function to move a plain note file into the store and delete it; returns 0, or -1 if there is no such file
+int checkInNoteFile(struct NoteStore *store, const char *name, int sync){
+    struct stat info;
+    size_t length;
+    if (stat(name, &info) != 0){
+        return -1;
+    }
+    unsigned char *data = readWholeFile(name, &length);
+    if (data == NULL){
+        return -1;
+    }
+    storeNoteContent(store, name, data, length, (int64_t)info.st_mtime, sync);
+    free(data);
+    if (sync){
+        unlink(name); // Only once the catalog record is durable
+    }
+    return 0;
+}
+
+// Function to make everything written to the store so far durable: the pack first, so that no durable catalog record
+// can name content that a crash loses
+void syncNoteStore(struct NoteStore *store){
+    pthread_mutex_lock(&store->lock);
+    if (store->active){
+        fdatasync(store->packFd);
+        fdatasync(store->catalogFd);
+    }
+    pthread_mutex_unlock(&store->lock);
+}
+
+// Function to release the store's tables and close its files
+void closeNoteStore(struct NoteStore *store){
+    pthread_mutex_lock(&store->lock);
+    if (store->packFd >= 0){
+        close(store->packFd);
+    }
+    if (store->catalogFd >= 0){
+        close(store->catalogFd);
+    }
+    for (int i = 0; i < STORE_CACHE_CHUNKS; i++){
+        free(store->cache[i].data);
+    }
+    free(store->objects);
+    free(store->objectSlots);
+    free(store->notes);
+    memset(store->cache, 0, sizeof(store->cache));
+    store->objects = NULL;
+    store->objectSlots = NULL;
+    store->notes = NULL;
+    store->objectCount = store->objectCapacity = store->slotCapacity = 0;
+    store->noteSlots = store->noteCount = store->liveNotes = store->catalogRecords = 0;
+    store->liveBytes = store->packSize = store->catalogSize = 0;
+    store->packFd = store->catalogFd = -1;
+    store->active = 0;
+    pthread_mutex_unlock(&store->lock);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/*BACKGROUND FILE I/O*/
+// Note files are created and unlinked by a small pool of worker threads, so the tree updates at once
+// and a folder of 50k notes does not stall the menu. A note's requests always go to the same worker
+// (chosen by its name hash), so a create followed by a delete of the same name cannot be reordered.
+#define FILE_IO_THREADS 4        // Default worker count (NOTEMAKER_IO_THREADS)
+#define FILE_IO_MAX_THREADS 64
+#define FILE_IO_BATCH 256        // Requests a worker takes per lock
+
+// Kinds of file requests
+enum FileIoOperation{
+    FILE_IO_CREATE,
+    FILE_IO_UNLINK
+};
+
+// Structure to represent one queued file request; interned names stay valid until exit, so only the handle is kept
+struct FileIoRequest{
+    enum FileIoOperation operation;
+    struct NameRef name;
+};
+
+// Structure to represent a failed request waiting to be reported by the main thread
+struct FileIoFailure{
+    enum FileIoOperation operation;
+    struct NameRef name;
+    int error;
+};
+
+// Structure to represent one worker and its FIFO of requests
+struct FileIoWorker{
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t hasWork;
+    pthread_cond_t idle;
+    struct FileIoRequest *requests;
+    size_t head;     // First request not yet taken
+    size_t count;    // Requests queued after head
+    size_t capacity;
+    int busy;        // Set while the worker runs a batch outside the lock
+    int stopping;
+};
+
+// Structure to represent the worker pool and its completion queue
+struct FileIo{
+    struct FileIoWorker workers[FILE_IO_MAX_THREADS];
+    size_t workerCount; // 0 until the first request starts the pool, and again once it is stopped
+    pthread_once_t started;
+    pthread_mutex_t failureLock;
+    struct FileIoFailure *failures;
+    size_t failureCount;
+    size_t failureCapacity;
+};
+
+struct FileIo fileIo = {.failureLock = PTHREAD_MUTEX_INITIALIZER, .started = PTHREAD_ONCE_INIT};
+
+// Function to queue a failed request for reportFileIoFailures
+void recordFileIoFailure(enum FileIoOperation operation, struct NameRef name, int error){
+    pthread_mutex_lock(&fileIo.failureLock);
+    if (fileIo.failureCount == fileIo.failureCapacity){
+        size_t newCapacity = fileIo.failureCapacity == 0 ? 16 : fileIo.failureCapacity * 2;
+        struct FileIoFailure *newFailures = (struct FileIoFailure *)realloc(fileIo.failures, sizeof(struct FileIoFailure) * newCapacity);
+        if (newFailures == NULL){
+            pthread_mutex_unlock(&fileIo.failureLock);
+            return; // Losing an error message is better than stopping the worker
+        }
+        fileIo.failures = newFailures;
+        fileIo.failureCapacity = newCapacity;
+    }
+    struct FileIoFailure failure = {operation, name, error};
+    fileIo.failures[fileIo.failureCount++] = failure;
+    pthread_mutex_unlock(&fileIo.failureLock);
+}
+
+// Function to carry out one request on the calling worker
+void performFileIo(const struct FileIoRequest *request){
+    uint64_t started = metricsNow();
+    const char *path = nameText(request->name);
+    if (request->operation == FILE_IO_CREATE){
+        if (noteStoreActive()){
+            recordMetric(METRIC_FILE_CREATE, started);
+            return; // A stored note has no file until it is opened; until then it reads as empty
+        }
+        int fd = open(path, O_WRONLY | O_CREAT, 0644); // An existing note keeps its content
+        if (fd < 0){
+            recordFileIoFailure(request->operation, request->name, errno);
+        }
+        else{
+            close(fd);
+        }
+    }
+    else{
+        removeStoredNote(&noteStore, path);
+        if (unlink(path) != 0 && errno != ENOENT){
+            recordFileIoFailure(request->operation, request->name, errno); // Notes that were never written have no file
+        }
+    }
+    recordMetric(request->operation == FILE_IO_CREATE ? METRIC_FILE_CREATE : METRIC_FILE_UNLINK, started);
+}
+
+void *runFileIoWorker(void *argument){
+    struct FileIoWorker *worker = (struct FileIoWorker *)argument;
+    struct FileIoRequest batch[FILE_IO_BATCH];
+    pthread_mutex_lock(&worker->lock);
+    while (1){
+        while (worker->count == 0 && !worker->stopping){
+            pthread_cond_wait(&worker->hasWork, &worker->lock);
+        }
+        if (worker->count == 0){
+            break;
+        }
+        size_t taken = worker->count < FILE_IO_BATCH ? worker->count : FILE_IO_BATCH;
+        memcpy(batch, worker->requests + worker->head, sizeof(struct FileIoRequest) * taken);
+        worker->head += taken;
+        worker->count -= taken;
+        worker->busy = 1;
+        pthread_mutex_unlock(&worker->lock);
+
+        for (size_t i = 0; i < taken; i++){
+            performFileIo(&batch[i]);
+        }
+
+        pthread_mutex_lock(&worker->lock);
+        worker->busy = 0;
+        if (worker->count == 0){
+            pthread_cond_broadcast(&worker->idle);
+        }
+    }
+    pthread_mutex_unlock(&worker->lock);
+    return NULL;
+}
+
+// Function to start the workers; without threads the requests are carried out inline
+void startFileIo(void){
+    const char *setting = getenv("NOTEMAKER_IO_THREADS");
+    long threads = setting != NULL && atol(setting) > 0 ? atol(setting) : FILE_IO_THREADS;
+    if (threads > FILE_IO_MAX_THREADS){
+        threads = FILE_IO_MAX_THREADS;
+    }
+    for (long i = 0; i < threads; i++){
+        struct FileIoWorker *worker = &fileIo.workers[fileIo.workerCount];
+        memset(worker, 0, sizeof(*worker));
+        pthread_mutex_init(&worker->lock, NULL);
+        pthread_cond_init(&worker->hasWork, NULL);
+        pthread_cond_init(&worker->idle, NULL);
+        if (pthread_create(&worker->thread, NULL, runFileIoWorker, worker) != 0){
+            pthread_mutex_destroy(&worker->lock);
+            pthread_cond_destroy(&worker->hasWork);
+            pthread_cond_destroy(&worker->idle);
+            break;
+        }
+        fileIo.workerCount++;
+    }
+}
+
+// Function to queue the creation or removal of a note's file
+void submitFileIo(enum FileIoOperation operation, struct NameRef name){
+    struct FileIoRequest request = {operation, name};
+    pthread_once(&fileIo.started, startFileIo);
+    if (fileIo.workerCount == 0){
+        performFileIo(&request);
+        return;
+    }
+    struct FileIoWorker *worker = &fileIo.workers[name.hash % fileIo.workerCount];
+    pthread_mutex_lock(&worker->lock);
+    if (worker->head + worker->count == worker->capacity){
+        if (worker->head != 0){
+            // Reuse the space of requests already taken before growing
+            memmove(worker->requests, worker->requests + worker->head, sizeof(struct FileIoRequest) * worker->count);
+            worker->head = 0;
+        }
+        if (worker->count == worker->capacity){
+            size_t newCapacity = worker->capacity == 0 ? 1024 : worker->capacity * 2;
+            struct FileIoRequest *newRequests = (struct FileIoRequest *)realloc(worker->requests, sizeof(struct FileIoRequest) * newCapacity);
+            if (newRequests == NULL){
+                fprintf(stderr, "Memory allocation failed.\n");
+                exit(1);
+            }
+            worker->requests = newRequests;
+            worker->capacity = newCapacity;
+        }
+    }
+    worker->requests[worker->head + worker->count++] = request;
+    pthread_cond_signal(&worker->hasWork);
+    pthread_mutex_unlock(&worker->lock);
+}
+
+// Function to print the requests that failed since the last call
+void reportFileIoFailures(void){
+    pthread_mutex_lock(&fileIo.failureLock);
+    for (size_t i = 0; i < fileIo.failureCount; i++){
+        struct FileIoFailure *failure = &fileIo.failures[i];
+        printf(" Could not %s note %s: %s\n", failure->operation == FILE_IO_CREATE ? "create" : "delete",
+               nameText(failure->name), strerror(failure->error));
+    }
+    fileIo.failureCount = 0;
+    pthread_mutex_unlock(&fileIo.failureLock);
+}
+
+// Function to block until every queued request has been carried out
+void waitForFileIo(void){
+    for (size_t i = 0; i < fileIo.workerCount; i++){
+        struct FileIoWorker *worker = &fileIo.workers[i];
+        pthread_mutex_lock(&worker->lock);
+        while (worker->count != 0 || worker->busy){
+            pthread_cond_wait(&worker->idle, &worker->lock);
+        }
+        pthread_mutex_unlock(&worker->lock);
+    }
+}
+
+// Function to finish the queued requests, report their failures and stop the workers
+void stopFileIo(void){
+    for (size_t i = 0; i < fileIo.workerCount; i++){
+        struct FileIoWorker *worker = &fileIo.workers[i];
+        pthread_mutex_lock(&worker->lock);
+        worker->stopping = 1;
+        pthread_cond_signal(&worker->hasWork);
+        pthread_mutex_unlock(&worker->lock);
+    }
+    for (size_t i = 0; i < fileIo.workerCount; i++){
+        struct FileIoWorker *worker = &fileIo.workers[i];
+        pthread_join(worker->thread, NULL); // A stopping worker drains its queue first
+        pthread_mutex_destroy(&worker->lock);
+        pthread_cond_destroy(&worker->hasWork);
+        pthread_cond_destroy(&worker->idle);
+        free(worker->requests);
+    }
+    fileIo.workerCount = 0;
+    reportFileIoFailures();
+    free(fileIo.failures);
+    fileIo.failures = NULL;
+    fileIo.failureCapacity = 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/*FOLDER TREE LINKS*/
+// Function to link a folder as the last child of its parent and register it in the parent's child index
+void linkChildFolder(struct FolderNode *parentFolder, struct FolderNode *newNode){
+    if (parentFolder->lastChild == NULL){
+        parentFolder->firstChild = newNode;
+    }
+    else{
+        parentFolder->lastChild->nextFolder = newNode;
+        newNode->prevFolder = parentFolder->lastChild;
+    }
+    parentFolder->lastChild = newNode;
+    addToNameIndex(&parentFolder->childIndex, newNode->foldername, newNode);
+}
+
+// Function to unlink a folder from its parent's child chain and child index
+void detachFolderFromParent(struct FolderNode *folder){
+    struct FolderNode *parentFolder = folder->parentFolder;
+    if (folder->prevFolder != NULL){
+        folder->prevFolder->nextFolder = folder->nextFolder;
+    }
+    else{
+        parentFolder->firstChild = folder->nextFolder;
+    }
+
+    if (folder->nextFolder != NULL){
+        folder->nextFolder->prevFolder = folder->prevFolder;
+    }
+    else{
+        parentFolder->lastChild = folder->prevFolder;
+    }
+    removeFromNameIndex(&parentFolder->childIndex, folder, folder->foldername);
+    folder->nextFolder = NULL;
+    folder->prevFolder = NULL;
+}
+
+// Function to check whether a folder is an ancestor folder itself or lies somewhere below it
+int folderIsWithin(struct FolderNode *folder, struct FolderNode *ancestor){
+    for (; folder != NULL; folder = folder->parentFolder){
+        if (folder == ancestor){
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Function to build the full path of a folder, such as /projects/q3 ("/" for the root); the caller frees it
+char *buildFolderPath(struct FolderNode *folder){
+    size_t length = 0;
+    for (struct FolderNode *current = folder; current->parentFolder != NULL; current = current->parentFolder){
+        length += current->foldername.length + 1;
+    }
+    char *path = (char *)malloc(length + 2);
+    if (path == NULL){
+        fprintf(stderr, "Memory allocation failed.\n");
+        exit(1);
+    }
+    path[0] = '/';
+    path[length == 0 ? 1 : length] = '\0';
+    // Fill from the end, one component per ancestor
+    size_t end = length;
+    for (struct FolderNode *current = folder; current->parentFolder != NULL; current = current->parentFolder){
+        end -= current->foldername.length;
+        memcpy(path + end, nameText(current->foldername), current->foldername.length);
+        path[--end] = '/';
+    }
+    return path;
+}
+
+// Function to build the full path of a note, such as /projects/q3/notes1; the caller frees it
+char *buildNotePath(struct FileNode *note){
+    char *folderPath = buildFolderPath(note->folder);
+    size_t folderLength = strlen(folderPath);
+    char *path = (char *)malloc(folderLength + note->filename.length + 2);
+    if (path == NULL){
+        fprintf(stderr, "Memory allocation failed.\n");
+        exit(1);
+    }
+    memcpy(path, folderPath, folderLength);
+    if (folderLength > 1){
+        path[folderLength++] = '/';
+    }
+    memcpy(path + folderLength, nameText(note->filename), note->filename.length + 1);
+    free(folderPath);
+    return path;
+}
+
+// Function to hand out folder ids again in preorder, dropping the ids of deleted folders
+void renumberFolderSubtree(struct FolderNode *folder){
+    folder->folderId = folderRegistry.count;
+    folderRegistry.byId[folderRegistry.count++] = folder;
+    for (struct FolderNode *child = folder->firstChild; child != NULL; child = child->nextFolder){
+        renumberFolderSubtree(child);
+    }
+}
+
+// Function to renumber every folder of the workspace in preorder, matching the snapshot's folder table
+void renumberFolders(struct FolderNode *root){
+    folderRegistry.count = 0;
+    renumberFolderSubtree(root);
+}
+
+// Bumped whenever a folder is freed; resolved paths cached under an older value may point at freed folders
+atomic_ullong folderTreeGeneration = 0;
+
+// Function to keep a detached folder and its subtree in the trash: nothing is freed and no file is touched, so putting
+// it back is a relink. Cached paths into it are dropped.
+void trashFolder(struct FolderNode *folder){
+    folder->inTrash = 1;
+    atomic_fetch_add(&folderTreeGeneration, 1);
+}
+
+// Function to check whether a folder is in the trash or lies below a folder that is
+int folderInTrash(struct FolderNode *folder){
+    for (; folder != NULL; folder = folder->parentFolder){
+        if (folder->inTrash){
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Function to free a folder and everything below it, each node visited exactly once
+void destroyFolderSubtree(struct FolderNode *folder, int removeFiles){
+    atomic_fetch_add(&folderTreeGeneration, 1);
+    struct FolderNode *child = folder->firstChild;
+    while (child != NULL){
+        struct FolderNode *nextChild = child->nextFolder;
+        destroyFolderSubtree(child, removeFiles);
+        child = nextChild;
+    }
+
+    struct FileNode *fileList = folder->fileList.head;
+    while (fileList != NULL){
+        struct FileNode *tempFile = fileList;
+        fileList = fileList->next;
+        struct NameRef name = tempFile->filename;
+        if (releaseFileNode(tempFile) && removeFiles){
+            submitFileIo(FILE_IO_UNLINK, name); // Delete the file from the file system in the background
+        }
+    }
+    freeNameIndex(&folder->fileList.index);
+    freePositionArray(&folder->fileList);
+    freeNameIndex(&folder->childIndex);
+    pthread_rwlock_destroy(&folder->lock);
+    if (folder->folderId < folderRegistry.count && folderRegistry.byId[folder->folderId] == folder){
+        folderRegistry.byId[folder->folderId] = NULL; // A folder kept in the trash across a snapshot lost its id
+    }
+    releaseToPool(&workspaceArena.folderPool, folder);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/*PATH RESOLUTION CACHE*/
+// Paths such as /projects/q3/design name a folder from the root; paths without a leading / start at the current
+// folder, and . and .. work as usual. Resolved absolute paths (and each of their prefixes) are kept in an LRU table,
+// so a repeated deep access is one hash lookup. Freeing any folder bumps folderTreeGeneration, which empties the table.
+#define PATH_CACHE_ENTRIES 4096
+#define PATH_CACHE_BUCKETS (2 * PATH_CACHE_ENTRIES) // Power of two
+
+// Structure to represent one resolved path
+struct PathCacheEntry{
+    char *path;                        // Owned copy of the path text (not '\0' terminated)
+    size_t length;
+    size_t capacity;
+    uint32_t hash;
+    struct FolderNode *folder;
+    struct PathCacheEntry *chainNext;  // Next entry in the same bucket
+    struct PathCacheEntry *lruPrev;    // Towards the most recently used entry
+    struct PathCacheEntry *lruNext;    // Towards the least recently used entry
+};
+
+// Structure to represent the path cache
+struct PathCache{
+    struct PathCacheEntry *entries;    // PATH_CACHE_ENTRIES entries, allocated on first use
+    struct PathCacheEntry **buckets;
+    size_t used;
+    struct PathCacheEntry *mostRecent;
+    struct PathCacheEntry *leastRecent;
+    unsigned long long generation;     // folderTreeGeneration the entries were resolved under
+    size_t hits;
+    size_t misses;
+    size_t textBytes;                  // Capacity of every entry's path buffer, kept for the metrics report
+    pthread_mutex_t lock;              // Server clients resolve paths concurrently
+};
+
+struct PathCache pathCache = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+// Function to unlink an entry from the LRU list
+void unlinkPathCacheEntry(struct PathCache *cache, struct PathCacheEntry *entry){
+    if (entry->lruPrev != NULL){
+        entry->lruPrev->lruNext = entry->lruNext;
+    }
+    else{
+        cache->mostRecent = entry->lruNext;
+    }
+    if (entry->lruNext != NULL){
+        entry->lruNext->lruPrev = entry->lruPrev;
+    }
+    else{
+        cache->leastRecent = entry->lruPrev;
+    }
+}
+
+// Function to put an entry at the most recently used end of the LRU list
+void pushPathCacheEntry(struct PathCache *cache, struct PathCacheEntry *entry){
+    entry->lruPrev = NULL;
+    entry->lruNext = cache->mostRecent;
+    if (cache->mostRecent != NULL){
+        cache->mostRecent->lruPrev = entry;
+    }
+    else{
+        cache->leastRecent = entry;
+    }
+    cache->mostRecent = entry;
+}
+
+// Function to get the cache ready for use under its lock, dropping every entry if a folder was freed since they were resolved
+void preparePathCache(struct PathCache *cache){
+    if (cache->entries == NULL){
+        cache->entries = (struct PathCacheEntry *)calloc(PATH_CACHE_ENTRIES, sizeof(struct PathCacheEntry));
+        cache->buckets = (struct PathCacheEntry **)calloc(PATH_CACHE_BUCKETS, sizeof(struct PathCacheEntry *));
+        if (cache->entries == NULL || cache->buckets == NULL){
+            fprintf(stderr, "Memory allocation failed.\n");
+            exit(1);
+        }
+        cache->generation = atomic_load(&folderTreeGeneration);
+    }
+    unsigned long long generation = atomic_load(&folderTreeGeneration);
+    if (generation != cache->generation){
+        memset(cache->buckets, 0, PATH_CACHE_BUCKETS * sizeof(struct PathCacheEntry *));
+        cache->used = 0;
+        cache->mostRecent = cache->leastRecent = NULL;
+        cache->generation = generation;
+    }
+}
+
+// Function to look up a resolved path, or NULL; the caller holds the lock
+struct FolderNode *findCachedPath(struct PathCache *cache, const char *path, size_t length, uint32_t hash){
+    for (struct PathCacheEntry *entry = cache->buckets[hash & (PATH_CACHE_BUCKETS - 1)]; entry != NULL; entry = entry->chainNext){
+        if (entry->hash == hash && entry->length == length && memcmp(entry->path, path, length) == 0){
+            unlinkPathCacheEntry(cache, entry);
+            pushPathCacheEntry(cache, entry);
+            return entry->folder;
+        }
+    }
+    return NULL;
+}
+
+// Function to remember a resolved path, evicting the least recently used one when the cache is full; the caller holds the lock
+void addCachedPath(struct PathCache *cache, const char *path, size_t length, uint32_t hash, struct FolderNode *folder){
+    struct PathCacheEntry *entry;
+    if (cache->used < PATH_CACHE_ENTRIES){
+        entry = &cache->entries[cache->used++];
+    }
+    else{
+        entry = cache->leastRecent;
+        unlinkPathCacheEntry(cache, entry);
+        struct PathCacheEntry **link = &cache->buckets[entry->hash & (PATH_CACHE_BUCKETS - 1)];
+        while (*link != entry){
+            link = &(*link)->chainNext;
+        }
+        *link = entry->chainNext;
+    }
+    if (entry->capacity < length){
+        char *newPath = (char *)realloc(entry->path, length);
+        if (newPath == NULL){
+            fprintf(stderr, "Memory allocation failed.\n");
+            exit(1);
+        }
+        entry->path = newPath;
+        cache->textBytes += length - entry->capacity;
+        entry->capacity = length;
+    }
+    memcpy(entry->path, path, length);
+    entry->length = length;
+    entry->hash = hash;
+    entry->folder = folder;
+    struct PathCacheEntry **bucket = &cache->buckets[hash & (PATH_CACHE_BUCKETS - 1)];
+    entry->chainNext = *bucket;
+    *bucket = entry;
+    pushPathCacheEntry(cache, entry);
+}
+
+// Function to take one step of a path from a folder: a child by name, . or ..; NULL if there is no such child
+struct FolderNode *stepAlongPath(struct FolderNode *folder, const char *component, size_t length){
+    if (length == 1 && component[0] == '.'){
+        return folder;
+    }
+    if (length == 2 && component[0] == '.' && component[1] == '.'){
+        return folder->parentFolder != NULL ? folder->parentFolder : folder; // .. of the root is the root
+    }
+    pthread_rwlock_rdlock(&folder->lock); // A server client may be adding a child here
+    struct FolderNode *child = (struct FolderNode *)findInNameIndexBytes(&folder->childIndex, component, length);
+    pthread_rwlock_unlock(&folder->lock);
+    return child;
+}
+
+// Function to walk the components of path[start, end) from a folder; NULL as soon as one is missing.
+// With cacheKey set, every prefix of an absolute path resolved on the way is added to the cache.
+struct FolderNode *walkPath(struct FolderNode *folder, const char *path, size_t start, size_t end, int cacheKey){
+    size_t position = start;
+    while (position < end && folder != NULL){
+        while (position < end && path[position] == '/'){
+            position++;
+        }
+        size_t componentEnd = position;
+        while (componentEnd < end && path[componentEnd] != '/'){
+            componentEnd++;
+        }
+        if (componentEnd == position){
+            break;
+        }
+        folder = stepAlongPath(folder, path + position, componentEnd - position);
+        if (folder != NULL && cacheKey){
+            uint32_t hash = hashName(path, componentEnd);
+            pthread_mutex_lock(&pathCache.lock);
+            preparePathCache(&pathCache);
+            if (findCachedPath(&pathCache, path, componentEnd, hash) == NULL){
+                addCachedPath(&pathCache, path, componentEnd, hash, folder);
+            }
+            pthread_mutex_unlock(&pathCache.lock);
+        }
+        position = componentEnd;
+    }
+    return folder;
+}
+
+// Function to find the folder the first length bytes of a path name, through the cache where possible
+struct FolderNode *lookupFolderPathBytes(struct FolderNode *currentFolder, const char *path, size_t length){
+    while (length > 1 && path[length - 1] == '/'){
+        length--;
+    }
+    if (length == 0 || path[0] != '/'){
+        return walkPath(currentFolder, path, 0, length, 0);
+    }
+    struct FolderNode *root = currentFolder;
+    if (length == 1){
+        while (root->parentFolder != NULL){
+            root = root->parentFolder;
+        }
+        return root;
+    }
+
+    // Longest cached prefix first: the whole path, then each shorter one ending before a /
+    struct FolderNode *folder = NULL;
+    size_t resolved = length;
+    pthread_mutex_lock(&pathCache.lock);
+    preparePathCache(&pathCache);
+    while (resolved > 0){
+        folder = findCachedPath(&pathCache, path, resolved, hashName(path, resolved));
+        if (folder != NULL){
+            break;
+        }
+        do{
+            resolved--;
+        } while (resolved > 0 && path[resolved] != '/');
+    }
+    if (resolved == length){
+        pathCache.hits++;
+        pthread_mutex_unlock(&pathCache.lock);
+        return folder;
+    }
+    pathCache.misses++;
+    pthread_mutex_unlock(&pathCache.lock);
+    if (folder == NULL){
+        while (root->parentFolder != NULL){
+            root = root->parentFolder;
+        }
+        folder = root;
+    }
+    return walkPath(folder, path, resolved, length, 1);
+}
+
+// Function to resolve the first length bytes of a folder path from a folder; NULL if some component does not exist
+struct FolderNode *resolveFolderPathBytes(struct FolderNode *currentFolder, const char *path, size_t length){
+    uint64_t started = metricsNow();
+    struct FolderNode *folder = lookupFolderPathBytes(currentFolder, path, length);
+    recordMetric(METRIC_RESOLVE_PATH, started);
+    return folder;
+}
+
+// Function to check that a name can be given to a new note or folder: not empty, and not . or .. which paths reserve
+int isValidName(const char *name){
+    return name[0] != '\0' && strcmp(name, ".") != 0 && strcmp(name, "..") != 0;
+}
+
+// Function to resolve a folder path from a folder; NULL if some component does not exist
+struct FolderNode *resolveFolderPath(struct FolderNode *currentFolder, const char *path){
+    return resolveFolderPathBytes(currentFolder, path, strlen(path));
+}
+
+// Function to split a note or folder path into the folder that holds it and its last component (leaf). A plain name
+// resolves to the current folder. Returns NULL if the folder does not exist or the path ends without a name.
+struct FolderNode *resolveParentPath(struct FolderNode *currentFolder, const char *path, const char **leaf){
+    const char *slash = strrchr(path, '/');
+    if (slash == NULL){
+        *leaf = path;
+        return currentFolder;
+    }
+    *leaf = slash + 1;
+    if (slash[1] == '\0'){
+        return NULL;
+    }
+    return resolveFolderPathBytes(currentFolder, path, slash == path ? 1 : (size_t)(slash - path));
+}
+
+// Function to release the path cache
+void freePathCache(void){
+    pthread_mutex_lock(&pathCache.lock);
+    for (size_t i = 0; pathCache.entries != NULL && i < PATH_CACHE_ENTRIES; i++){
+        free(pathCache.entries[i].path); // Entries dropped by a flush keep their buffers for reuse
+    }
+    free(pathCache.entries);
+    free(pathCache.buckets);
+    pathCache.entries = NULL;
+    pathCache.buckets = NULL;
+    pathCache.used = 0;
+    pathCache.textBytes = 0;
+    pathCache.mostRecent = pathCache.leastRecent = NULL;
+    pthread_mutex_unlock(&pathCache.lock);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/*TASK QUEUE HEAP AND TASK INDEX*/
+// Tasks come out earliest due time first, then smallest priority, then in insertion order
+// Function to hash a task's sequence number into the task index (Fibonacci hashing)
+size_t hashTaskSeq(uint64_t seq, size_t indexCapacity){
+    return (size_t)((seq * 11400714819323198485ull) >> 32) & (indexCapacity - 1);
+}
+
+// Function to find a task by its sequence number, or NULL
+struct TaskNode *findTaskBySeq(struct TaskQueue *queue, uint64_t seq){
+    if (queue->indexCapacity == 0){
+        return NULL;
+    }
+    size_t slot = hashTaskSeq(seq, queue->indexCapacity);
+    while (queue->seqIndex[slot] != NULL){
+        if (queue->seqIndex[slot]->seq == seq){
+            return queue->seqIndex[slot];
+        }
+        slot = (slot + 1) & (queue->indexCapacity - 1);
+    }
+    return NULL;
+}
+
+// Function to place a task into the task index without growing it
+void placeTaskInIndex(struct TaskNode **index, size_t indexCapacity, struct TaskNode *task){
+    size_t slot = hashTaskSeq(task->seq, indexCapacity);
+    while (index[slot] != NULL){
+        slot = (slot + 1) & (indexCapacity - 1);
+    }
+    index[slot] = task;
+}
+
+// Function to add a task to the task index, doubling the table to keep the load factor under one half
+void addTaskToIndex(struct TaskQueue *queue, struct TaskNode *task){
+    if ((queue->count + 1) * 2 > queue->indexCapacity){
+        size_t newCapacity = queue->indexCapacity == 0 ? 16 : queue->indexCapacity * 2;
+        struct TaskNode **newIndex = (struct TaskNode **)calloc(newCapacity, sizeof(struct TaskNode *));
+        if (newIndex == NULL){
+            fprintf(stderr, "Memory allocation failed.\n");
+            exit(1);
+        }
+        for (size_t i = 0; i < queue->indexCapacity; i++){
+            if (queue->seqIndex[i] != NULL){
+                placeTaskInIndex(newIndex, newCapacity, queue->seqIndex[i]);
+            }
+        }
+        free(queue->seqIndex);
+        queue->seqIndex = newIndex;
+        queue->indexCapacity = newCapacity;
+    }
+    placeTaskInIndex(queue->seqIndex, queue->indexCapacity, task);
+}
+
+// Function to remove a task from the task index, shifting later entries back so no tombstones are needed
+void removeTaskFromIndex(struct TaskQueue *queue, struct TaskNode *task){
+    size_t mask = queue->indexCapacity - 1;
+    size_t slot = hashTaskSeq(task->seq, queue->indexCapacity);
+    while (queue->seqIndex[slot] != task){
+        slot = (slot + 1) & mask;
+    }
+    size_t hole = slot;
+    slot = (slot + 1) & mask;
+    while (queue->seqIndex[slot] != NULL){
+        size_t home = hashTaskSeq(queue->seqIndex[slot]->seq, queue->indexCapacity);
+        // Move the entry into the hole unless its home lies cyclically in (hole, slot]
+        if (((slot - home) & mask) >= ((slot - hole) & mask)){
+            queue->seqIndex[hole] = queue->seqIndex[slot];
+            hole = slot;
+        }
+        slot = (slot + 1) & mask;
+    }
+    queue->seqIndex[hole] = NULL;
+}
+
+// Function to check whether task a comes out of the queue before task b
+int taskComesFirst(const struct TaskNode *a, const struct TaskNode *b){
+    if (a->dueTime != b->dueTime){
+        return a->dueTime < b->dueTime;
+    }
+    if (a->priority != b->priority){
+        return a->priority < b->priority;
+    }
+    return a->seq < b->seq;
+}
+
+// Function to swap two heap entries and keep their stored positions in sync
+void swapHeapTasks(struct TaskQueue *queue, size_t a, size_t b){
+    struct TaskNode *temp = queue->heap[a];
+    queue->heap[a] = queue->heap[b];
+    queue->heap[b] = temp;
+    queue->heap[a]->heapIndex = a;
+    queue->heap[b]->heapIndex = b;
+}
+
+// Function to move a task up the heap until its parent comes before it
+void siftTaskUp(struct TaskQueue *queue, size_t position){
+    while (position > 0){
+        size_t parent = (position - 1) / 2;
+        if (!taskComesFirst(queue->heap[position], queue->heap[parent])){
+            break;
+        }
+        swapHeapTasks(queue, parent, position);
+        position = parent;
+    }
+}
+
+// Function to move a task down the heap until it comes before both children
+void siftTaskDown(struct TaskQueue *queue, size_t position){
+    while (1){
+        size_t smallest = position;
+        size_t left = 2 * position + 1;
+        size_t right = left + 1;
+        if (left < queue->count && taskComesFirst(queue->heap[left], queue->heap[smallest])){
+            smallest = left;
+        }
+        if (right < queue->count && taskComesFirst(queue->heap[right], queue->heap[smallest])){
+            smallest = right;
+        }
+        if (smallest == position){
+            break;
+        }
+        swapHeapTasks(queue, smallest, position);
+        position = smallest;
+    }
+}
+
+// Function to detach the task at a heap position from both the heap and the task index
+struct TaskNode *removeTaskAt(struct TaskQueue *queue, size_t position){
+    struct TaskNode *task = queue->heap[position];
+    removeTaskFromIndex(queue, task);
+    queue->count--;
+    if (position != queue->count){
+        queue->heap[position] = queue->heap[queue->count];
+        queue->heap[position]->heapIndex = position;
+        siftTaskDown(queue, position);
+        siftTaskUp(queue, position);
+    }
+    return task;
+}
+
+// Function to insert a task node into the heap and the task index
+void pushTaskNode(struct TaskQueue *queue, struct TaskNode *newNode){
+    if (queue->count == queue->capacity){
+        size_t newCapacity = queue->capacity == 0 ? 16 : queue->capacity * 2;
+        struct TaskNode **newHeap = (struct TaskNode **)realloc(queue->heap, newCapacity * sizeof(struct TaskNode *));
+        if (newHeap == NULL){
+            fprintf(stderr, "Memory allocation failed.\n");
+            exit(1);
+        }
+        queue->heap = newHeap;
+        queue->capacity = newCapacity;
+    }
+    addTaskToIndex(queue, newNode);
+    newNode->heapIndex = queue->count;
+    queue->heap[queue->count++] = newNode;
+    siftTaskUp(queue, newNode->heapIndex);
+}
+
+// Function to compare two tasks in queue order for the ordered view
+int compareTasksInQueueOrder(const void *a, const void *b){
+    const struct TaskNode *taskA = *(struct TaskNode *const *)a;
+    const struct TaskNode *taskB = *(struct TaskNode *const *)b;
+    return taskComesFirst(taskA, taskB) ? -1 : taskComesFirst(taskB, taskA);
+}
+
+#define NEXT_DUE_MAX_COUNT 1000 // Most tasks one next-due listing shows
+
+// Function to build a copy of the queue sorted in queue order (caller frees the array)
+struct TaskNode **createOrderedTaskView(struct TaskQueue *queue){
+    struct TaskNode **view = (struct TaskNode **)malloc((queue->count + 1) * sizeof(struct TaskNode *));
+    if (view == NULL){
+        fprintf(stderr, "Memory allocation failed.\n");
+        exit(1);
+    }
+    if (queue->count != 0){
+        memcpy(view, queue->heap, queue->count * sizeof(struct TaskNode *));
+        qsort(view, queue->count, sizeof(struct TaskNode *), compareTasksInQueueOrder);
+    }
+    return view;
+}
+
+// Structure to represent a heap entry that may be the next task due, and the queue it is in
+struct NextDueCandidate{
+    struct TaskNode *task;
+    int queue;
+};
+
+// Function to restore the candidate heap after the entry at a position got later (or was replaced)
+void siftNextDueCandidateDown(struct NextDueCandidate *candidates, size_t count, size_t position){
+    while (1){
+        size_t left = 2 * position + 1;
+        size_t right = left + 1;
+        size_t first = position;
+        if (left < count && taskComesFirst(candidates[left].task, candidates[first].task)){
+            first = left;
+        }
+        if (right < count && taskComesFirst(candidates[right].task, candidates[first].task)){
+            first = right;
+        }
+        if (first == position){
+            return;
+        }
+        struct NextDueCandidate swap = candidates[first];
+        candidates[first] = candidates[position];
+        candidates[position] = swap;
+        position = first;
+    }
+}
+
+// Function to add a candidate to the candidate heap
+void pushNextDueCandidate(struct NextDueCandidate *candidates, size_t *count, struct TaskNode *task, int queue){
+    size_t position = (*count)++;
+    while (position > 0 && taskComesFirst(task, candidates[(position - 1) / 2].task)){
+        candidates[position] = candidates[(position - 1) / 2];
+        position = (position - 1) / 2;
+    }
+    candidates[position] = (struct NextDueCandidate){task, queue};
+}
+
+// Function to collect up to limit (at most NEXT_DUE_MAX_COUNT) tasks with deadlines in due order from one or more heaps
+// without a full scan: a heap entry can only come out after its parent, so only the children of taken entries are ever
+// candidates. They wait in a small heap of their own, so each task taken costs O(log limit).
+size_t collectNextDueTasks(struct TaskQueue **queues, int queueCount, struct TaskNode **out, size_t limit){
+    // Each task taken swaps one candidate for at most two, so there are never more than queueCount + limit + 1
+    struct NextDueCandidate *candidates = (struct NextDueCandidate *)malloc(((size_t)queueCount + limit + 1) * sizeof(struct NextDueCandidate));
+    if (candidates == NULL){
+        fprintf(stderr, "Memory allocation failed.\n");
+        exit(1);
+    }
+    size_t candidateCount = 0;
+    for (int q = 0; q < queueCount; q++){
+        if (queues[q]->count != 0){
+            pushNextDueCandidate(candidates, &candidateCount, queues[q]->heap[0], q);
+        }
+    }
+    size_t taken = 0;
+    while (taken < limit && candidateCount != 0){
+        struct TaskNode *task = candidates[0].task;
+        if (task->dueTime == TASK_NO_DEADLINE){
+            break; // Everything left has no deadline
+        }
+        int q = candidates[0].queue;
+        struct TaskQueue *queue = queues[q];
+        out[taken++] = task;
+        candidates[0] = candidates[--candidateCount];
+        siftNextDueCandidateDown(candidates, candidateCount, 0);
+        for (size_t child = 2 * task->heapIndex + 1; child <= 2 * task->heapIndex + 2 && child < queue->count; child++){
+            pushNextDueCandidate(candidates, &candidateCount, queue->heap[child], q);
+        }
+    }
+    free(candidates);
+    return taken;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/*TIMER WHEEL FOR DUE TASKS*/
+// Four levels of 64 one-second slots (64 s, ~68 min, ~3 days, ~194 days); later deadlines wait in an overflow list.
+// Scheduling and cancelling are O(1), and each task is cascaded at most once per level before it fires.
+#define TIMER_WHEEL_BITS 6
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_LEVELS 4
+
+// Structure to represent a task that became due, kept until it is reported
+struct DueAlert{
+    struct NameRef taskname;
+    int priority;
+};
+
+// Structure to represent the timer wheel
+struct TimerWheel{
+    struct TaskNode *slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+    struct TaskNode *overflow;
+    int64_t now;            // Last second processed; 0 until the wheel is first used
+    size_t scheduled;
+    struct DueAlert *alerts;
+    size_t alertCount;
+    size_t alertCapacity;
+    pthread_mutex_t lock;   // Tasks in different server shards share the wheel
+};
+
+struct TimerWheel timerWheel = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+// Function to record that a task became due
+void addDueAlert(struct TimerWheel *wheel, struct TaskNode *task){
+    if (wheel->alertCount == wheel->alertCapacity){
+        size_t newCapacity = wheel->alertCapacity == 0 ? 16 : wheel->alertCapacity * 2;
+        struct DueAlert *newAlerts = (struct DueAlert *)realloc(wheel->alerts, newCapacity * sizeof(struct DueAlert));
+        if (newAlerts == NULL){
+            fprintf(stderr, "Memory allocation failed.\n");
+            exit(1);
+        }
+        wheel->alerts = newAlerts;
+        wheel->alertCapacity = newCapacity;
+    }
+    struct DueAlert alert = {task->taskname, task->priority};
+    wheel->alerts[wheel->alertCount++] = alert;
+}
+
+// Function to put a task into the slot for its due time, or fire it if that time has come; the caller holds the lock
+void placeTaskTimer(struct TimerWheel *wheel, struct TaskNode *task){
+    int64_t delta = task->dueTime - wheel->now;
+    if (delta <= 0){
+        addDueAlert(wheel, task);
+        return;
+    }
+    struct TaskNode **bucket = &wheel->overflow;
+    for (int level = 0; level < TIMER_WHEEL_LEVELS; level++){
+        if (delta < (int64_t)1 << (TIMER_WHEEL_BITS * (level + 1))){
+            bucket = &wheel->slots[level][(task->dueTime >> (TIMER_WHEEL_BITS * level)) & (TIMER_WHEEL_SLOTS - 1)];
+            break;
+        }
+    }
+    task->timerBucket = bucket;
+    task->timerPrev = NULL;
+    task->timerNext = *bucket;
+    if (*bucket != NULL){
+        (*bucket)->timerPrev = task;
+    }
+    *bucket = task;
+    wheel->scheduled++;
+}
+
+// Function to take every task out of a bucket and file it again against the current time
+void refileTimerBucket(struct TimerWheel *wheel, struct TaskNode **bucket){
+    struct TaskNode *task = *bucket;
+    *bucket = NULL;
+    while (task != NULL){
+        struct TaskNode *next = task->timerNext;
+        task->timerBucket = NULL;
+        wheel->scheduled--;
+        placeTaskTimer(wheel, task);
+        task = next;
+    }
+}
+
+// Function to start tracking a task's deadline; tasks without one, or already due, are not tracked
+void scheduleTaskTimer(struct TaskNode *task){
+    if (task->dueTime == TASK_NO_DEADLINE){
+        return;
+    }
+    struct TimerWheel *wheel = &timerWheel;
+    pthread_mutex_lock(&wheel->lock);
+    if (wheel->now == 0){
+        wheel->now = (int64_t)time(NULL);
+    }
+    if (task->dueTime > wheel->now){
+        placeTaskTimer(wheel, task);
+    }
+    pthread_mutex_unlock(&wheel->lock);
+}
+
+// Function to stop tracking a task's deadline
+void cancelTaskTimer(struct TaskNode *task){
+    struct TimerWheel *wheel = &timerWheel;
+    pthread_mutex_lock(&wheel->lock);
+    if (task->timerBucket != NULL){
+        if (task->timerPrev != NULL){
+            task->timerPrev->timerNext = task->timerNext;
+        }
+        else{
+            *task->timerBucket = task->timerNext;
+        }
+        if (task->timerNext != NULL){
+            task->timerNext->timerPrev = task->timerPrev;
+        }
+        task->timerBucket = NULL;
+        wheel->scheduled--;
+    }
+    pthread_mutex_unlock(&wheel->lock);
+}
+
+// Function to move the wheel forward to a time, firing every task that falls due on the way
+void advanceTimerWheel(int64_t target){
+    struct TimerWheel *wheel = &timerWheel;
+    pthread_mutex_lock(&wheel->lock);
+    if (wheel->now == 0 || wheel->scheduled == 0){
+        wheel->now = target > wheel->now ? target : wheel->now;
+    }
+    while (wheel->now < target){
+        wheel->now++;
+        if ((wheel->now & (((int64_t)1 << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS)) - 1)) == 0){
+            refileTimerBucket(wheel, &wheel->overflow);
+        }
+        // Higher levels first, so a task cascaded into a lower slot that is also due now is handled below
+        for (int level = TIMER_WHEEL_LEVELS - 1; level >= 1; level--){
+            if ((wheel->now & (((int64_t)1 << (TIMER_WHEEL_BITS * level)) - 1)) == 0){
+                refileTimerBucket(wheel, &wheel->slots[level][(wheel->now >> (TIMER_WHEEL_BITS * level)) & (TIMER_WHEEL_SLOTS - 1)]);
+            }
+        }
+        refileTimerBucket(wheel, &wheel->slots[0][wheel->now & (TIMER_WHEEL_SLOTS - 1)]);
+        if (wheel->scheduled == 0){
+            wheel->now = target;
+        }
+    }
+    pthread_mutex_unlock(&wheel->lock);
+}
+
+// Function to print the tasks that fell due since the last report
+void reportDueTasks(FILE *output){
+    advanceTimerWheel((int64_t)time(NULL));
+    struct TimerWheel *wheel = &timerWheel;
+    pthread_mutex_lock(&wheel->lock);
+    for (size_t i = 0; i < wheel->alertCount; i++){
+        fprintf(output, " Task due now (priority %d): %s\n", wheel->alerts[i].priority, nameText(wheel->alerts[i].taskname));
+    }
+    wheel->alertCount = 0;
+    pthread_mutex_unlock(&wheel->lock);
+}
+
+// Function to drop every pending timer and alert, before the task nodes themselves go away
+void clearTimerWheel(void){
+    struct TimerWheel *wheel = &timerWheel;
+    pthread_mutex_lock(&wheel->lock);
+    memset(wheel->slots, 0, sizeof(wheel->slots));
+    wheel->overflow = NULL;
+    wheel->scheduled = 0;
+    free(wheel->alerts);
+    wheel->alerts = NULL;
+    wheel->alertCount = wheel->alertCapacity = 0;
+    pthread_mutex_unlock(&wheel->lock);
+}
+
+// Function to write a due time as local date and time, or "no deadline"
+void formatDueTime(int64_t dueTime, char *text, size_t size){
+    if (dueTime == TASK_NO_DEADLINE){
+        snprintf(text, size, "no deadline");
+        return;
+    }
+    time_t when = (time_t)dueTime;
+    struct tm local;
+    localtime_r(&when, &local);
+    strftime(text, size, "%Y-%m-%d %H:%M", &local);
+}
+
+// Function to print one task of a listing: priority, name, and its deadline and repeat interval if it has them
+void printTaskLine(FILE *output, size_t number, const struct TaskNode *task, int64_t now){
+    fprintf(output, "%zu. Priority %d: %s", number, task->priority, nameText(task->taskname));
+    if (task->dueTime != TASK_NO_DEADLINE){
+        char due[32];
+        formatDueTime(task->dueTime, due, sizeof(due));
+        fprintf(output, " (%s %s", task->dueTime <= now ? "OVERDUE since" : "due", due);
+        if (task->repeatSeconds != 0){
+            fprintf(output, ", every %u min", task->repeatSeconds / 60);
+        }
+        fprintf(output, ")");
+    }
+    fprintf(output, "\n");
+}
+
+// Function to compute the next occurrence of a recurring task: one interval on, skipping occurrences already past
+int64_t nextOccurrence(const struct TaskNode *task, int64_t now){
+    int64_t next = task->dueTime + task->repeatSeconds;
+    if (next <= now){
+        next += ((now - next) / task->repeatSeconds + 1) * task->repeatSeconds;
+    }
+    return next;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/*WRITE-AHEAD JOURNAL*/
+#define JOURNAL_PATH "notemaker.journal"
+#define JOURNAL_OLD_PATH "notemaker.journal.old" // Previous generation while it is being folded into a snapshot
+#define JOURNAL_MAGIC "NMJRNL\0"
+#define JOURNAL_VERSION 2                      // Version 1 journals (records without task deadlines) still replay
+#define JOURNAL_GROUP_BYTES 65536              // Buffered records are written in one call once they reach this size
+#define JOURNAL_FSYNC_RECORDS 64               // Default: fsync after this many unsynced records (NOTEMAKER_FSYNC_RECORDS)
+#define JOURNAL_FSYNC_INTERVAL_MS 1000         // Default: or once this much time has passed (NOTEMAKER_FSYNC_MS)
+#define JOURNAL_COMPACT_BYTES (8u << 20)       // Default: fold the journal into a snapshot past this size (NOTEMAKER_COMPACT_BYTES)
+
+// Kinds of journal records
+enum JournalRecordType{
+    JOURNAL_ADD_NOTE = 1,
+    JOURNAL_DELETE_NOTE,
+    JOURNAL_ADD_FOLDER,
+    JOURNAL_DELETE_FOLDER,
+    JOURNAL_ADD_TASK,
+    JOURNAL_EXECUTE_TASK,
+    JOURNAL_DELETE_TASK,
+    JOURNAL_CLONE_FOLDER,
+    JOURNAL_RESTORE_FOLDER
+};
+
+// Structure to represent the header at the start of a journal file
+struct JournalHeader{
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t generation; // Matches the journalGeneration of the snapshot this journal continues
+};
+
+// Structure to represent the fixed part of a record; the name bytes and a checksum of both follow it
+struct JournalRecord{
+    uint32_t type;
+    uint32_t nameLength;
+    uint32_t folderId;
+    int32_t priority;
+    int64_t dueTime;        // Task records: the due time, or the next one for an executed recurring task
+    uint64_t taskSeq;       // Task records: the task's sequence number; 0 in records replayed from a version 1 journal.
+                            // Clone records: the id of the folder copied; restore records: the id of the folder put back.
+                            // Add-folder records: 1 + the id of the new folder, as server clients may journal their
+                            // new folders in another order than they got their ids in; 0 in older records.
+    uint32_t repeatSeconds;
+    uint32_t reserved;
+};
+
+// Structure to represent the fixed part of a version 1 record
+struct JournalRecordV1{
+    uint32_t type;
+    uint32_t nameLength;
+    uint32_t folderId;
+    int32_t priority;
+};
+
+// Structure to represent the open journal and its commit settings
+struct Journal{
+    int fd;                         // -1 while journaling is off (before startup replay, or in tools)
+    uint64_t generation;
+    uint64_t fileSize;
+    char *buffer;                   // Records of the current commit group
+    size_t used;
+    size_t capacity;
+    size_t bufferedRecords;
+    size_t unsyncedRecords;
+    struct timespec lastSync;
+    size_t fsyncEveryRecords;
+    long fsyncIntervalMs;
+    uint64_t compactBytes;
+    pthread_t compactionThread;
+    atomic_int compactionState;     // 0 idle, 1 writing a snapshot in the background, 2 finished and waiting to be joined
+    pthread_mutex_t lock;           // Held while appending or committing; rotation runs with every writer shut out
+};
+
+struct Journal workspaceJournal = {.fd = -1, .lock = PTHREAD_MUTEX_INITIALIZER};
+
+// Function to read a positive numeric setting from the environment
+long journalSetting(const char *name, long fallback){
+    const char *value = getenv(name);
+    if (value != NULL && atol(value) > 0){
+        return atol(value);
+    }
+    return fallback;
+}
+
+// Function to get the milliseconds elapsed since a monotonic timestamp
+long millisecondsSince(const struct timespec *start){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long)(now.tv_sec - start->tv_sec) * 1000 + (now.tv_nsec - start->tv_nsec) / 1000000;
+}
+
+// Function to write the buffered commit group; the caller holds the journal lock
+void commitJournalGroup(struct Journal *journal){
+    if (journal->fd < 0 || journal->bufferedRecords == 0){
+        return;
+    }
+    uint64_t started = metricsNow();
+    if (writeAllBytes(journal->fd, journal->buffer, journal->used) != 0){
+        fprintf(stderr, "Could not write the journal: %s\n", strerror(errno));
+        exit(1);
+    }
+    recordMetric(METRIC_JOURNAL_WRITE, started);
+    journal->fileSize += journal->used;
+    journal->unsyncedRecords += journal->bufferedRecords;
+    journal->used = 0;
+    journal->bufferedRecords = 0;
+    if (journal->unsyncedRecords >= journal->fsyncEveryRecords || millisecondsSince(&journal->lastSync) >= journal->fsyncIntervalMs){
+        started = metricsNow();
+        fdatasync(journal->fd);
+        recordMetric(METRIC_JOURNAL_SYNC, started);
+        journal->unsyncedRecords = 0;
+        clock_gettime(CLOCK_MONOTONIC, &journal->lastSync);
+    }
+}
+
+// Function to write the buffered commit group to the journal and fsync it if the batching policy says so
+void journalCommit(struct Journal *journal){
+    pthread_mutex_lock(&journal->lock);
+    commitJournalGroup(journal);
+    pthread_mutex_unlock(&journal->lock);
+}
+
+// Function to append one record to the current commit group
+void appendJournalRecord(struct Journal *journal, struct JournalRecord record, const char *name){
+    pthread_mutex_lock(&journal->lock);
+    if (journal->fd < 0){
+        pthread_mutex_unlock(&journal->lock);
+        return;
+    }
+    record.nameLength = name == NULL ? 0 : (uint32_t)strlen(name);
+    size_t recordSize = sizeof(record) + record.nameLength + sizeof(uint64_t);
+    if (journal->used + recordSize > journal->capacity){
+        size_t newCapacity = journal->capacity == 0 ? JOURNAL_GROUP_BYTES : journal->capacity;
+        while (newCapacity < journal->used + recordSize){
+            newCapacity *= 2;
+        }
+        char *newBuffer = (char *)realloc(journal->buffer, newCapacity);
+        if (newBuffer == NULL){
+            fprintf(stderr, "Memory allocation failed.\n");
+            exit(1);
+        }
+        journal->buffer = newBuffer;
+        journal->capacity = newCapacity;
+    }
+    char *start = journal->buffer + journal->used;
+    memcpy(start, &record, sizeof(record));
+    if (record.nameLength != 0){
+        memcpy(start + sizeof(record), name, record.nameLength);
+    }
+    uint64_t checksum = checksumBytes((const unsigned char *)start, sizeof(record) + record.nameLength);
+    memcpy(start + sizeof(record) + record.nameLength, &checksum, sizeof(checksum));
+    journal->used += recordSize;
+    journal->bufferedRecords++;
+    if (journal->used >= JOURNAL_GROUP_BYTES){
+        commitJournalGroup(journal);
+    }
+    pthread_mutex_unlock(&journal->lock);
+}
+
+// Function to append one note or folder mutation to the current commit group
+void journalAppend(struct Journal *journal, enum JournalRecordType type, uint32_t folderId, int priority, const char *name){
+    struct JournalRecord record = {0};
+    record.type = (uint32_t)type;
+    record.folderId = folderId;
+    record.priority = priority;
+    appendJournalRecord(journal, record, name);
+}
+
+// Function to journal a new folder under its parent, with the id it was given
+void journalAppendFolder(struct Journal *journal, const struct FolderNode *folder){
+    struct JournalRecord record = {0};
+    record.type = JOURNAL_ADD_FOLDER;
+    record.folderId = folder->parentFolder->folderId;
+    record.taskSeq = (uint64_t)folder->folderId + 1;
+    appendJournalRecord(journal, record, nameText(folder->foldername));
+}
+
+// Function to append one task mutation; adds carry the task's name, executes carry its next due time
+void journalAppendTask(struct Journal *journal, enum JournalRecordType type, const struct TaskNode *task, int64_t dueTime){
+    struct JournalRecord record = {0};
+    record.type = (uint32_t)type;
+    record.priority = task->priority;
+    record.dueTime = dueTime;
+    record.taskSeq = task->seq;
+    record.repeatSeconds = task->repeatSeconds;
+    appendJournalRecord(journal, record, type == JOURNAL_ADD_TASK ? nameText(task->taskname) : NULL);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/*FULL-TEXT SEARCH INDEX*/
+// Posting lists are delta + varint coded: per note, the gap to the previous note id (the first gap is id + 1), the number
+// of positions, then the word positions as gaps. Note ids only grow, so new notes always append at the end of a list.
+#define SEARCH_MAX_THREADS 8
+#define SEARCH_MAX_TERM 64           // Longer words are cut to this many bytes
+#define SEARCH_MAX_RESULTS 20
+#define SEARCH_TEXT_CHUNK 65536
+
+// Structure to represent the compressed posting list of one term
+struct PostingList{
+    unsigned char *bytes;
+    size_t size;
+    size_t capacity;
+    uint32_t lastNote;
+    uint32_t noteCount;
+};
+
+// Structure to represent one term of the dictionary
+struct SearchTerm{
+    const char *text; // Lives in the table's text chunks
+    uint32_t length;
+    uint32_t hash;
+    struct PostingList postings;
+};
+
+// Structure to represent a term dictionary: dense term array plus an open-addressing table of term numbers
+struct TermTable{
+    struct SearchTerm *terms;
+    size_t termCount;
+    size_t termCapacity;
+    uint32_t *slots;           // Term number + 1; 0 marks an empty slot
+    size_t slotCapacity;       // Always a power of two
+    char **textChunks;         // Term text is bump-allocated in fixed chunks
+    size_t chunkCount;
+    size_t chunkUsed;
+    size_t postingBytes;       // Capacity of all posting lists, kept for the metrics report
+};
+
+// Structure to represent the workspace's search index
+struct SearchIndex{
+    int built;
+    struct TermTable table;
+    size_t indexedNotes;
+    pthread_mutex_t lock; // Held by incremental updates; building and querying run with every writer shut out
+};
+
+// Structure to represent a word occurrence while a note is being indexed
+struct TermOccurrence{
+    uint32_t term;
+    uint32_t position;
+};
+
+// Structure to represent the scratch space one indexing thread reuses across notes
+struct IndexScratch{
+    char *content;
+    size_t contentCapacity;
+    struct TermOccurrence *occurrences;
+    size_t occurrenceCapacity;
+};
+
+// Structure to represent the work of one indexing thread: a range of note ids and a private dictionary
+struct IndexWorker{
+    pthread_t thread;
+    uint32_t firstNote;
+    uint32_t endNote;
+    struct TermTable table;
+    size_t indexedNotes;
+};
+
+struct SearchIndex searchIndex = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+// Function to append an unsigned varint to a posting list
+void appendVarint(struct PostingList *list, uint32_t value){
+    if (list->size + 5 > list->capacity){
+        size_t newCapacity = list->capacity == 0 ? 16 : list->capacity * 2;
+        unsigned char *newBytes = (unsigned char *)realloc(list->bytes, newCapacity);
+        if (newBytes == NULL){
+            fprintf(stderr, "Memory allocation failed.\n");
+            exit(1);
+        }
+        list->bytes = newBytes;
+        list->capacity = newCapacity;
+    }
+    while (value >= 0x80){
+        list->bytes[list->size++] = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    list->bytes[list->size++] = (unsigned char)value;
+}
+
+// Function to read an unsigned varint and advance the cursor
+uint32_t readVarint(const unsigned char **cursor){
+    uint32_t value = 0;
+    int shift = 0;
+    while (**cursor & 0x80){
+        value |= (uint32_t)(**cursor & 0x7F) << shift;
+        shift += 7;
+        (*cursor)++;
+    }
+    value |= (uint32_t)**cursor << shift;
+    (*cursor)++;
+    return value;
+}
+
+// Function to find a term's number, or -1 if the term is not in the dictionary
+long findSearchTerm(struct TermTable *table, const char *text, size_t length, uint32_t hash){
+    if (table->slotCapacity == 0){
+        return -1;
+    }
+    size_t slot = hash & (table->slotCapacity - 1);
+    while (table->slots[slot] != 0){
+        struct SearchTerm *term = &table->terms[table->slots[slot] - 1];
+        if (term->hash == hash && term->length == length && memcmp(term->text, text, length) == 0){
+            return (long)(table->slots[slot] - 1);
+        }
+        slot = (slot + 1) & (table->slotCapacity - 1);
+    }
+    return -1;
+}
+
+// Function to find a term's number, adding the term to the dictionary if it is new
+uint32_t addSearchTerm(struct TermTable *table, const char *text, size_t length, uint32_t hash){
+    long existing = findSearchTerm(table, text, length, hash);
+    if (existing >= 0){
+        return (uint32_t)existing;
+    }
+    if ((table->termCount + 1) * 2 > table->slotCapacity){
+        size_t newCapacity = table->slotCapacity == 0 ? 1024 : table->slotCapacity * 2;
+        uint32_t *newSlots = (uint32_t *)calloc(newCapacity, sizeof(uint32_t));
+        if (newSlots == NULL){
+            fprintf(stderr, "Memory allocation failed.\n");
+            exit(1);
+        }
+        for (size_t i = 0; i < table->termCount; i++){
+            size_t slot = table->terms[i].hash & (newCapacity - 1);
+            while (newSlots[slot] != 0){
+                slot = (slot + 1) & (newCapacity - 1);
+            }
+            newSlots[slot] = (uint32_t)i + 1;
+        }
+        free(table->slots);
+        table->slots = newSlots;
+        table->slotCapacity = newCapacity;
+    }
+    if (table->termCount == table->termCapacity){
+        size_t newCapacity = table->termCapacity == 0 ? 1024 : table->termCapacity * 2;
+        struct SearchTerm *newTerms = (struct SearchTerm *)realloc(table->terms, newCapacity * sizeof(struct SearchTerm));
+        if (newTerms == NULL){
+            fprintf(stderr, "Memory allocation failed.\n");
+            exit(1);
+        }
+        table->terms = newTerms;
+        table->termCapacity = newCapacity;
+    }
+    if (table->chunkCount == 0 || table->chunkUsed + length > SEARCH_TEXT_CHUNK){
+        char **newChunks = (char **)realloc(table->textChunks, (table->chunkCount + 1) * sizeof(char *));
+        if (newChunks == NULL || (newChunks[table->chunkCount] = (char *)malloc(SEARCH_TEXT_CHUNK)) == NULL){
+            fprintf(stderr, "Memory allocation failed.\n");
+            exit(1);
+        }
+        table->textChunks = newChunks;
+        table->chunkCount++;
+        table->chunkUsed = 0;
+    }
+    char *stored = table->textChunks[table->chunkCount - 1] + table->chunkUsed;
+    memcpy(stored, text, length);
+    table->chunkUsed += length;
+
+    struct SearchTerm *term = &table->terms[table->termCount];
+    memset(term, 0, sizeof(*term));
+    term->text = stored;
+    term->length = (uint32_t)length;
+    term->hash = hash;
+    size_t slot = hash & (table->slotCapacity - 1);
+    while (table->slots[slot] != 0){
+        slot = (slot + 1) & (table->slotCapacity - 1);
+    }
+    table->slots[slot] = (uint32_t)table->termCount + 1;
+    return (uint32_t)table->termCount++;
+}
+
+// Function to release a term dictionary and all of its posting lists
+void freeTermTable(struct TermTable *table){
+    for (size_t i = 0; i < table->termCount; i++){
+        free(table->terms[i].postings.bytes);
+    }
+    for (size_t i = 0; i < table->chunkCount; i++){
+        free(table->textChunks[i]);
+    }
+    free(table->terms);
+    free(table->slots);
+    free(table->textChunks);
+    memset(table, 0, sizeof(*table));
+}
+
+// Function to check whether a byte belongs to a word (letters, digits and any non-ASCII byte)
+int isWordByte(unsigned char c){
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c >= 0x80;
+}
+
+// Function to cut the next lower-cased word out of a text; returns its length, or 0 at the end of the text
+size_t nextSearchWord(const char **cursor, const char *end, char *word){
+    const char *p = *cursor;
+    while (p < end && !isWordByte((unsigned char)*p)){
+        p++;
+    }
+    size_t length = 0;
+    while (p < end && isWordByte((unsigned char)*p)){
+        if (length < SEARCH_MAX_TERM){
+            char c = *p;
+            word[length++] = (c >= 'A' && c <= 'Z') ? (char)(c - 'A' + 'a') : c;
+        }
+        p++;
+    }
+    *cursor = p;
+    return length;
+}
+
+// Function to order word occurrences by term, then by position
+int compareTermOccurrences(const void *a, const void *b){
+    const struct TermOccurrence *x = (const struct TermOccurrence *)a;
+    const struct TermOccurrence *y = (const struct TermOccurrence *)b;
+    if (x->term != y->term){
+        return x->term < y->term ? -1 : 1;
+    }
+    return (x->position > y->position) - (x->position < y->position);
+}
+
+// Function to make room for at least needed bytes of note content in the scratch buffer
+void reserveScratchContent(struct IndexScratch *scratch, size_t needed){
+    if (needed <= scratch->contentCapacity){
+        return;
+    }
+    size_t newCapacity = scratch->contentCapacity == 0 ? 65536 : scratch->contentCapacity * 2;
+    while (newCapacity < needed){
+        newCapacity *= 2;
+    }
+    char *newContent = (char *)realloc(scratch->content, newCapacity);
+    if (newContent == NULL){
+        fprintf(stderr, "Memory allocation failed.\n");
+        exit(1);
+    }
+    scratch->content = newContent;
+    scratch->contentCapacity = newCapacity;
+}
+
+// Structure to represent a scratch buffer being filled from the note store
+struct ScratchFill{
+    struct IndexScratch *scratch;
+    size_t size;
+};
+
+// Function to append a chunk streamed from the note store to the scratch buffer
+void appendChunkToScratch(void *context, const unsigned char *bytes, size_t length){
+    struct ScratchFill *fill = (struct ScratchFill *)context;
+    reserveScratchContent(fill->scratch, fill->size + length);
+    memcpy(fill->scratch->content + fill->size, bytes, length);
+    fill->size += length;
+}
+
+// Function to read a note's content into the scratch buffer; returns the byte count, or 0 if there is nothing to read
+size_t readNoteContent(const char *path, struct IndexScratch *scratch){
+    struct ScratchFill fill = {scratch, 0};
+    if (readStoredNote(&noteStore, path, appendChunkToScratch, &fill) >= 0){
+        return fill.size;
+    }
+    int fd = open(path, O_RDONLY);
+    if (fd < 0){
+        return 0;
+    }
+    size_t size = 0;
+    while (1){
+        reserveScratchContent(scratch, size + 1);
+        ssize_t got = read(fd, scratch->content + size, scratch->contentCapacity - size);
+        if (got < 0 && errno == EINTR){
+            continue;
+        }
+        if (got <= 0){
+            break;
+        }
+        size += (size_t)got;
+    }
+    close(fd);
+    return size;
+}
+
+// Function to index the contents of one note into a dictionary under the given note id
+void indexNoteContent(struct TermTable *table, uint32_t noteId, const char *path, struct IndexScratch *scratch){
+    size_t size = readNoteContent(path, scratch);
+    const char *cursor = scratch->content;
+    const char *end = cursor + size;
+    char word[SEARCH_MAX_TERM];
+    size_t count = 0;
+    size_t length;
+    while ((length = nextSearchWord(&cursor, end, word)) != 0){
+        if (count == scratch->occurrenceCapacity){
+            size_t newCapacity = scratch->occurrenceCapacity == 0 ? 4096 : scratch->occurrenceCapacity * 2;
+            struct TermOccurrence *newOccurrences = (struct TermOccurrence *)realloc(scratch->occurrences, newCapacity * sizeof(struct TermOccurrence));
+            if (newOccurrences == NULL){
+                fprintf(stderr, "Memory allocation failed.\n");
+                exit(1);
+            }
+            scratch->occurrences = newOccurrences;
+            scratch->occurrenceCapacity = newCapacity;
+        }
+        scratch->occurrences[count].term = addSearchTerm(table, word, length, hashName(word, length));
+        scratch->occurrences[count].position = (uint32_t)count;
+        count++;
+    }
+    if (count > 1){
+        qsort(scratch->occurrences, count, sizeof(struct TermOccurrence), compareTermOccurrences);
+    }
+
+    size_t i = 0;
+    while (i < count){
+        size_t runEnd = i;
+        while (runEnd < count && scratch->occurrences[runEnd].term == scratch->occurrences[i].term){
+            runEnd++;
+        }
+        struct PostingList *list = &table->terms[scratch->occurrences[i].term].postings;
+        size_t oldCapacity = list->capacity;
+        appendVarint(list, list->noteCount == 0 ? noteId + 1 : noteId - list->lastNote);
+        appendVarint(list, (uint32_t)(runEnd - i));
+        uint32_t previous = 0;
+        for (size_t j = i; j < runEnd; j++){
+            appendVarint(list, scratch->occurrences[j].position - previous);
+            previous = scratch->occurrences[j].position;
+        }
+        list->lastNote = noteId;
+        list->noteCount++;
+        table->postingBytes += list->capacity - oldCapacity;
+        i = runEnd;
+    }
+}
+
+// Function run by each indexing thread over its range of note ids
+void *runIndexWorker(void *argument){
+    struct IndexWorker *worker = (struct IndexWorker *)argument;
+    struct IndexScratch scratch = {NULL, 0, NULL, 0};
+    for (uint32_t noteId = worker->firstNote; noteId < worker->endNote; noteId++){
+        struct FileNode *note = noteRegistry.byId[noteId];
+        if (note != NULL){
+            indexNoteContent(&worker->table, noteId, nameText(note->filename), &scratch);
+            worker->indexedNotes++;
+        }
+    }
+    free(scratch.content);
+    free(scratch.occurrences);
+    return NULL;
+}
+
+// Function to append a worker's posting list to the merged one; only the first note gap has to be re-coded
+void mergePostingList(struct PostingList *into, const struct PostingList *from){
+    const unsigned char *cursor = from->bytes;
+    uint32_t firstNote = readVarint(&cursor) - 1;
+    appendVarint(into, into->noteCount == 0 ? firstNote + 1 : firstNote - into->lastNote);
+    size_t rest = from->size - (size_t)(cursor - from->bytes);
+    if (into->size + rest > into->capacity){
+        size_t newCapacity = into->capacity == 0 ? 16 : into->capacity;
+        while (newCapacity < into->size + rest){
+            newCapacity *= 2;
+        }
+        unsigned char *newBytes = (unsigned char *)realloc(into->bytes, newCapacity);
+        if (newBytes == NULL){
+            fprintf(stderr, "Memory allocation failed.\n");
+            exit(1);
+        }
+        into->bytes = newBytes;
+        into->capacity = newCapacity;
+    }
+    memcpy(into->bytes + into->size, cursor, rest);
+    into->size += rest;
+    into->lastNote = from->lastNote;
+    into->noteCount += from->noteCount;
+}
+
+// Function to build the search index over every note, splitting the note ids across a pool of threads
+void buildSearchIndex(struct SearchIndex *index){
+    freeTermTable(&index->table);
+    index->indexedNotes = 0;
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads < 1){
+        threads = 1;
+    }
+    if (threads > SEARCH_MAX_THREADS){
+        threads = SEARCH_MAX_THREADS;
+    }
+    uint32_t noteCount = noteRegistry.count;
+    struct IndexWorker *workers = (struct IndexWorker *)calloc((size_t)threads, sizeof(struct IndexWorker));
+    if (workers == NULL){
+        fprintf(stderr, "Memory allocation failed.\n");
+        exit(1);
+    }
+    for (long t = 0; t < threads; t++){
+        workers[t].firstNote = (uint32_t)((uint64_t)noteCount * t / threads);
+        workers[t].endNote = (uint32_t)((uint64_t)noteCount * (t + 1) / threads);
+        if (pthread_create(&workers[t].thread, NULL, runIndexWorker, &workers[t]) != 0){
+            runIndexWorker(&workers[t]);
+            workers[t].thread = pthread_self();
+        }
+    }
+    // Workers cover ascending id ranges, so merging them in order keeps every posting list sorted
+    for (long t = 0; t < threads; t++){
+        if (!pthread_equal(workers[t].thread, pthread_self())){
+            pthread_join(workers[t].thread, NULL);
+        }
+        struct TermTable *local = &workers[t].table;
+        for (size_t i = 0; i < local->termCount; i++){
+            struct SearchTerm *term = &local->terms[i];
+            uint32_t merged = addSearchTerm(&index->table, term->text, term->length, term->hash);
+            struct PostingList *postings = &index->table.terms[merged].postings;
+            size_t oldCapacity = postings->capacity;
+            mergePostingList(postings, &term->postings);
+            index->table.postingBytes += postings->capacity - oldCapacity;
+        }
+        index->indexedNotes += workers[t].indexedNotes;
+        freeTermTable(local);
+    }
+    free(workers);
+    index->built = 1;
+}
+
+// Function to drop the index so the next search builds it again from every note, after a change too large to apply
+// note by note
+void resetSearchIndex(struct SearchIndex *index){
+    pthread_mutex_lock(&index->lock);
+    freeTermTable(&index->table);
+    index->indexedNotes = 0;
+    index->built = 0;
+    pthread_mutex_unlock(&index->lock);
+}
+
+// Function to index a note that was just added or edited, if the index has been built
+void searchIndexAddNote(struct SearchIndex *index, struct FileNode *note){
+    pthread_mutex_lock(&index->lock);
+    if (!index->built){
+        pthread_mutex_unlock(&index->lock);
+        return;
+    }
+    struct IndexScratch scratch = {NULL, 0, NULL, 0};
+    indexNoteContent(&index->table, note->fileId, nameText(note->filename), &scratch);
+    index->indexedNotes++;
+    pthread_mutex_unlock(&index->lock);
+    free(scratch.content);
+    free(scratch.occurrences);
+}
+
+// Structure to represent a reading position in one posting list
+struct PostingCursor{
+    const unsigned char *next;
+    const unsigned char *end;
+    uint32_t note;
+    uint32_t positionCount;
+    const unsigned char *positions;
+    int valid;
+};
+
+// Function to step a posting cursor to its next note
+void advancePostingCursor(struct PostingCursor *cursor, int first){
+    if (!first){
+        // Skip the positions of the current note
+        const unsigned char *p = cursor->positions;
+        for (uint32_t i = 0; i < cursor->positionCount; i++){
+            readVarint(&p);
+        }
+        cursor->next = p;
+    }
+    if (cursor->next >= cursor->end){
+        cursor->valid = 0;
+        return;
+    }
+    uint32_t gap = readVarint(&cursor->next);
+    cursor->note = first ? gap - 1 : cursor->note + gap;
+    cursor->positionCount = readVarint(&cursor->next);
+    cursor->positions = cursor->next;
+}
+
+// Function to check whether the query words occur one after another somewhere in the current note
+int cursorsFormPhrase(struct PostingCursor *cursors, int termCount){
+    const unsigned char *p = cursors[0].positions;
+    uint32_t start = 0;
+    for (uint32_t i = 0; i < cursors[0].positionCount; i++){
+        start += readVarint(&p);
+        int matched = 1;
+        for (int t = 1; t < termCount && matched; t++){
+            const unsigned char *q = cursors[t].positions;
+            uint32_t position = 0;
+            matched = 0;
+            for (uint32_t j = 0; j < cursors[t].positionCount; j++){
+                position += readVarint(&q);
+                if (position >= start + (uint32_t)t){
+                    matched = position == start + (uint32_t)t;
+                    break;
+                }
+            }
+        }
+        if (matched){
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Structure to represent one ranked search hit
+struct SearchHit{
+    uint32_t note;
+    uint32_t score;
+};
+
+// Function to run a query: notes containing every word (or, for a "quoted phrase", the words in order), ranked by how
+// often the words occur. Returns the number of matches; up to maxHits of the best are stored in hits.
+size_t querySearchIndex(struct SearchIndex *index, const char *query, struct SearchHit *hits, size_t maxHits, size_t *hitCount){
+    int phrase = query[0] == '"';
+    const char *cursor = query;
+    const char *end = query + strlen(query);
+    char word[SEARCH_MAX_TERM];
+    size_t length;
+    struct PostingCursor cursors[16];
+    int termCount = 0;
+    *hitCount = 0;
+    while ((length = nextSearchWord(&cursor, end, word)) != 0 && termCount < 16){
+        long term = findSearchTerm(&index->table, word, length, hashName(word, length));
+        if (term < 0){
+            return 0;
+        }
+        struct PostingList *list = &index->table.terms[term].postings;
+        cursors[termCount].next = list->bytes;
+        cursors[termCount].end = list->bytes + list->size;
+        cursors[termCount].valid = 1;
+        advancePostingCursor(&cursors[termCount], 1);
+        termCount++;
+    }
+    if (termCount == 0){
+        return 0;
+    }
+
+    size_t matches = 0;
+    while (cursors[0].valid){
+        // Leapfrog: move every cursor up to the largest current note until they all agree
+        uint32_t target = cursors[0].note;
+        int agreed = 1;
+        for (int t = 0; t < termCount; t++){
+            while (cursors[t].valid && cursors[t].note < target){
+                advancePostingCursor(&cursors[t], 0);
+            }
+            if (!cursors[t].valid){
+                return matches;
+            }
+            if (cursors[t].note > target){
+                target = cursors[t].note;
+                agreed = 0;
+            }
+        }
+        if (!agreed){
+            while (cursors[0].valid && cursors[0].note < target){
+                advancePostingCursor(&cursors[0], 0);
+            }
+            continue;
+        }
+        // Notes deleted since they were indexed no longer have a registry entry, or sit in a folder in the trash
+        if (target < noteRegistry.count && noteRegistry.byId[target] != NULL && !folderInTrash(noteRegistry.byId[target]->folder) &&
+            (!phrase || cursorsFormPhrase(cursors, termCount))){
+            uint32_t score = 0;
+            for (int t = 0; t < termCount; t++){
+                score += cursors[t].positionCount;
+            }
+            matches++;
+            size_t slot = *hitCount < maxHits ? (*hitCount)++ : maxHits;
+            while (slot > 0 && hits[slot - 1].score < score){
+                if (slot < maxHits){
+                    hits[slot] = hits[slot - 1];
+                }
+                slot--;
+            }
+            if (slot < maxHits){
+                hits[slot].note = target;
+                hits[slot].score = score;
+            }
+        }
+        advancePostingCursor(&cursors[0], 0);
+    }
+    return matches;
+}
+
+// Function to run a query and print the ranked notes with their full paths
+void printSearchResults(struct SearchIndex *index, const char *query){
+    uint64_t started = metricsNow();
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (!index->built){
+        pthread_mutex_lock(&index->lock); // The metrics report reads the table under it
+        buildSearchIndex(index);
+        pthread_mutex_unlock(&index->lock);
+        fprintf(sessionStream(), " Indexed %zu notes (%zu terms) in %ld ms.\n", index->indexedNotes, index->table.termCount, millisecondsSince(&start));
+        clock_gettime(CLOCK_MONOTONIC, &start);
+    }
+    struct SearchHit hits[SEARCH_MAX_RESULTS];
+    size_t hitCount;
+    size_t matches = querySearchIndex(index, query, hits, SEARCH_MAX_RESULTS, &hitCount);
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double elapsed = (double)(now.tv_sec - start.tv_sec) * 1000.0 + (double)(now.tv_nsec - start.tv_nsec) / 1e6;
+    fprintf(sessionStream(), " %zu matching notes (%.3f ms)", matches, elapsed);
+    fprintf(sessionStream(), hitCount < matches ? ", showing the best %zu:\n" : ":\n", hitCount);
+    for (size_t i = 0; i < hitCount; i++){
+        struct FileNode *note = noteRegistry.byId[hits[i].note];
+        char *path = buildNotePath(note);
+        fprintf(sessionStream(), "%zu. %s (%u hits)\n", i + 1, path, hits[i].score);
+        free(path);
+    }
+    recordMetric(METRIC_SEARCH, started);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/*NAME FINDER*/
+// find <text> looks up notes and Topic Folders anywhere in the workspace by name. Every distinct name is a key of a
+// radix trie whose edge labels point into the name pool, so a new name costs at most two small trie nodes; the notes
+// and folders carrying a name are listed at the node where it ends. Names starting with the text come from walking the
+// trie below it shortest first, names containing it from a table of the names holding each three-byte sequence, and
+// names one typo away (texts of 3 to 5 bytes) or two (longer texts) from walking the trie with one row of edit
+// distances per byte, leaving every branch that is already too far off. Exact matches rank first, then names starting
+// with the text, names containing it and names with typos; within those fewer typos, shorter names, earlier matches
+// and shallower paths come first. The finder is built on first use and then follows every change to notes and folders.
+#define NAME_FINDER_RESULTS 20
+#define NAME_FINDER_UNLISTED UINT32_MAX // finderSlot of a node the finder does not list
+
+// Structure to represent a node of the name trie; node 0 is the root
+struct NameTrieNode{
+    uint32_t labelOffset; // Bytes on the edge into this node, in the name pool
+    uint32_t labelLength;
+    uint32_t firstChild;  // Node numbers, 0 for none; siblings are ordered by the first byte of their labels
+    uint32_t nextSibling;
+    uint32_t name;        // 1 + the number of the name ending here, 0 if none does
+    uint32_t shortest;    // Length of the shortest name ever added below this node
+    uint32_t listed;      // Notes and folders listed under the names below this node
+};
+
+// Structure to represent a note or folder listed under its name
+struct NameFinderEntry{
+    void *node;
+    int isFolder;
+};
+
+// Structure to represent one distinct name and the notes and folders carrying it
+struct NameFinderName{
+    struct NameRef name;
+    struct NameFinderEntry *entries; // Each node's finderSlot is its position here
+    uint32_t count;
+    uint32_t capacity;
+};
+
+// Structure to represent the names holding one three-byte sequence
+struct NameTrigram{
+    uint32_t key;    // The three bytes plus one; 0 marks an empty slot
+    uint32_t count;
+    uint32_t capacity;
+    uint32_t *names; // Name numbers in the order the names were added
+};
+
+// Structure to represent the name finder. Names are never taken out: a name whose notes and folders are all gone
+// simply lists nothing, as the name pool keeps its bytes anyway.
+struct NameFinder{
+    struct NameTrieNode *nodes;
+    uint32_t nodeCount;
+    uint32_t nodeCapacity;
+    struct NameFinderName *names;
+    uint32_t nameCount;
+    uint32_t nameCapacity;
+    uint32_t longestName;
+    struct NameTrigram *trigrams;
+    size_t trigramCount;
+    size_t trigramCapacity; // Always a power of two
+    size_t listBytes;       // Capacity of the entry arrays of the names and the name arrays of the trigrams
+    size_t listed;
+    int built;
+    pthread_mutex_t lock;   // Server clients add and delete notes side by side
+};
+
+struct NameFinder nameFinder = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+// Function to make room for one more element at the end of an array of the finder. Arrays start with room for two, as
+// most names are carried by a single note and most three-byte sequences occur in only a few names.
+void *growFinderArray(void *array, uint32_t count, uint32_t *capacity, size_t elementSize){
+    if (count < *capacity){
+        return array;
+    }
+    uint32_t newCapacity = *capacity == 0 ? 2 : *capacity * 2;
+    void *newArray = realloc(array, (size_t)newCapacity * elementSize);
+    if (newArray == NULL){
+        fprintf(stderr, "Memory allocation failed.\n");
+        exit(1);
+    }
+    *capacity = newCapacity;
+    return newArray;
+}
+
+// Function to add a trie node with the given edge label and return its number
+uint32_t addNameTrieNode(struct NameFinder *finder, uint32_t labelOffset, uint32_t labelLength, uint32_t shortest){
+    finder->nodes = (struct NameTrieNode *)growFinderArray(finder->nodes, finder->nodeCount, &finder->nodeCapacity, sizeof(struct NameTrieNode));
+    finder->nodes[finder->nodeCount] = (struct NameTrieNode){labelOffset, labelLength, 0, 0, 0, shortest, 0};
+    return finder->nodeCount++;
+}
+
+// Function to find the child of a node whose label starts with a byte, or 0; previous receives the sibling it follows,
+// or would follow if it were added (0 if it comes first)
+uint32_t findNameTrieChild(struct NameFinder *finder, uint32_t node, unsigned char byte, uint32_t *previous){
+    *previous = 0;
+    for (uint32_t child = finder->nodes[node].firstChild; child != 0; child = finder->nodes[child].nextSibling){
+        unsigned char first = (unsigned char)namePool.data[finder->nodes[child].labelOffset];
+        if (first == byte){
+            return child;
+        }
+        if (first > byte){
+            return 0;
+        }
+        *previous = child;
+    }
+    return 0;
+}
+
+// Function to follow text down the trie: returns the node where it ends, or the node whose edge it ends inside, and
+// 0 if no name starts with it. exact is set when the text ends right at the node returned.
+uint32_t followNameTrie(struct NameFinder *finder, const char *text, size_t length, int *exact){
+    uint32_t node = 0;
+    size_t matched = 0;
+    while (matched < length){
+        uint32_t previous;
+        uint32_t child = findNameTrieChild(finder, node, (unsigned char)text[matched], &previous);
+        if (child == 0){
+            return 0;
+        }
+        const char *label = namePool.data + finder->nodes[child].labelOffset;
+        size_t labelLength = finder->nodes[child].labelLength;
+        size_t common = 1;
+        while (common < labelLength && matched + common < length && label[common] == text[matched + common]){
+            common++;
+        }
+        if (common < labelLength && matched + common < length){
+            return 0;
+        }
+        node = child;
+        matched += common;
+        if (common < labelLength){
+            *exact = 0;
+            return node;
+        }
+    }
+    *exact = 1;
+    return node;
+}
+
+// Function to add every three-byte sequence of a new name to the trigram table
+void addNameTrigrams(struct NameFinder *finder, struct NameRef name, uint32_t number){
+    const unsigned char *bytes = (const unsigned char *)nameText(name);
+    for (uint32_t i = 0; i + 3 <= name.length; i++){
+        if ((finder->trigramCount + 1) * 2 > finder->trigramCapacity){
+            size_t newCapacity = finder->trigramCapacity == 0 ? 4096 : finder->trigramCapacity * 2;
+            struct NameTrigram *newTrigrams = (struct NameTrigram *)calloc(newCapacity, sizeof(struct NameTrigram));
+            if (newTrigrams == NULL){
+                fprintf(stderr, "Memory allocation failed.\n");
+                exit(1);
+            }
+            for (size_t slot = 0; slot < finder->trigramCapacity; slot++){
+                if (finder->trigrams[slot].key != 0){
+                    size_t target = (finder->trigrams[slot].key * 2654435761u) & (newCapacity - 1);
+                    while (newTrigrams[target].key != 0){
+                        target = (target + 1) & (newCapacity - 1);
+                    }
+                    newTrigrams[target] = finder->trigrams[slot];
+                }
+            }
+            free(finder->trigrams);
+            finder->trigrams = newTrigrams;
+            finder->trigramCapacity = newCapacity;
+        }
+        uint32_t key = ((uint32_t)bytes[i] << 16 | (uint32_t)bytes[i + 1] << 8 | bytes[i + 2]) + 1;
+        size_t slot = (key * 2654435761u) & (finder->trigramCapacity - 1);
+        while (finder->trigrams[slot].key != 0 && finder->trigrams[slot].key != key){
+            slot = (slot + 1) & (finder->trigramCapacity - 1);
+        }
+        struct NameTrigram *trigram = &finder->trigrams[slot];
+        if (trigram->key == 0){
+            trigram->key = key;
+            finder->trigramCount++;
+        }
+        if (trigram->count != 0 && trigram->names[trigram->count - 1] == number){
+            continue; // The sequence occurs twice in this name
+        }
+        uint32_t oldCapacity = trigram->capacity;
+        trigram->names = (uint32_t *)growFinderArray(trigram->names, trigram->count, &trigram->capacity, sizeof(uint32_t));
+        finder->listBytes += (size_t)(trigram->capacity - oldCapacity) * sizeof(uint32_t);
+        trigram->names[trigram->count++] = number;
+    }
+}
+
+// Function to find the names holding a three-byte sequence, or NULL if none does
+struct NameTrigram *findNameTrigram(struct NameFinder *finder, const char *text){
+    if (finder->trigramCapacity == 0){
+        return NULL;
+    }
+    const unsigned char *bytes = (const unsigned char *)text;
+    uint32_t key = ((uint32_t)bytes[0] << 16 | (uint32_t)bytes[1] << 8 | bytes[2]) + 1;
+    size_t slot = (key * 2654435761u) & (finder->trigramCapacity - 1);
+    while (finder->trigrams[slot].key != 0){
+        if (finder->trigrams[slot].key == key){
+            return &finder->trigrams[slot];
+        }
+        slot = (slot + 1) & (finder->trigramCapacity - 1);
+    }
+    return NULL;
+}
+
+// Function to find the number of a name, adding it to the trie and the trigram table if it is new
+uint32_t addFinderName(struct NameFinder *finder, struct NameRef name){
+    const char *key = nameText(name);
+    uint32_t node = 0;
+    uint32_t matched = 0;
+    while (1){
+        if (finder->nodes[node].shortest > name.length){
+            finder->nodes[node].shortest = name.length;
+        }
+        if (matched == name.length){
+            break;
+        }
+        uint32_t previous;
+        uint32_t child = findNameTrieChild(finder, node, (unsigned char)key[matched], &previous);
+        if (child == 0){
+            uint32_t leaf = addNameTrieNode(finder, name.offset + matched, name.length - matched, name.length);
+            if (previous == 0){
+                finder->nodes[leaf].nextSibling = finder->nodes[node].firstChild;
+                finder->nodes[node].firstChild = leaf;
+            }
+            else{
+                finder->nodes[leaf].nextSibling = finder->nodes[previous].nextSibling;
+                finder->nodes[previous].nextSibling = leaf;
+            }
+            node = leaf;
+            break;
+        }
+        const char *label = namePool.data + finder->nodes[child].labelOffset;
+        uint32_t common = 1;
+        while (common < finder->nodes[child].labelLength && matched + common < name.length && label[common] == key[matched + common]){
+            common++;
+        }
+        if (common < finder->nodes[child].labelLength){
+            // The name leaves the edge part way along: split it there
+            uint32_t middle = addNameTrieNode(finder, finder->nodes[child].labelOffset, common, finder->nodes[child].shortest);
+            struct NameTrieNode *split = &finder->nodes[child];
+            finder->nodes[middle].listed = split->listed;
+            finder->nodes[middle].nextSibling = split->nextSibling;
+            finder->nodes[middle].firstChild = child;
+            split->nextSibling = 0;
+            split->labelOffset += common;
+            split->labelLength -= common;
+            if (previous == 0){
+                finder->nodes[node].firstChild = middle;
+            }
+            else{
+                finder->nodes[previous].nextSibling = middle;
+            }
+            child = middle;
+        }
+        node = child;
+        matched += common;
+    }
+    if (finder->nodes[node].name == 0){
+        finder->names = (struct NameFinderName *)growFinderArray(finder->names, finder->nameCount, &finder->nameCapacity, sizeof(struct NameFinderName));
+        finder->names[finder->nameCount] = (struct NameFinderName){name, NULL, 0, 0};
+        finder->nodes[node].name = ++finder->nameCount;
+        if (name.length > finder->longestName){
+            finder->longestName = name.length;
+        }
+        addNameTrigrams(finder, name, finder->nameCount - 1);
+    }
+    return finder->nodes[node].name - 1;
+}
+
+// Function to add to the listed count of every trie node on the way to a name already in the trie
+void adjustFinderListed(struct NameFinder *finder, struct NameRef name, int delta){
+    const char *key = nameText(name);
+    uint32_t node = 0;
+    uint32_t matched = 0;
+    while (1){
+        finder->nodes[node].listed += (uint32_t)delta;
+        if (matched == name.length){
+            return;
+        }
+        uint32_t previous;
+        node = findNameTrieChild(finder, node, (unsigned char)key[matched], &previous);
+        matched += finder->nodes[node].labelLength;
+    }
+}
+
+// Function to get the finder slot field of a listed note or folder
+uint32_t *finderSlotOf(struct NameFinderEntry entry){
+    return entry.isFolder ? &((struct FolderNode *)entry.node)->finderSlot : &((struct FileNode *)entry.node)->finderSlot;
+}
+
+// Function to get the name of a listed note or folder
+struct NameRef finderEntryName(struct NameFinderEntry entry){
+    return entry.isFolder ? ((struct FolderNode *)entry.node)->foldername : ((struct FileNode *)entry.node)->filename;
+}
+
+// Function to list a note or folder under its name; the caller holds the finder lock
+void listInNameFinderLocked(struct NameFinder *finder, struct NameFinderEntry entry){
+    uint32_t *slot = finderSlotOf(entry);
+    if (*slot != NAME_FINDER_UNLISTED){
+        return;
+    }
+    struct NameRef name = finderEntryName(entry);
+    uint32_t number = addFinderName(finder, name); // May move the names array
+    struct NameFinderName *named = &finder->names[number];
+    uint32_t oldCapacity = named->capacity;
+    named->entries = (struct NameFinderEntry *)growFinderArray(named->entries, named->count, &named->capacity, sizeof(struct NameFinderEntry));
+    finder->listBytes += (size_t)(named->capacity - oldCapacity) * sizeof(struct NameFinderEntry);
+    *slot = named->count;
+    named->entries[named->count++] = entry;
+    adjustFinderListed(finder, name, 1);
+    finder->listed++;
+}
+
+// Function to stop listing a note or folder; the caller holds the finder lock
+void unlistFromNameFinderLocked(struct NameFinder *finder, struct NameFinderEntry entry){
+    uint32_t *slot = finderSlotOf(entry);
+    if (*slot == NAME_FINDER_UNLISTED){
+        return;
+    }
+    struct NameRef name = finderEntryName(entry);
+    int exact;
+    struct NameFinderName *named = &finder->names[finder->nodes[followNameTrie(finder, nameText(name), name.length, &exact)].name - 1];
+    struct NameFinderEntry last = named->entries[--named->count];
+    named->entries[*slot] = last;
+    *finderSlotOf(last) = *slot;
+    *slot = NAME_FINDER_UNLISTED;
+    adjustFinderListed(finder, name, -1);
+    finder->listed--;
+}
+
+// Function to list (or stop listing) a folder's notes and everything below it, and the folder itself with self set
+void walkNameFinderSubtree(struct NameFinder *finder, struct FolderNode *folder, int self, int list){
+    if (self){
+        struct NameFinderEntry entry = {folder, 1};
+        if (list){
+            listInNameFinderLocked(finder, entry);
+        }
+        else{
+            unlistFromNameFinderLocked(finder, entry);
+        }
+    }
+    for (struct FileNode *note = folder->fileList.head; note != NULL; note = note->next){
+        struct NameFinderEntry entry = {note, 0};
+        if (list){
+            listInNameFinderLocked(finder, entry);
+        }
+        else{
+            unlistFromNameFinderLocked(finder, entry);
+        }
+    }
+    for (struct FolderNode *child = folder->firstChild; child != NULL; child = child->nextFolder){
+        walkNameFinderSubtree(finder, child, 1, list);
+    }
+}
+
+// Function to list a new note or folder, if the finder has been built
+void listInNameFinder(void *node, int isFolder){
+    if (!nameFinder.built){
+        return;
+    }
+    pthread_mutex_lock(&nameFinder.lock);
+    listInNameFinderLocked(&nameFinder, (struct NameFinderEntry){node, isFolder});
+    pthread_mutex_unlock(&nameFinder.lock);
+}
+
+// Function to stop listing a note or folder that is deleted or put aside, if the finder has been built
+void unlistFromNameFinder(void *node, int isFolder){
+    if (!nameFinder.built){
+        return;
+    }
+    pthread_mutex_lock(&nameFinder.lock);
+    unlistFromNameFinderLocked(&nameFinder, (struct NameFinderEntry){node, isFolder});
+    pthread_mutex_unlock(&nameFinder.lock);
+}
+
+// Function to list (list 1) or stop listing (list 0) a folder with everything below it, if the finder has been built
+void updateNameFinderSubtree(struct FolderNode *folder, int list){
+    if (!nameFinder.built){
+        return;
+    }
+    pthread_mutex_lock(&nameFinder.lock);
+    walkNameFinderSubtree(&nameFinder, folder, 1, list);
+    pthread_mutex_unlock(&nameFinder.lock);
+}
+
+// Function to build the finder over every note and folder below the root; the caller holds the finder lock
+void buildNameFinder(struct NameFinder *finder, struct FolderNode *root){
+    if (finder->nodeCount == 0){
+        addNameTrieNode(finder, 0, 0, UINT32_MAX);
+    }
+    walkNameFinderSubtree(finder, root, 0, 1); // The root itself has no name to find it by
+    finder->built = 1;
+}
+
+// Structure to represent a name that matches the text
+struct NameFinderCandidate{
+    uint32_t name;
+    int kind;          // 0 exact, 1 starts with the text, 2 contains it, 3 within the allowed typos
+    int distance;      // Typos
+    uint32_t position; // Where the text starts inside the name
+    struct NameRef text;
+};
+
+// Structure to represent one note or folder found
+struct NameFinderMatch{
+    struct NameFinderEntry entry;
+    struct NameFinderCandidate candidate;
+    uint32_t depth;    // Folders above it
+    char *path;
+};
+
+// Structure to represent the matches of one query and the candidate names waiting to be ranked
+struct NameFinderQuery{
+    struct NameFinder *finder;
+    const char *text;
+    size_t length;
+    struct NameFinderMatch matches[NAME_FINDER_RESULTS];
+    size_t matchCount;
+    struct NameFinderCandidate *candidates;
+    uint32_t candidateCount;
+    uint32_t candidateCapacity;
+    struct NameFinderMatch *group; // The listed nodes of one name, before the best of them are taken
+    uint32_t groupCapacity;
+};
+
+// Function to compare two candidate names in rank order
+int compareNameCandidates(const void *a, const void *b){
+    const struct NameFinderCandidate *x = (const struct NameFinderCandidate *)a;
+    const struct NameFinderCandidate *y = (const struct NameFinderCandidate *)b;
+    struct NameRef nameX = x->text;
+    struct NameRef nameY = y->text;
+    if (x->kind != y->kind){
+        return x->kind - y->kind;
+    }
+    if (x->distance != y->distance){
+        return x->distance - y->distance;
+    }
+    if (nameX.length != nameY.length){
+        return nameX.length < nameY.length ? -1 : 1;
+    }
+    if (x->position != y->position){
+        return x->position < y->position ? -1 : 1;
+    }
+    return memcmp(nameText(nameX), nameText(nameY), nameX.length);
+}
+
+// Function to compare two nodes of the same name, shallower first
+int compareNameMatchDepths(const void *a, const void *b){
+    const struct NameFinderMatch *x = (const struct NameFinderMatch *)a;
+    const struct NameFinderMatch *y = (const struct NameFinderMatch *)b;
+    return x->depth != y->depth ? (x->depth < y->depth ? -1 : 1) : 0;
+}
+
+// Function to note a name that matches; the caller ranks the names of one kind before taking their nodes
+void addNameCandidate(struct NameFinderQuery *query, uint32_t name, int kind, int distance, uint32_t position){
+    query->candidates = (struct NameFinderCandidate *)growFinderArray(query->candidates, query->candidateCount, &query->candidateCapacity,
+                                                                      sizeof(struct NameFinderCandidate));
+    query->candidates[query->candidateCount++] = (struct NameFinderCandidate){name, kind, distance, position, query->finder->names[name].name};
+}
+
+// Function to rank the candidate names gathered and take their notes and folders, skipping those in the trash, until
+// the results are full; returns 1 once they are
+int takeNameCandidates(struct NameFinderQuery *query){
+    struct NameFinder *finder = query->finder;
+    if (query->candidateCount > 1){
+        qsort(query->candidates, query->candidateCount, sizeof(struct NameFinderCandidate), compareNameCandidates);
+    }
+    for (uint32_t i = 0; i < query->candidateCount && query->matchCount < NAME_FINDER_RESULTS; i++){
+        struct NameFinderName *named = &finder->names[query->candidates[i].name];
+        uint32_t groupCount = 0;
+        for (uint32_t e = 0; e < named->count; e++){
+            struct NameFinderEntry entry = named->entries[e];
+            struct FolderNode *folder = entry.isFolder ? (struct FolderNode *)entry.node : ((struct FileNode *)entry.node)->folder;
+            if (folderInTrash(folder)){
+                continue;
+            }
+            uint32_t depth = 0;
+            for (struct FolderNode *ancestor = folder; ancestor->parentFolder != NULL; ancestor = ancestor->parentFolder){
+                depth++;
+            }
+            query->group = (struct NameFinderMatch *)growFinderArray(query->group, groupCount, &query->groupCapacity, sizeof(struct NameFinderMatch));
+            query->group[groupCount++] = (struct NameFinderMatch){entry, query->candidates[i], depth, NULL};
+        }
+        size_t room = NAME_FINDER_RESULTS - query->matchCount;
+        if (groupCount > room){
+            qsort(query->group, groupCount, sizeof(struct NameFinderMatch), compareNameMatchDepths);
+            groupCount = (uint32_t)room;
+        }
+        for (uint32_t g = 0; g < groupCount; g++){
+            query->matches[query->matchCount++] = query->group[g];
+        }
+    }
+    query->candidateCount = 0;
+    return query->matchCount == NAME_FINDER_RESULTS;
+}
+
+// Structure to represent a step of the shortest-first walk: a trie node to open, or a name to report
+struct NameWalkStep{
+    uint32_t length; // Shortest name the step can lead to
+    uint32_t node;
+    int report;
+};
+
+// Function to push a step onto the walk's min-heap
+void pushNameWalkStep(struct NameWalkStep **heap, uint32_t *count, uint32_t *capacity, struct NameWalkStep step){
+    *heap = (struct NameWalkStep *)growFinderArray(*heap, *count, capacity, sizeof(struct NameWalkStep));
+    uint32_t position = (*count)++;
+    while (position > 0 && (*heap)[(position - 1) / 2].length > step.length){
+        (*heap)[position] = (*heap)[(position - 1) / 2];
+        position = (position - 1) / 2;
+    }
+    (*heap)[position] = step;
+}
+
+// Function to pop the step of the walk's min-heap leading to the shortest names
+struct NameWalkStep popNameWalkStep(struct NameWalkStep *heap, uint32_t *count){
+    struct NameWalkStep top = heap[0];
+    struct NameWalkStep last = heap[--*count];
+    uint32_t position = 0;
+    while (2 * position + 1 < *count){
+        uint32_t child = 2 * position + 1;
+        if (child + 1 < *count && heap[child + 1].length < heap[child].length){
+            child++;
+        }
+        if (heap[child].length >= last.length){
+            break;
+        }
+        heap[position] = heap[child];
+        position = child;
+    }
+    if (*count > 0){
+        heap[position] = last;
+    }
+    return top;
+}
+
+// Function to take the names starting with the text, shortest first. Names of one length are gathered until they
+// list enough nodes to fill the results, then ranked; start is the node the text leads to and skip the name of an
+// exact match.
+int findNamesByPrefix(struct NameFinderQuery *query, uint32_t start, uint32_t skip){
+    struct NameFinder *finder = query->finder;
+    struct NameWalkStep *heap = NULL;
+    uint32_t count = 0;
+    uint32_t capacity = 0;
+    int full = 0;
+    pushNameWalkStep(&heap, &count, &capacity, (struct NameWalkStep){finder->nodes[start].shortest, start, 0});
+    while (count > 0 && !full){
+        uint32_t length = heap[0].length;
+        size_t gathered = 0;
+        while (count > 0 && heap[0].length == length && gathered < NAME_FINDER_RESULTS - query->matchCount){
+            struct NameWalkStep step = popNameWalkStep(heap, &count);
+            struct NameTrieNode *node = &finder->nodes[step.node];
+            if (step.report){
+                addNameCandidate(query, node->name - 1, 1, 0, 0);
+                gathered += finder->names[node->name - 1].count;
+                continue;
+            }
+            if (node->name != 0 && node->name != skip && finder->names[node->name - 1].count != 0){
+                pushNameWalkStep(&heap, &count, &capacity, (struct NameWalkStep){finder->names[node->name - 1].name.length, step.node, 1});
+            }
+            for (uint32_t child = node->firstChild; child != 0; child = finder->nodes[child].nextSibling){
+                if (finder->nodes[child].listed != 0){
+                    pushNameWalkStep(&heap, &count, &capacity, (struct NameWalkStep){finder->nodes[child].shortest, child, 0});
+                }
+            }
+        }
+        full = takeNameCandidates(query);
+    }
+    free(heap);
+    return full;
+}
+
+// Function to find where text first occurs in a name, or -1
+long findTextInName(const char *name, size_t nameLength, const char *text, size_t length){
+    for (const char *at = name; length <= nameLength - (size_t)(at - name); at++){
+        at = (const char *)memchr(at, text[0], nameLength - (size_t)(at - name) - length + 1);
+        if (at == NULL){
+            return -1;
+        }
+        if (memcmp(at, text, length) == 0){
+            return at - name;
+        }
+    }
+    return -1;
+}
+
+// Function to take the names containing the text past their first byte. Only names holding the text's rarest
+// three-byte sequence need checking.
+int findNamesBySubstring(struct NameFinderQuery *query){
+    struct NameFinder *finder = query->finder;
+    struct NameTrigram *rarest = NULL;
+    for (size_t i = 0; i + 3 <= query->length; i++){
+        struct NameTrigram *trigram = findNameTrigram(finder, query->text + i);
+        if (trigram == NULL){
+            return 0;
+        }
+        if (rarest == NULL || trigram->count < rarest->count){
+            rarest = trigram;
+        }
+    }
+    for (uint32_t i = 0; i < rarest->count; i++){
+        struct NameFinderName *named = &finder->names[rarest->names[i]];
+        if (named->count == 0){
+            continue;
+        }
+        long position = findTextInName(nameText(named->name), named->name.length, query->text, query->length);
+        if (position > 0){
+            addNameCandidate(query, rarest->names[i], 2, 0, (uint32_t)position);
+        }
+    }
+    return takeNameCandidates(query);
+}
+
+// Structure to represent the state of the typo walk: one row of edit distances per byte of the path so far
+struct NameTypoWalk{
+    struct NameFinderQuery *query;
+    int maxTypos;
+    int *rows;            // Row d holds the distances from the first d bytes of the path to each prefix of the text
+    unsigned char *path;  // The bytes of the path so far
+};
+
+// Function to walk the trie below a node whose path is depth bytes long, noting names within the allowed typos
+// (adjacent bytes swapped count as one typo)
+void walkNameTypos(struct NameTypoWalk *walk, uint32_t node, uint32_t depth){
+    struct NameFinderQuery *query = walk->query;
+    struct NameFinder *finder = query->finder;
+    size_t width = query->length + 1;
+    const unsigned char *text = (const unsigned char *)query->text;
+    const char *label = namePool.data + finder->nodes[node].labelOffset;
+    for (uint32_t k = 0; k < finder->nodes[node].labelLength; k++){
+        unsigned char byte = (unsigned char)label[k];
+        uint32_t d = depth + 1 + k;
+        walk->path[d] = byte;
+        int *row = walk->rows + d * width;
+        int *above = row - width;
+        row[0] = (int)d;
+        int best = row[0];
+        for (size_t j = 1; j < width; j++){
+            int cost = above[j - 1] + (text[j - 1] != byte);
+            if (above[j] + 1 < cost){
+                cost = above[j] + 1;
+            }
+            if (row[j - 1] + 1 < cost){
+                cost = row[j - 1] + 1;
+            }
+            if (d > 1 && j > 1 && byte == text[j - 2] && walk->path[d - 1] == text[j - 1] && (above - width)[j - 2] + 1 < cost){
+                cost = (above - width)[j - 2] + 1;
+            }
+            row[j] = cost;
+            if (cost < best){
+                best = cost;
+            }
+        }
+        if (best > walk->maxTypos){
+            return;
+        }
+    }
+    depth += finder->nodes[node].labelLength;
+    struct NameTrieNode *here = &finder->nodes[node];
+    int distance = walk->rows[depth * width + query->length];
+    if (here->name != 0 && distance > 0 && distance <= walk->maxTypos && finder->names[here->name - 1].count != 0){
+        struct NameRef name = finder->names[here->name - 1].name;
+        if (findTextInName(nameText(name), name.length, query->text, query->length) < 0){
+            addNameCandidate(query, here->name - 1, 3, distance, 0);
+        }
+    }
+    for (uint32_t child = here->firstChild; child != 0; child = finder->nodes[child].nextSibling){
+        if (finder->nodes[child].listed != 0){
+            walkNameTypos(walk, child, depth);
+        }
+    }
+}
+
+// Function to take the names within one typo of a text of 3 to 5 bytes, or two of a longer one
+int findNamesWithTypos(struct NameFinderQuery *query){
+    struct NameTypoWalk walk = {query, query->length <= 5 ? 1 : 2, NULL, NULL};
+    size_t width = query->length + 1;
+    walk.rows = (int *)malloc(((size_t)query->finder->longestName + 1) * width * sizeof(int));
+    walk.path = (unsigned char *)malloc((size_t)query->finder->longestName + 1);
+    if (walk.rows == NULL || walk.path == NULL){
+        fprintf(stderr, "Memory allocation failed.\n");
+        exit(1);
+    }
+    for (size_t j = 0; j < width; j++){
+        walk.rows[j] = (int)j;
+    }
+    walkNameTypos(&walk, 0, 0);
+    free(walk.rows);
+    free(walk.path);
+    return takeNameCandidates(query);
+}
+
+// Function to rank two matches for printing: by candidate, then shallower paths, then paths in byte order
+int compareNameMatches(const void *a, const void *b){
+    const struct NameFinderMatch *x = (const struct NameFinderMatch *)a;
+    const struct NameFinderMatch *y = (const struct NameFinderMatch *)b;
+    int order = compareNameCandidates(&x->candidate, &y->candidate);
+    if (order != 0){
+        return order;
+    }
+    if (x->depth != y->depth){
+        return x->depth < y->depth ? -1 : 1;
+    }
+    return strcmp(x->path, y->path);
+}
+
+// Function to find the notes and folders whose names match the text; the caller holds the finder lock and keeps
+// the tree from changing
+void queryNameFinder(struct NameFinderQuery *query){
+    struct NameFinder *finder = query->finder;
+    int exact = 0;
+    uint32_t start = followNameTrie(finder, query->text, query->length, &exact);
+    uint32_t skip = 0;
+    if (start != 0 && exact && finder->nodes[start].name != 0 && finder->names[finder->nodes[start].name - 1].count != 0){
+        skip = finder->nodes[start].name;
+        addNameCandidate(query, skip - 1, 0, 0, 0);
+        if (takeNameCandidates(query)){
+            return;
+        }
+    }
+    if (start != 0 && finder->nodes[start].listed != 0 && findNamesByPrefix(query, start, skip)){
+        return;
+    }
+    if (query->length >= 3 && (findNamesBySubstring(query) || findNamesWithTypos(query))){
+        return;
+    }
+}
+
+// 23) Function to print the notes and folders whose names best match the text, with their full paths; folders end
+// in /. Nothing else may change the tree meanwhile.
+void printNameMatches(FILE *output, struct FolderNode *root, const char *text){
+    uint64_t started = metricsNow();
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    pthread_mutex_lock(&nameFinder.lock);
+    if (!nameFinder.built){
+        buildNameFinder(&nameFinder, root);
+        fprintf(output, " Listed %zu notes and Topic Folders under %u names in %ld ms.\n", nameFinder.listed, nameFinder.nameCount,
+                millisecondsSince(&start));
+        clock_gettime(CLOCK_MONOTONIC, &start);
+    }
+    struct NameFinderQuery query;
+    memset(&query, 0, sizeof(query));
+    query.finder = &nameFinder;
+    query.text = text;
+    query.length = strlen(text);
+    if (query.length != 0){
+        queryNameFinder(&query);
+    }
+    for (size_t i = 0; i < query.matchCount; i++){
+        struct NameFinderEntry entry = query.matches[i].entry;
+        query.matches[i].path = entry.isFolder ? buildFolderPath((struct FolderNode *)entry.node) : buildNotePath((struct FileNode *)entry.node);
+    }
+    qsort(query.matches, query.matchCount, sizeof(struct NameFinderMatch), compareNameMatches);
+    pthread_mutex_unlock(&nameFinder.lock);
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double elapsed = (double)(now.tv_sec - start.tv_sec) * 1000.0 + (double)(now.tv_nsec - start.tv_nsec) / 1e6;
+
+    fprintf(output, " %s%zu %s (%.3f ms):\n", query.matchCount == NAME_FINDER_RESULTS ? "Best " : "", query.matchCount,
+            query.matchCount == 1 ? "match" : "matches", elapsed);
+    const char *kinds[] = {"exact", "starts with it", "contains it", "1 typo", "2 typos"};
+    for (size_t i = 0; i < query.matchCount; i++){
+        struct NameFinderMatch *match = &query.matches[i];
+        int kind = match->candidate.kind == 3 ? 2 + match->candidate.distance : match->candidate.kind;
+        fprintf(output, "%zu. %s%s (%s)\n", i + 1, match->path, match->entry.isFolder ? "/" : "", kinds[kind]);
+        free(match->path);
+    }
+    free(query.candidates);
+    free(query.group);
+    recordMetric(METRIC_FIND_NAME, started);
+}
+
+// Function to release the name finder
+void freeNameFinder(struct NameFinder *finder){
+    for (uint32_t i = 0; i < finder->nameCount; i++){
+        free(finder->names[i].entries);
+    }
+    for (size_t i = 0; i < finder->trigramCapacity; i++){
+        free(finder->trigrams[i].names);
+    }
+    free(finder->names);
+    free(finder->nodes);
+    free(finder->trigrams);
+    finder->names = NULL;
+    finder->nodes = NULL;
+    finder->trigrams = NULL;
+    finder->nameCount = finder->nameCapacity = finder->nodeCount = finder->nodeCapacity = 0;
+    finder->trigramCount = finder->trigramCapacity = finder->listBytes = finder->listed = 0;
+    finder->built = 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/*FOLDER AGGREGATES*/
+// Every folder carries the totals of its subtree, so a folder summary reads a handful of counters instead of walking
+// everything below it. Adding or deleting a note or folder updates the totals of each ancestor; the sizes come from
+// the note files and are measured at start-up and again after a note is edited.
+
+// Function to move a folder's latest change forward to when, unless it already records a later one
+void touchFolderStats(struct FolderStats *stats, int64_t when){
+    long long latest = atomic_load(&stats->lastModified);
+    while (latest < when && !atomic_compare_exchange_weak(&stats->lastModified, &latest, when)){
+    }
+}
+
+// Function to add notes and bytes (negative to take them away) to a folder and all of its ancestors
+void propagateNoteChange(struct FolderNode *folder, long long notes, long long bytes, int64_t when){
+    for (; folder != NULL; folder = folder->parentFolder){
+        atomic_fetch_add(&folder->stats.noteCount, notes);
+        atomic_fetch_add(&folder->stats.totalBytes, bytes);
+        touchFolderStats(&folder->stats, when);
+    }
+}
+
+// Function to count a newly linked folder, with whatever its own totals already hold, in the totals of its ancestors
+void propagateFolderAdded(struct FolderNode *folder){
+    long long notes = atomic_load(&folder->stats.noteCount);
+    long long bytes = atomic_load(&folder->stats.totalBytes);
+    long long folders = atomic_load(&folder->stats.folderCount) + 1;
+    int64_t now = (int64_t)time(NULL);
+    int level = atomic_load(&folder->stats.deepestLevel) + 1;
+    for (struct FolderNode *ancestor = folder->parentFolder; ancestor != NULL; ancestor = ancestor->parentFolder, level++){
+        atomic_fetch_add(&ancestor->stats.noteCount, notes);
+        atomic_fetch_add(&ancestor->stats.totalBytes, bytes);
+        atomic_fetch_add(&ancestor->stats.folderCount, folders);
+        int deepest = atomic_load(&ancestor->stats.deepestLevel);
+        while (deepest < level && !atomic_compare_exchange_weak(&ancestor->stats.deepestLevel, &deepest, level)){
+        }
+        touchFolderStats(&ancestor->stats, now);
+    }
+}
+
+// Function to take a detached folder's subtree out of the totals of the folder it was removed from and that folder's
+// ancestors. The deepest level is worked out again from the remaining children, which no one else may change meanwhile.
+void propagateFolderRemoved(struct FolderNode *parentFolder, struct FolderNode *removed){
+    long long notes = atomic_load(&removed->stats.noteCount);
+    long long bytes = atomic_load(&removed->stats.totalBytes);
+    long long folders = atomic_load(&removed->stats.folderCount) + 1;
+    int64_t now = (int64_t)time(NULL);
+    for (struct FolderNode *ancestor = parentFolder; ancestor != NULL; ancestor = ancestor->parentFolder){
+        atomic_fetch_sub(&ancestor->stats.noteCount, notes);
+        atomic_fetch_sub(&ancestor->stats.totalBytes, bytes);
+        atomic_fetch_sub(&ancestor->stats.folderCount, folders);
+        touchFolderStats(&ancestor->stats, now);
+    }
+    for (struct FolderNode *ancestor = parentFolder; ancestor != NULL; ancestor = ancestor->parentFolder){
+        int deepest = 0;
+        for (struct FolderNode *child = ancestor->firstChild; child != NULL; child = child->nextFolder){
+            int level = atomic_load(&child->stats.deepestLevel) + 1;
+            deepest = level > deepest ? level : deepest;
+        }
+        if (deepest == atomic_load(&ancestor->stats.deepestLevel)){
+            break; // Nothing above can change either
+        }
+        atomic_store(&ancestor->stats.deepestLevel, deepest);
+    }
+}
+
+// Function to get the size and modification time of a note, from the note store or its file; returns 0 if it has neither
+int measureNote(struct FileNode *note, uint64_t *size, int64_t *modified){
+    struct stat info;
+    if (findStoredNoteInfo(&noteStore, nameText(note->filename), size, modified)){
+        return 1;
+    }
+    if (stat(nameText(note->filename), &info) != 0){
+        return 0;
+    }
+    *size = (uint64_t)info.st_size;
+    *modified = (int64_t)info.st_mtime;
+    return 1;
+}
+
+// Function to measure a note again and pass the change in size up the tree
+void remeasureNote(struct FileNode *note){
+    uint64_t size = 0;
+    int64_t when = (int64_t)time(NULL);
+    measureNote(note, &size, &when);
+    long long change = (long long)size - (long long)note->byteSize;
+    note->byteSize = size;
+    propagateNoteChange(note->folder, 0, change, when);
+}
+
+// Function to compute the totals of a folder and everything below it from scratch, measuring every note file unless
+// measureFiles is 0; run on the loaded workspace, whose snapshot and journal do not record them
+void rebuildFolderStats(struct FolderNode *folder, int measureFiles){
+    long long notes = (long long)folder->fileList.count;
+    long long bytes = 0;
+    long long folders = 0;
+    int deepest = 0;
+    int64_t latest = 0;
+    for (struct FileNode *note = folder->fileList.head; note != NULL; note = note->next){
+        uint64_t size;
+        int64_t modified;
+        note->byteSize = 0;
+        if (measureFiles && measureNote(note, &size, &modified)){
+            note->byteSize = size;
+            latest = modified > latest ? modified : latest;
+        }
+        bytes += (long long)note->byteSize;
+    }
+    for (struct FolderNode *child = folder->firstChild; child != NULL; child = child->nextFolder){
+        rebuildFolderStats(child, measureFiles);
+        notes += atomic_load(&child->stats.noteCount);
+        bytes += atomic_load(&child->stats.totalBytes);
+        folders += atomic_load(&child->stats.folderCount) + 1;
+        int level = atomic_load(&child->stats.deepestLevel) + 1;
+        deepest = level > deepest ? level : deepest;
+        long long childLatest = atomic_load(&child->stats.lastModified);
+        latest = childLatest > latest ? childLatest : latest;
+    }
+    atomic_store(&folder->stats.noteCount, notes);
+    atomic_store(&folder->stats.totalBytes, bytes);
+    atomic_store(&folder->stats.folderCount, folders);
+    atomic_store(&folder->stats.deepestLevel, deepest);
+    atomic_store(&folder->stats.lastModified, latest);
+}
+
+// Function to print the totals of a folder and its subtree
+void printFolderSummary(FILE *output, struct FolderNode *folder){
+    char *path = buildFolderPath(folder);
+    long long lastModified = atomic_load(&folder->stats.lastModified);
+    char when[32] = "unknown";
+    if (lastModified != 0){
+        formatDueTime(lastModified, when, sizeof(when));
+    }
+    fprintf(output, " Summary of %s:\n", path);
+    fprintf(output, " Notes: %lld (%zu directly inside)\n", atomic_load(&folder->stats.noteCount), folder->fileList.count);
+    fprintf(output, " Topic Folders below: %lld (%zu directly inside)\n", atomic_load(&folder->stats.folderCount),
+            folder->childIndex.count);
+    fprintf(output, " Size of the Notes: %lld bytes\n", atomic_load(&folder->stats.totalBytes));
+    fprintf(output, " Deepest level below: %d\n", atomic_load(&folder->stats.deepestLevel));
+    fprintf(output, " Last modified: %s\n", when);
+    free(path);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/*MOVING NOTES INTO THE STORE*/
+// Function to move the plain file of every note under a folder into the store, remembering the names of the files moved.
+// A name shared by notes in several folders is one file, so it is moved once.
+void checkInFolderNotes(struct FolderNode *folder, struct NameRef **moved, size_t *count, size_t *capacity){
+    for (struct FileNode *note = folder->fileList.head; note != NULL; note = note->next){
+        uint64_t size;
+        int64_t modified;
+        if (findStoredNoteInfo(&noteStore, nameText(note->filename), &size, &modified) ||
+            checkInNoteFile(&noteStore, nameText(note->filename), 0) != 0){
+            continue;
+        }
+        if (*count == *capacity){
+            *capacity = *capacity == 0 ? 1024 : *capacity * 2;
+            struct NameRef *newMoved = (struct NameRef *)realloc(*moved, *capacity * sizeof(struct NameRef));
+            if (newMoved == NULL){
+                fprintf(stderr, "Memory allocation failed.\n");
+                exit(1);
+            }
+            *moved = newMoved;
+        }
+        (*moved)[(*count)++] = note->filename;
+    }
+    for (struct FolderNode *child = folder->firstChild; child != NULL; child = child->nextFolder){
+        checkInFolderNotes(child, moved, count, capacity);
+    }
+}
+
+// Function to print how much the store holds and how much room it takes
+void printNoteStoreReport(FILE *output){
+    pthread_mutex_lock(&noteStore.lock);
+    size_t notes = noteStore.liveNotes;
+    uint64_t contentBytes = noteStore.liveBytes;
+    uint64_t packBytes = noteStore.packSize;
+    size_t objects = noteStore.objectCount;
+    pthread_mutex_unlock(&noteStore.lock);
+    pthread_mutex_lock(&noteStore.cacheLock);
+    size_t hits = noteStore.cacheHits;
+    size_t misses = noteStore.cacheMisses;
+    pthread_mutex_unlock(&noteStore.cacheLock);
+    fprintf(output, " Note store: %zu notes, %llu bytes of content in %llu bytes of pack (%zu objects)", notes,
+            (unsigned long long)contentBytes, (unsigned long long)packBytes, objects);
+    if (packBytes != 0 && contentBytes != 0){
+        fprintf(output, ", %.2f bytes of content per byte of pack", (double)contentBytes / (double)packBytes);
+    }
+    fprintf(output, ".\n Chunk cache: %zu hits, %zu misses.\n", hits, misses);
+}
+
+// Function to switch the workspace over to the store: every note file is moved into it and deleted once the store
+// copy is durable, and notes written from now on go straight into it. Running it again moves any stray files.
+void moveNotesIntoStore(FILE *output, struct FolderNode *root){
+    waitForFileIo(); // No note file may still be on its way in or out
+    if (openNoteStore(&noteStore, 1) != 0){
+        fprintf(output, " The note store could not be opened, so the notes stay in their files.\n");
+        return;
+    }
+    struct NameRef *moved = NULL;
+    size_t count = 0;
+    size_t capacity = 0;
+    checkInFolderNotes(root, &moved, &count, &capacity);
+    syncNoteStore(&noteStore);
+    for (size_t i = 0; i < count; i++){
+        unlink(nameText(moved[i]));
+    }
+    free(moved);
+    fprintf(output, " Moved %zu note files into the store.\n", count);
+    printNoteStoreReport(output);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/*UNDO AND REDO*/
+// The menu and batch mode keep the last UNDO_LIMIT changes to notes, folders and tasks as records of how to reverse
+// them. A record points at the pooled node it changed, so nothing is copied: a deleted note or folder is only unlinked
+// and kept, with its files, until its record leaves the log, and undoing the delete links the same node back in. Each
+// undo or redo is journaled as the plain change it makes. A folder put back in the journal generation it was deleted
+// in is one restore record; after a compaction its subtree is journaled again folder by folder.
+#define UNDO_LIMIT 100
+
+// Kinds of changes that can be undone
+enum UndoKind{
+    UNDO_ADD_NOTE,
+    UNDO_DELETE_NOTE,
+    UNDO_ADD_FOLDER,
+    UNDO_DELETE_FOLDER,
+    UNDO_ADD_TASK,
+    UNDO_REMOVE_TASK,     // Deleted, or executed as a one-off
+    UNDO_RESCHEDULE_TASK  // A recurring task moved on to its next occurrence
+};
+
+// Structure to represent one change and what it touched
+struct UndoRecord{
+    enum UndoKind kind;
+    int undone;                 // Set while the change is reversed and waiting for a redo
+    struct FolderNode *folder;  // Folder holding the note, or parent of the folder
+    void *node;                 // The note, folder or task node changed
+    struct TaskQueue *queue;
+    int64_t dueTime;            // Reschedules: the other due time, swapped in by undo and redo alike
+    uint64_t trashGeneration;   // Journal generation the folder was last taken out of the tree in
+};
+
+// Structure to represent the log: a ring of the latest records, the first done of them not undone
+struct UndoLog{
+    struct UndoRecord records[UNDO_LIMIT];
+    size_t first;
+    size_t count;
+    size_t done;
+    int enabled;                // Off in server mode, where clients' changes interleave
+};
+
+struct UndoLog undoLog = {.enabled = 0};
+
+// Function to find the record at a position of the log, oldest first
+struct UndoRecord *undoRecordAt(struct UndoLog *log, size_t position){
+    return &log->records[(log->first + position) % UNDO_LIMIT];
+}
+
+// Function to let go of a record: a node it alone holds (a deleted one, or an added one whose add was undone) is freed
+// now, and its files go with it unless another note still has the name
+void finalizeUndoRecord(struct UndoRecord *record){
+    int holdsNode = (record->kind == UNDO_DELETE_NOTE || record->kind == UNDO_DELETE_FOLDER || record->kind == UNDO_REMOVE_TASK) ?
+                    !record->undone : (record->kind != UNDO_RESCHEDULE_TASK && record->undone);
+    if (!holdsNode){
+        return;
+    }
+    if (record->kind == UNDO_ADD_NOTE || record->kind == UNDO_DELETE_NOTE){
+        struct FileNode *note = (struct FileNode *)record->node;
+        struct NameRef name = note->filename;
+        if (releaseFileNode(note)){
+            submitFileIo(FILE_IO_UNLINK, name);
+        }
+    }
+    else if (record->kind == UNDO_ADD_FOLDER || record->kind == UNDO_DELETE_FOLDER){
+        updateNameFinderSubtree((struct FolderNode *)record->node, 0);
+        destroyFolderSubtree((struct FolderNode *)record->node, 1);
+    }
+    else{
+        releaseToPool(&workspaceArena.taskPool, record->node);
+    }
+}
+
+// Function to log a change that was just made; the changes undone so far can no longer be redone
+void pushUndo(enum UndoKind kind, struct FolderNode *folder, void *node, struct TaskQueue *queue, int64_t dueTime){
+    struct UndoLog *log = &undoLog;
+    while (log->count > log->done){
+        finalizeUndoRecord(undoRecordAt(log, --log->count));
+    }
+    if (log->count == UNDO_LIMIT){
+        finalizeUndoRecord(undoRecordAt(log, 0));
+        log->first = (log->first + 1) % UNDO_LIMIT;
+        log->count--;
+        log->done--;
+    }
+    struct UndoRecord *record = undoRecordAt(log, log->count++);
+    log->done++;
+    record->kind = kind;
+    record->undone = 0;
+    record->folder = folder;
+    record->node = node;
+    record->queue = queue;
+    record->dueTime = dueTime;
+    record->trashGeneration = workspaceJournal.generation;
+}
+
+// Function to empty the log, freeing every node it alone holds
+void clearUndoLog(void){
+    while (undoLog.count > 0){
+        finalizeUndoRecord(undoRecordAt(&undoLog, --undoLog.count));
+    }
+    undoLog.first = undoLog.done = 0;
+}
+
+// Function to give every folder of a subtree put back after a compaction a fresh id and journal it again in preorder,
+// folder then notes then children, so each folder is created before anything inside it
+void journalRestoredSubtree(struct FolderNode *folder){
+    registerFolder(folder);
+    journalAppendFolder(&workspaceJournal, folder);
+    for (struct FileNode *note = folder->fileList.head; note != NULL; note = note->next){
+        journalAppend(&workspaceJournal, JOURNAL_ADD_NOTE, folder->folderId, 0, nameText(note->filename));
+    }
+    for (struct FolderNode *child = folder->firstChild; child != NULL; child = child->nextFolder){
+        journalRestoredSubtree(child);
+    }
+}
+
+// Function to take the node of a record out of the workspace again, keeping it; a current folder inside a folder
+// taken out moves up to the folder's parent
+void takeAwayUndoNode(struct UndoRecord *record, struct FolderNode **currentFolder){
+    if (record->kind == UNDO_ADD_NOTE || record->kind == UNDO_DELETE_NOTE){
+        struct FileNode *note = (struct FileNode *)record->node;
+        unlinkFileNode(&record->folder->fileList, note);
+        unlistFromNameFinder(note, 0);
+        propagateNoteChange(record->folder, -1, -(long long)note->byteSize, (int64_t)time(NULL));
+        journalAppend(&workspaceJournal, JOURNAL_DELETE_NOTE, record->folder->folderId, 0, nameText(note->filename));
+        retireNoteId(note);
+    }
+    else if (record->kind == UNDO_ADD_FOLDER || record->kind == UNDO_DELETE_FOLDER){
+        struct FolderNode *folder = (struct FolderNode *)record->node;
+        if (folderIsWithin(*currentFolder, folder)){
+            *currentFolder = record->folder;
+        }
+        detachFolderFromParent(folder);
+        propagateFolderRemoved(record->folder, folder);
+        journalAppend(&workspaceJournal, JOURNAL_DELETE_FOLDER, record->folder->folderId, 0, nameText(folder->foldername));
+        trashFolder(folder);
+        record->trashGeneration = workspaceJournal.generation;
+    }
+    else{
+        struct TaskNode *task = (struct TaskNode *)record->node;
+        journalAppendTask(&workspaceJournal, JOURNAL_DELETE_TASK, task, task->dueTime);
+        cancelTaskTimer(task);
+        removeTaskAt(record->queue, task->heapIndex);
+    }
+}
+
+// Function to link the node of a record back into the workspace; returns 0 if its name has been taken meanwhile
+int bringBackUndoNode(struct UndoRecord *record){
+    if (record->kind == UNDO_ADD_NOTE || record->kind == UNDO_DELETE_NOTE){
+        struct FileNode *note = (struct FileNode *)record->node;
+        if (findInNameIndex(&record->folder->fileList.index, nameText(note->filename)) != NULL){
+            return 0;
+        }
+        note->next = note->prev = NULL;
+        appendFileNode(record->folder, note);
+        listInNameFinder(note, 0);
+        propagateNoteChange(record->folder, 1, (long long)note->byteSize, (int64_t)time(NULL));
+        journalAppend(&workspaceJournal, JOURNAL_ADD_NOTE, record->folder->folderId, 0, nameText(note->filename));
+        renumberNote(note);
+        if (searchIndex.built){
+            searchIndexAddNote(&searchIndex, note);
+        }
+    }
+    else if (record->kind == UNDO_ADD_FOLDER || record->kind == UNDO_DELETE_FOLDER){
+        struct FolderNode *folder = (struct FolderNode *)record->node;
+        if (findInNameIndex(&record->folder->childIndex, nameText(folder->foldername)) != NULL){
+            return 0;
+        }
+        folder->inTrash = 0;
+        linkChildFolder(record->folder, folder);
+        propagateFolderAdded(folder);
+        if (record->trashGeneration == workspaceJournal.generation){
+            struct JournalRecord restore = {0};
+            restore.type = JOURNAL_RESTORE_FOLDER;
+            restore.folderId = record->folder->folderId;
+            restore.taskSeq = folder->folderId; // Still its id: folders are only renumbered by a compaction
+            appendJournalRecord(&workspaceJournal, restore, nameText(folder->foldername));
+        }
+        else{
+            journalRestoredSubtree(folder);
+        }
+    }
+    else{
+        struct TaskNode *task = (struct TaskNode *)record->node;
+        pushTaskNode(record->queue, task);
+        scheduleTaskTimer(task);
+        journalAppendTask(&workspaceJournal, JOURNAL_ADD_TASK, task, task->dueTime);
+    }
+    return 1;
+}
+
+// Function to move a recurring task back or forward to the due time the record keeps, keeping the one it had instead
+void swapUndoDueTime(struct UndoRecord *record){
+    struct TaskNode *task = (struct TaskNode *)record->node;
+    int64_t dueTime = record->dueTime;
+    record->dueTime = task->dueTime;
+    cancelTaskTimer(task);
+    journalAppendTask(&workspaceJournal, JOURNAL_EXECUTE_TASK, task, dueTime);
+    task->dueTime = dueTime;
+    siftTaskDown(record->queue, task->heapIndex);
+    siftTaskUp(record->queue, task->heapIndex);
+    scheduleTaskTimer(task);
+}
+
+// Function to reverse the latest change not yet undone (redo 0) or make the earliest undone one again (redo 1); returns
+// 0 if there was none or it could not be done
+int undoOrRedo(FILE *output, int redo, struct FolderNode **currentFolder){
+    struct UndoLog *log = &undoLog;
+    if (!log->enabled || (redo ? log->done == log->count : log->done == 0)){
+        fprintf(output, " Nothing to %s.\n", redo ? "redo" : "undo");
+        return 0;
+    }
+    struct UndoRecord *record = undoRecordAt(log, redo ? log->done : log->done - 1);
+    int adds = record->kind == UNDO_ADD_NOTE || record->kind == UNDO_ADD_FOLDER || record->kind == UNDO_ADD_TASK;
+    if (record->kind == UNDO_RESCHEDULE_TASK){
+        swapUndoDueTime(record);
+    }
+    else if (adds != redo){
+        takeAwayUndoNode(record, currentFolder);
+    }
+    else if (!bringBackUndoNode(record)){
+        fprintf(output, " Cannot %s: the name is in use again.\n", redo ? "redo" : "undo");
+        return 0;
+    }
+    record->undone = !redo;
+    if (redo){
+        log->done++;
+    }
+    else{
+        log->done--;
+    }
+    fprintf(output, " %s (%zu more to undo, %zu to redo).\n", redo ? "Redone" : "Undone", log->done, log->count - log->done);
+    return 1;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/*MENU FUNCTIONALITIES*/
+// 1) Function to add a note to the doubly linked list
+void addFileToList(struct FolderNode *folder, const char *filename){
+    uint64_t started = metricsNow();
+    struct FileList *list = &folder->fileList;
+    if (findInNameIndex(&list->index, filename) != NULL){
+        fprintf(sessionStream(), "\n");
+        fprintf(sessionStream(), " Note %s already exists in this Topic Folder.\n", filename);
+        recordMetric(METRIC_ADD_NOTE, started);
+        return;
+    }
+    struct FileNode *newNode = createFileNode(internName(filename));
+    appendFileNode(folder, newNode);
+    searchIndexAddNote(&searchIndex, newNode);
+    listInNameFinder(newNode, 0);
+    journalAppend(&workspaceJournal, JOURNAL_ADD_NOTE, folder->folderId, 0, filename);
+    submitFileIo(FILE_IO_CREATE, newNode->filename); // Create the empty note file in the background
+    propagateNoteChange(folder, 1, 0, (int64_t)time(NULL));
+    if (undoLog.enabled){
+        pushUndo(UNDO_ADD_NOTE, folder, newNode, NULL, 0);
+    }
+    recordMetric(METRIC_ADD_NOTE, started);
+}
+
+// 2) Function to open a note in Notepad
+void openFileInNotepad(const char *filename){
+    uint64_t started = metricsNow();
+    size_t commandSize = strlen(filename) + sizeof("notepad ");
+    char *command = (char *)malloc(commandSize);
+    if (command == NULL){
+        fprintf(stderr, "Memory allocation failed.\n");
+        exit(1);
+    }
+    snprintf(command, commandSize, "notepad %s", filename);
+    uint64_t size;
+    int64_t modified;
+    if (findStoredNoteInfo(&noteStore, filename, &size, &modified) && checkOutStoredNote(&noteStore, filename) != 0){
+        printf(" Could not write %s out for editing: %s\n", filename, strerror(errno));
+    }
+    system(command);
+    free(command);
+    if (noteStoreActive()){
+        checkInNoteFile(&noteStore, filename, 1); // The edited version goes back into the store
+    }
+    recordMetric(METRIC_OPEN_NOTE, started);
+}
+
+// Function to pick up a note's new content after it was edited: it gets a fresh id so its old postings stop matching
+void reindexEditedNote(struct FileNode *note){
+    if (!searchIndex.built){
+        return;
+    }
+    renumberNote(note);
+    searchIndexAddNote(&searchIndex, note);
+}
+
+// 3) Function to print the list of files
+void printFileList(struct FileList *list){
+    uint64_t started = metricsNow();
+    struct FileNode *current = list->head;
+    int index = 1;
+    while (current != NULL){
+        fprintf(sessionStream(), "%d. %s\n", index, nameText(current->filename));
+        current = current->next;
+        index++;
+    }
+    recordMetric(METRIC_LIST_NOTES, started);
+}
+
+// 4) Function to delete a file from the doubly linked list and the file system
+void deleteFile(struct FolderNode *folder, const char *filename){
+    uint64_t started = metricsNow();
+    struct FileNode *current = (struct FileNode *)findInNameIndex(&folder->fileList.index, filename);
+    if (current == NULL){
+        recordMetric(METRIC_DELETE_NOTE, started);
+        return;
+    }
+
+    unlinkFileNode(&folder->fileList, current);
+    unlistFromNameFinder(current, 0);
+    propagateNoteChange(folder, -1, -(long long)current->byteSize, (int64_t)time(NULL));
+    journalAppend(&workspaceJournal, JOURNAL_DELETE_NOTE, folder->folderId, 0, filename);
+    if (undoLog.enabled){
+        retireNoteId(current); // Kept, file and all, until the delete can no longer be undone
+        pushUndo(UNDO_DELETE_NOTE, folder, current, NULL, 0);
+        recordMetric(METRIC_DELETE_NOTE, started);
+        return;
+    }
+    struct NameRef name = current->filename;
+    if (releaseFileNode(current)){
+        submitFileIo(FILE_IO_UNLINK, name); // Delete the file from the file system in the background
+    }
+    recordMetric(METRIC_DELETE_NOTE, started);
+}
+
+// Function to find the note a menu answer names: an index into the current folder's list, or a note path such as
+// /projects/q3/notes1; folder receives the folder holding it. NULL if there is no such note.
+struct FileNode *findNoteFromAnswer(struct FolderNode *currentFolder, const char *answer, struct FolderNode **folder){
+    char *end;
+    long fileIndex = strtol(answer, &end, 10);
+    if (end != answer && *end == '\0'){
+        *folder = currentFolder;
+        return fileIndex >= 1 && fileIndex <= INT_MAX ? getFileAtIndex(&currentFolder->fileList, (int)fileIndex) : NULL;
+    }
+    const char *leaf;
+    *folder = resolveParentPath(currentFolder, answer, &leaf);
+    return *folder != NULL ? (struct FileNode *)findInNameIndex(&(*folder)->fileList.index, leaf) : NULL;
+}
+
+// 5) Function to add a folder as the last child of its parent
+struct FolderNode *addFolderToTree(struct FolderNode *parentFolder, const char *foldername){
+    uint64_t started = metricsNow();
+    if (findInNameIndex(&parentFolder->childIndex, foldername) != NULL){
+        fprintf(sessionStream(), "\n");
+        fprintf(sessionStream(), " Topic Folder %s already exists here.\n", foldername);
+        recordMetric(METRIC_ADD_FOLDER, started);
+        return NULL;
+    }
+    struct FolderNode *newNode = createFolderNode(internName(foldername), parentFolder);
+    // Journaled before it is linked, so no server client can journal a change inside it ahead of its creation
+    journalAppendFolder(&workspaceJournal, newNode);
+    linkChildFolder(parentFolder, newNode);
+    propagateFolderAdded(newNode);
+    listInNameFinder(newNode, 1);
+    if (undoLog.enabled){
+        pushUndo(UNDO_ADD_FOLDER, parentFolder, newNode, NULL, 0);
+    }
+    recordMetric(METRIC_ADD_FOLDER, started);
+    return newNode;
+}
+
+// 6) Function to navigate to a child folder
+struct FolderNode *navigateToChildFolder(struct FolderNode *currentFolder, const char *foldername){
+    return (struct FolderNode *)findInNameIndex(&currentFolder->childIndex, foldername); // NULL if not found
+}
+
+// 7) Function to navigate to the parent folder
+struct FolderNode *navigateToParentFolder(struct FolderNode *currentFolder){
+    return currentFolder->parentFolder;
+}
+
+// 8) Function to delete a child folder and its whole subtree, including files; returns 0 if not found
+int deleteFolder(struct FolderNode *parentFolder, const char *foldername){
+    uint64_t started = metricsNow();
+    struct FolderNode *current = navigateToChildFolder(parentFolder, foldername);
+    if (current == NULL){
+        recordMetric(METRIC_DELETE_FOLDER, started);
+        return 0;
+    }
+    detachFolderFromParent(current);
+    propagateFolderRemoved(parentFolder, current);
+    journalAppend(&workspaceJournal, JOURNAL_DELETE_FOLDER, parentFolder->folderId, 0, foldername);
+    if (undoLog.enabled){
+        trashFolder(current);
+        pushUndo(UNDO_DELETE_FOLDER, parentFolder, current, NULL, 0);
+    }
+    else{
+        updateNameFinderSubtree(current, 0);
+        destroyFolderSubtree(current, 1);
+    }
+    recordMetric(METRIC_DELETE_FOLDER, started);
+    return 1;
+}
+
+// Function to copy a folder and everything below it into a new detached folder of the given name under parent. Only
+// nodes are made: each copied note keeps its name, and with it the note's content, which the original and the copy share.
+struct FolderNode *copyFolderSubtree(struct FolderNode *source, struct NameRef foldername, struct FolderNode *parent){
+    struct FolderNode *copy = createFolderNode(foldername, parent);
+    for (struct FileNode *note = source->fileList.head; note != NULL; note = note->next){
+        struct FileNode *noteCopy = createFileNode(note->filename);
+        noteCopy->byteSize = note->byteSize;
+        appendFileNode(copy, noteCopy);
+    }
+    for (struct FolderNode *child = source->firstChild; child != NULL; child = child->nextFolder){
+        linkChildFolder(copy, copyFolderSubtree(child, child->foldername, copy));
+    }
+    atomic_store(&copy->stats.noteCount, atomic_load(&source->stats.noteCount));
+    atomic_store(&copy->stats.folderCount, atomic_load(&source->stats.folderCount));
+    atomic_store(&copy->stats.totalBytes, atomic_load(&source->stats.totalBytes));
+    atomic_store(&copy->stats.deepestLevel, atomic_load(&source->stats.deepestLevel));
+    atomic_store(&copy->stats.lastModified, atomic_load(&source->stats.lastModified));
+    return copy;
+}
+
+// 20) Function to clone a folder with its whole subtree as a new child folder of parentFolder. Returns the clone, or
+// NULL if parentFolder already has a folder of that name. No other writer may run meanwhile: the clone is journaled
+// as one record, and replaying it must hand out the same folder ids.
+struct FolderNode *cloneFolder(struct FolderNode *source, struct FolderNode *parentFolder, const char *foldername){
+    uint64_t started = metricsNow();
+    if (findInNameIndex(&parentFolder->childIndex, foldername) != NULL){
+        fprintf(sessionStream(), " Topic Folder %s already exists here.\n", foldername);
+        recordMetric(METRIC_CLONE_FOLDER, started);
+        return NULL;
+    }
+    struct JournalRecord record = {0};
+    record.type = JOURNAL_CLONE_FOLDER;
+    record.folderId = parentFolder->folderId;
+    record.taskSeq = source->folderId;
+    appendJournalRecord(&workspaceJournal, record, foldername);
+    struct FolderNode *clone = copyFolderSubtree(source, internName(foldername), parentFolder); // Detached while it is built,
+    linkChildFolder(parentFolder, clone);                                                         // even inside source
+    propagateFolderAdded(clone);
+    updateNameFinderSubtree(clone, 1);
+    if (undoLog.enabled){
+        pushUndo(UNDO_ADD_FOLDER, parentFolder, clone, NULL, 0);
+    }
+    if (searchIndex.built){
+        resetSearchIndex(&searchIndex); // The copies are indexed with everything else on the next search
+    }
+    recordMetric(METRIC_CLONE_FOLDER, started);
+    fprintf(sessionStream(), " Cloned %lld notes and %lld Topic Folders.\n", atomic_load(&clone->stats.noteCount),
+            atomic_load(&clone->stats.folderCount) + 1);
+    return clone;
+}
+
+// 9) Add task to task list
+// (dueTime is TASK_NO_DEADLINE for a task without a deadline; repeatSeconds 0 for a one-off task)
+void addTaskToQueue(struct TaskQueue *queue, const char *taskname, int priority, int64_t dueTime, uint32_t repeatSeconds){
+    uint64_t started = metricsNow();
+    if (dueTime == TASK_NO_DEADLINE){
+        repeatSeconds = 0; // Only a deadline can recur
+    }
+    struct TaskNode *newNode = createTaskNode(internName(taskname), priority, dueTime, repeatSeconds, 0);
+    pushTaskNode(queue, newNode);
+    scheduleTaskTimer(newNode);
+    journalAppendTask(&workspaceJournal, JOURNAL_ADD_TASK, newNode, dueTime);
+    if (undoLog.enabled){
+        pushUndo(UNDO_ADD_TASK, NULL, newNode, queue, 0);
+    }
+    recordMetric(METRIC_ADD_TASK, started);
+}
+
+// Function to finish the task at the front of the queue: a recurring task moves to its next occurrence, a one-off task is removed
+void rescheduleOrReleaseTask(struct TaskQueue *queue, struct TaskNode *task){
+    cancelTaskTimer(task);
+    if (task->repeatSeconds != 0){
+        int64_t nextDue = nextOccurrence(task, (int64_t)time(NULL));
+        journalAppendTask(&workspaceJournal, JOURNAL_EXECUTE_TASK, task, nextDue);
+        if (undoLog.enabled){
+            pushUndo(UNDO_RESCHEDULE_TASK, NULL, task, queue, task->dueTime);
+        }
+        task->dueTime = nextDue;
+        siftTaskDown(queue, task->heapIndex);
+        scheduleTaskTimer(task);
+    }
+    else{
+        journalAppendTask(&workspaceJournal, JOURNAL_EXECUTE_TASK, task, TASK_NO_DEADLINE);
+        removeTaskAt(queue, task->heapIndex);
+        if (undoLog.enabled){
+            pushUndo(UNDO_REMOVE_TASK, NULL, task, queue, 0);
+        }
+        else{
+            releaseToPool(&workspaceArena.taskPool, task);
+        }
+    }
+}
+
+// 10) Remove prioritized task upon completion
+void executeHighestPriorityTask(struct TaskQueue *queue){
+    uint64_t started = metricsNow();
+    if (queue->count != 0){
+        struct TaskNode *taskToExecute = queue->heap[0];
+        printf("Executing task with priority %d: %s\n", taskToExecute->priority, nameText(taskToExecute->taskname));
+        rescheduleOrReleaseTask(queue, taskToExecute);
+    }
+    else{
+        printf("No tasks in the priority queue.\n");
+    }
+    recordMetric(METRIC_EXECUTE_TASK, started);
+}
+
+// 11) View the task list
+void printTaskQueue(struct TaskQueue *queue){
+    uint64_t started = metricsNow();
+    struct TaskNode **view = createOrderedTaskView(queue);
+    int64_t now = (int64_t)time(NULL);
+    for (size_t i = 0; i < queue->count; i++){
+        printTaskLine(stdout, i + 1, view[i], now);
+    }
+    free(view);
+    recordMetric(METRIC_LIST_TASKS, started);
+}
+
+// 12) Delete a task from the task list
+void deleteTask(struct TaskQueue *queue, int taskIndex){
+    uint64_t started = metricsNow();
+    if (taskIndex >= 1 && (size_t)taskIndex <= queue->count){
+        struct TaskNode **view = createOrderedTaskView(queue);
+        struct TaskNode *current = view[taskIndex - 1];
+        free(view);
+
+        journalAppendTask(&workspaceJournal, JOURNAL_DELETE_TASK, current, current->dueTime);
+        cancelTaskTimer(current);
+        removeTaskAt(queue, current->heapIndex);
+        if (undoLog.enabled){
+            pushUndo(UNDO_REMOVE_TASK, NULL, current, queue, 0);
+        }
+        else{
+            releaseToPool(&workspaceArena.taskPool, current);
+        }
+        printf("\n");
+        printf(" Task deleted.\n");
+    }
+    else{
+        printf("\n");
+        printf(" Invalid task index.\n");
+    }
+    recordMetric(METRIC_DELETE_TASK, started);
+}
+
+// 15) View the next due tasks, in due order, without sorting the whole queue
+void printNextDueTasks(FILE *output, struct TaskQueue **queues, int queueCount, size_t limit){
+    uint64_t started = metricsNow();
+    size_t queued = 0;
+    for (int q = 0; q < queueCount; q++){
+        queued += queues[q]->count;
+    }
+    if (limit > queued){
+        limit = queued;
+    }
+    if (limit > NEXT_DUE_MAX_COUNT){
+        limit = NEXT_DUE_MAX_COUNT;
+    }
+    struct TaskNode **due = (struct TaskNode **)malloc((limit + 1) * sizeof(struct TaskNode *));
+    if (due == NULL){
+        fprintf(stderr, "Memory allocation failed.\n");
+        exit(1);
+    }
+    size_t found = collectNextDueTasks(queues, queueCount, due, limit);
+    int64_t now = (int64_t)time(NULL);
+    for (size_t i = 0; i < found; i++){
+        printTaskLine(output, i + 1, due[i], now);
+    }
+    if (found == 0){
+        fprintf(output, " No tasks with a deadline.\n");
+    }
+    free(due);
+    recordMetric(METRIC_NEXT_DUE, started);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/*FREE THE FILE, FOLDER AND TASKS LIST*/
+// Function to free the memory allocated for the doubly linked list of files
+void freeFileList(struct FileList *list){
+    struct FileNode *head = list->head;
+    while (head != NULL){
+        struct FileNode *temp = head;
+        head = head->next;
+        releaseFileNode(temp);
+    }
+    freeNameIndex(&list->index);
+    freePositionArray(list);
+    memset(list, 0, sizeof(*list));
+}
+
+// Function to free the memory allocated for a folder and its subtree
+void freeFolderTree(struct FolderNode *root){
+    if (root != NULL){
+        destroyFolderSubtree(root, 0);
+    }
+}
+
+// Function to free only the per-folder tables of a subtree; the nodes themselves are left to the arena
+void freeFolderTables(struct FolderNode *folder){
+    for (struct FolderNode *child = folder->firstChild; child != NULL; child = child->nextFolder){
+        freeFolderTables(child);
+    }
+    freeNameIndex(&folder->fileList.index);
+    freePositionArray(&folder->fileList);
+    freeNameIndex(&folder->childIndex);
+    pthread_rwlock_destroy(&folder->lock);
+}
+
+//Function to free the queue alloted to task manager
+void freeTaskQueue(struct TaskQueue *queue){
+    for (size_t i = 0; i < queue->count; i++){
+        cancelTaskTimer(queue->heap[i]);
+        releaseToPool(&workspaceArena.taskPool, queue->heap[i]);
+    }
+    free(queue->heap);
+    free(queue->seqIndex);
+    queue->heap = NULL;
+    queue->seqIndex = NULL;
+    queue->count = queue->capacity = queue->indexCapacity = 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/*WORKSPACE SNAPSHOT*/
+// Layout: header | string table (page aligned, mapped straight into the name pool) | name table | folder table | file table | task table
+#define SNAPSHOT_PATH "notemaker.snapshot"
+#define SNAPSHOT_MAGIC "NMSNAP\0"
+#define SNAPSHOT_VERSION 3
+#define SNAPSHOT_OLDEST_VERSION 2 // Version 2 task records have no deadline, recurrence or sequence number
+#define SNAPSHOT_PAGE 4096
+#define SNAPSHOT_NONE UINT32_MAX // Missing parent, child or sibling link
+
+// Structure to represent the fixed header at the start of a snapshot file
+struct SnapshotHeader{
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;
+    uint64_t checksum;          // checksumBytes() of everything after the header
+    uint64_t fileSize;
+    uint64_t stringTableOffset;
+    uint64_t stringTableSize;
+    uint64_t nameTableOffset;   // One NameRef per distinct string, to rebuild the pool's dedup table without rehashing
+    uint64_t nameCount;
+    uint64_t folderTableOffset; // Folders in preorder; index 0 is the root
+    uint64_t folderCount;
+    uint64_t fileTableOffset;   // Notes grouped by folder, in list order
+    uint64_t fileCount;
+    uint64_t taskTableOffset;   // Tasks in heap order, so they load as a valid heap
+    uint64_t taskCount;
+    uint64_t journalGeneration; // First journal generation that is not folded into this snapshot
+};
+
+// Structure to represent a folder record; links are indices into the folder table
+struct SnapshotFolder{
+    struct NameRef name;
+    uint32_t parent;
+    uint32_t firstChild;
+    uint32_t nextSibling;
+    uint32_t firstFile;
+    uint32_t fileCount;
+};
+
+// Structure to represent a note record
+struct SnapshotFile{
+    struct NameRef name;
+};
+
+// Structure to represent a task record
+struct SnapshotTask{
+    struct NameRef name;
+    int32_t priority;
+    int64_t dueTime;
+    uint64_t seq;
+    uint32_t repeatSeconds;
+    uint32_t reserved;
+};
+
+// Structure to represent a version 2 task record
+struct SnapshotTaskV2{
+    struct NameRef name;
+    int32_t priority;
+};
+
+// Structure to represent a growable byte buffer a snapshot table is assembled in
+struct SnapshotBuffer{
+    char *data;
+    size_t size;
+    size_t capacity;
+};
+
+// Structure to represent the state of one snapshot being written
+struct SnapshotWriter{
+    struct SnapshotBuffer strings;
+    struct SnapshotBuffer names;
+    struct SnapshotBuffer folders;
+    struct SnapshotBuffer files;
+    uint32_t *remap;        // Open-addressing map from pool offset (key) to string table offset (value), in pairs
+    size_t remapCapacity;
+    size_t remapCount;
+};
+
+// Function to append bytes to a snapshot buffer
+void appendSnapshotBytes(struct SnapshotBuffer *buffer, const void *bytes, size_t size){
+    if (buffer->size + size > buffer->capacity){
+        size_t newCapacity = buffer->capacity == 0 ? 4096 : buffer->capacity;
+        while (newCapacity < buffer->size + size){
+            newCapacity *= 2;
+        }
+        char *newData = (char *)realloc(buffer->data, newCapacity);
+        if (newData == NULL){
+            fprintf(stderr, "Memory allocation failed.\n");
+            exit(1);
+        }
+        buffer->data = newData;
+        buffer->capacity = newCapacity;
+    }
+    memcpy(buffer->data + buffer->size, bytes, size);
+    buffer->size += size;
+}
+
+// Function to copy a live name into the snapshot's string table once and return its handle there
+struct NameRef remapSnapshotName(struct SnapshotWriter *writer, struct NameRef name){
+    if (name.length == 0){
+        return name;
+    }
+    if ((writer->remapCount + 1) * 2 > writer->remapCapacity){
+        size_t oldCapacity = writer->remapCapacity;
+        uint32_t *oldRemap = writer->remap;
+        writer->remapCapacity = oldCapacity == 0 ? 1024 : oldCapacity * 2;
+        writer->remap = (uint32_t *)calloc(writer->remapCapacity * 2, sizeof(uint32_t));
+        if (writer->remap == NULL){
+            fprintf(stderr, "Memory allocation failed.\n");
+            exit(1);
+        }
+        for (size_t i = 0; i < oldCapacity; i++){
+            if (oldRemap[2 * i] != 0){
+                size_t slot = (oldRemap[2 * i] * 2654435761u) & (writer->remapCapacity - 1);
+                while (writer->remap[2 * slot] != 0){
+                    slot = (slot + 1) & (writer->remapCapacity - 1);
+                }
+                writer->remap[2 * slot] = oldRemap[2 * i];
+                writer->remap[2 * slot + 1] = oldRemap[2 * i + 1];
+            }
+        }
+        free(oldRemap);
+    }
+    // Interned names are unique per pool offset, so the offset alone identifies the string
+    size_t slot = (name.offset * 2654435761u) & (writer->remapCapacity - 1);
+    while (writer->remap[2 * slot] != 0){
+        if (writer->remap[2 * slot] == name.offset){
+            name.offset = writer->remap[2 * slot + 1];
+            return name;
+        }
+        slot = (slot + 1) & (writer->remapCapacity - 1);
+    }
+    uint32_t newOffset = (uint32_t)writer->strings.size;
+    appendSnapshotBytes(&writer->strings, nameText(name), name.length + 1);
+    writer->remap[2 * slot] = name.offset;
+    writer->remap[2 * slot + 1] = newOffset;
+    writer->remapCount++;
+    name.offset = newOffset;
+    appendSnapshotBytes(&writer->names, &name, sizeof(name));
+    return name;
+}
+
+// Function to append a folder and its subtree to the folder table in preorder; returns the folder's index
+uint32_t appendSnapshotFolder(struct SnapshotWriter *writer, struct FolderNode *folder, uint32_t parent){
+    uint32_t index = (uint32_t)(writer->folders.size / sizeof(struct SnapshotFolder));
+    struct SnapshotFolder record;
+    record.name = remapSnapshotName(writer, folder->foldername);
+    record.parent = parent;
+    record.firstChild = SNAPSHOT_NONE;
+    record.nextSibling = SNAPSHOT_NONE;
+    record.firstFile = (uint32_t)(writer->files.size / sizeof(struct SnapshotFile));
+    record.fileCount = (uint32_t)folder->fileList.count;
+    appendSnapshotBytes(&writer->folders, &record, sizeof(record));
+
+    for (struct FileNode *file = folder->fileList.head; file != NULL; file = file->next){
+        struct SnapshotFile fileRecord;
+        fileRecord.name = remapSnapshotName(writer, file->filename);
+        appendSnapshotBytes(&writer->files, &fileRecord, sizeof(fileRecord));
+    }
+
+    uint32_t previousChild = SNAPSHOT_NONE;
+    for (struct FolderNode *child = folder->firstChild; child != NULL; child = child->nextFolder){
+        uint32_t childIndex = appendSnapshotFolder(writer, child, index);
+        // The table may have moved while the child's subtree was appended, so patch links by index
+        struct SnapshotFolder *records = (struct SnapshotFolder *)writer->folders.data;
+        if (previousChild == SNAPSHOT_NONE){
+            records[index].firstChild = childIndex;
+        }
+        else{
+            records[previousChild].nextSibling = childIndex;
+        }
+        previousChild = childIndex;
+    }
+    return index;
+}
+
+// Function to round a file offset up to the next page boundary
+uint64_t alignSnapshotOffset(uint64_t offset){
+    return (offset + SNAPSHOT_PAGE - 1) & ~(uint64_t)(SNAPSHOT_PAGE - 1);
+}
+
+// Function to lay out a complete snapshot image in memory; folders are renumbered in preorder to match the folder table
+unsigned char *buildWorkspaceSnapshot(struct FolderNode *root, struct TaskQueue *queue, uint64_t journalGeneration, size_t *imageSize){
+    struct SnapshotWriter writer;
+    memset(&writer, 0, sizeof(writer));
+    renumberFolders(root);
+    appendSnapshotBytes(&writer.strings, "", 1); // Offset 0 is the empty name, as in the pool
+    appendSnapshotFolder(&writer, root, SNAPSHOT_NONE);
+
+    struct SnapshotTask *tasks = (struct SnapshotTask *)calloc(queue->count + 1, sizeof(struct SnapshotTask));
+    if (tasks == NULL){
+        fprintf(stderr, "Memory allocation failed.\n");
+        exit(1);
+    }
+    for (size_t i = 0; i < queue->count; i++){
+        tasks[i].name = remapSnapshotName(&writer, queue->heap[i]->taskname);
+        tasks[i].priority = queue->heap[i]->priority;
+        tasks[i].repeatSeconds = queue->heap[i]->repeatSeconds;
+        tasks[i].dueTime = queue->heap[i]->dueTime;
+        tasks[i].seq = queue->heap[i]->seq;
+    }
+
+    struct SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.headerSize = sizeof(header);
+    header.stringTableOffset = SNAPSHOT_PAGE;
+    header.stringTableSize = writer.strings.size;
+    header.nameTableOffset = alignSnapshotOffset(header.stringTableOffset + header.stringTableSize);
+    header.nameCount = writer.names.size / sizeof(struct NameRef);
+    header.folderTableOffset = header.nameTableOffset + writer.names.size;
+    header.folderCount = writer.folders.size / sizeof(struct SnapshotFolder);
+    header.fileTableOffset = header.folderTableOffset + writer.folders.size;
+    header.fileCount = writer.files.size / sizeof(struct SnapshotFile);
+    header.taskTableOffset = header.fileTableOffset + writer.files.size;
+    header.taskCount = queue->count;
+    header.fileSize = header.taskTableOffset + queue->count * sizeof(struct SnapshotTask);
+    header.journalGeneration = journalGeneration;
+
+    // Lay the whole file out in one buffer so the checksum and the write are single passes
+    unsigned char *image = (unsigned char *)calloc((size_t)header.fileSize, 1);
+    if (image == NULL){
+        fprintf(stderr, "Memory allocation failed.\n");
+        exit(1);
+    }
+    memcpy(image + header.stringTableOffset, writer.strings.data, writer.strings.size);
+    memcpy(image + header.nameTableOffset, writer.names.data, writer.names.size);
+    memcpy(image + header.folderTableOffset, writer.folders.data, writer.folders.size);
+    if (writer.files.size != 0){
+        memcpy(image + header.fileTableOffset, writer.files.data, writer.files.size);
+    }
+    memcpy(image + header.taskTableOffset, tasks, queue->count * sizeof(struct SnapshotTask));
+    header.checksum = checksumBytes(image + sizeof(header), (size_t)header.fileSize - sizeof(header));
+    memcpy(image, &header, sizeof(header));
+
+    free(tasks);
+    free(writer.strings.data);
+    free(writer.names.data);
+    free(writer.folders.data);
+    free(writer.files.data);
+    free(writer.remap);
+    *imageSize = (size_t)header.fileSize;
+    return image;
+}
+
+// Function to write a snapshot image beside its final path, fsync it and rename it into place; returns 0 on success
+int writeSnapshotImage(const char *path, const unsigned char *image, size_t imageSize){
+    uint64_t started = metricsNow();
+    size_t tempPathSize = strlen(path) + sizeof(".tmp");
+    char *tempPath = (char *)malloc(tempPathSize);
+    if (tempPath == NULL){
+        fprintf(stderr, "Memory allocation failed.\n");
+        exit(1);
+    }
+    snprintf(tempPath, tempPathSize, "%s.tmp", path);
+    int result = -1;
+    int fd = open(tempPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd >= 0){
+        if (writeAllBytes(fd, image, imageSize) == 0 && fsync(fd) == 0){
+            result = 0;
+        }
+        if (close(fd) != 0){
+            result = -1;
+        }
+        if (result == 0 && rename(tempPath, path) != 0){
+            result = -1;
+        }
+    }
+    if (result != 0){
+        fprintf(stderr, "Could not save the workspace snapshot to %s: %s\n", path, strerror(errno));
+        unlink(tempPath);
+    }
+    free(tempPath);
+    recordMetric(METRIC_SNAPSHOT_WRITE, started);
+    return result;
+}
+
+// Function to save the workspace to a snapshot file; returns 0 on success
+int saveWorkspaceSnapshot(const char *path, struct FolderNode *root, struct TaskQueue *queue, uint64_t journalGeneration){
+    size_t imageSize;
+    unsigned char *image = buildWorkspaceSnapshot(root, queue, journalGeneration, &imageSize);
+    int result = writeSnapshotImage(path, image, imageSize);
+    free(image);
+    return result;
+}
+
+// Function to map a snapshot's string table straight into the (still empty) name pool and rebuild its dedup table
+int adoptSnapshotStrings(int fd, const struct SnapshotHeader *header, const struct NameRef *names){
+    struct NamePool *pool = &namePool;
+    if (pool->data == NULL){
+        initNamePool(pool);
+    }
+    if (pool->used != 1 || header->stringTableSize > pool->reserved){
+        return -1;
+    }
+    size_t mapSize = (size_t)alignSnapshotOffset(header->stringTableSize);
+    void *mapped = mmap(pool->data, mapSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, (off_t)header->stringTableOffset);
+    if (mapped == MAP_FAILED){
+        return -1;
+    }
+    pool->used = (size_t)header->stringTableSize;
+
+    size_t capacity = 1024;
+    while (capacity < header->nameCount * 2 + 2){
+        capacity *= 2;
+    }
+    pool->table = (struct NameRef *)calloc(capacity, sizeof(struct NameRef));
+    if (pool->table == NULL){
+        fprintf(stderr, "Memory allocation failed.\n");
+        exit(1);
+    }
+    pool->capacity = capacity;
+    for (uint64_t i = 0; i < header->nameCount; i++){
+        placeInternedName(pool->table, capacity, names[i]);
+    }
+    pool->count = (size_t)header->nameCount;
+    return 0;
+}
+
+// Function to load the workspace from a snapshot file; returns the root folder, or NULL if there is no usable snapshot
+struct FolderNode *loadWorkspaceSnapshot(const char *path, struct TaskQueue *queue, uint64_t *journalGeneration){
+    int fd = open(path, O_RDONLY);
+    if (fd < 0){
+        return NULL;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(struct SnapshotHeader)){
+        close(fd);
+        return NULL;
+    }
+    size_t fileSize = (size_t)info.st_size;
+    unsigned char *file = (unsigned char *)mmap(NULL, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (file == MAP_FAILED){
+        close(fd);
+        return NULL;
+    }
+
+    struct SnapshotHeader header;
+    memcpy(&header, file, sizeof(header));
+    const char *problem = NULL;
+    size_t taskRecordSize = header.version == SNAPSHOT_VERSION ? sizeof(struct SnapshotTask) : sizeof(struct SnapshotTaskV2);
+    if (memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0){
+        problem = "not a workspace snapshot";
+    }
+    else if (header.version < SNAPSHOT_OLDEST_VERSION || header.version > SNAPSHOT_VERSION || header.headerSize != sizeof(header)){
+        problem = "unsupported snapshot version";
+    }
+    else if (header.fileSize != fileSize || header.folderCount == 0 ||
+             header.stringTableOffset != SNAPSHOT_PAGE ||
+             header.nameTableOffset < header.stringTableOffset + header.stringTableSize ||
+             header.folderTableOffset != header.nameTableOffset + header.nameCount * sizeof(struct NameRef) ||
+             header.fileTableOffset != header.folderTableOffset + header.folderCount * sizeof(struct SnapshotFolder) ||
+             header.taskTableOffset != header.fileTableOffset + header.fileCount * sizeof(struct SnapshotFile) ||
+             header.fileSize != header.taskTableOffset + header.taskCount * taskRecordSize){
+        problem = "snapshot tables are truncated";
+    }
+    else if (checksumBytes(file + sizeof(header), fileSize - sizeof(header)) != header.checksum){
+        problem = "snapshot checksum mismatch";
+    }
+    else if (adoptSnapshotStrings(fd, &header, (const struct NameRef *)(file + header.nameTableOffset)) != 0){
+        problem = "snapshot string table does not fit the name pool";
+    }
+    if (problem != NULL){
+        fprintf(stderr, "Ignoring %s: %s.\n", path, problem);
+        munmap(file, fileSize);
+        close(fd);
+        return NULL;
+    }
+
+    // Folders come in preorder, so linking each one under its parent in table order restores sibling order
+    const struct SnapshotFolder *folderRecords = (const struct SnapshotFolder *)(file + header.folderTableOffset);
+    const struct SnapshotFile *fileRecords = (const struct SnapshotFile *)(file + header.fileTableOffset);
+    struct FolderNode **folders = (struct FolderNode **)malloc(header.folderCount * sizeof(struct FolderNode *));
+    if (folders == NULL){
+        fprintf(stderr, "Memory allocation failed.\n");
+        exit(1);
+    }
+    for (uint64_t i = 0; i < header.folderCount; i++){
+        const struct SnapshotFolder *record = &folderRecords[i];
+        struct FolderNode *parentFolder = (i == 0 || record->parent >= i) ? NULL : folders[record->parent];
+        folders[i] = createFolderNode(record->name, parentFolder);
+        if (parentFolder != NULL){
+            linkChildFolder(parentFolder, folders[i]);
+        }
+        for (uint32_t f = 0; f < record->fileCount && (uint64_t)record->firstFile + f < header.fileCount; f++){
+            appendFileNode(folders[i], createFileNode(fileRecords[record->firstFile + f].name));
+        }
+    }
+    for (uint64_t i = 0; i < header.taskCount; i++){
+        struct TaskNode *task;
+        if (header.version == SNAPSHOT_VERSION){
+            struct SnapshotTask record;
+            memcpy(&record, file + header.taskTableOffset + i * taskRecordSize, sizeof(record));
+            task = createTaskNode(record.name, record.priority, record.dueTime, record.repeatSeconds, record.seq);
+        }
+        else{
+            struct SnapshotTaskV2 record;
+            memcpy(&record, file + header.taskTableOffset + i * taskRecordSize, sizeof(record));
+            task = createTaskNode(record.name, record.priority, TASK_NO_DEADLINE, 0, 0);
+        }
+        pushTaskNode(queue, task);
+        scheduleTaskTimer(task);
+    }
+
+    struct FolderNode *root = folders[0];
+    *journalGeneration = header.journalGeneration;
+    free(folders);
+    munmap(file, fileSize);
+    close(fd);
+    return root;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/*METRICS REPORT*/
+// Menu option 16 and the stats command print the totals; the same numbers are written in the Prometheus text format
+// to notemaker.metrics (or the file named by NOTEMAKER_METRICS_FILE) for a collector to pick up. Structure sizes are
+// approximate: they count the arrays and slabs each structure owns, not allocator overhead.
+#define METRICS_FILE "notemaker.metrics"
+#define STRUCTURE_COUNT 12
+
+// Structure to represent the size of one workspace structure
+struct StructureUsage{
+    const char *name;
+    size_t count; // Nodes, names, entries or terms held
+    size_t bytes;
+};
+
+// Function to work out the bytes of every slab a pool has allocated
+size_t poolSlabBytes(struct NodePool *pool){
+    size_t nodesPerSlab = POOL_SLAB_BYTES / pool->nodeSize;
+    if (nodesPerSlab < 16){
+        nodesPerSlab = 16;
+    }
+    size_t headerSize = (sizeof(struct PoolSlab) + 15) & ~(size_t)15;
+    return pool->slabCount * (headerSize + nodesPerSlab * pool->nodeSize);
+}
+
+// Function to measure the workspace structures. Tasks are in the given queues, each read under its lock in queueLocks
+// (NULL when the caller is the only one using them). Every structure is read under its own lock from counters kept as
+// it grows, so measuring costs the same for any workspace and holds up no other structure.
+void measureStructures(struct StructureUsage usage[STRUCTURE_COUNT], struct TaskQueue **queues, pthread_mutex_t **queueLocks, int queueCount){
+    struct NodePool *pools[] = {&workspaceArena.filePool, &workspaceArena.folderPool, &workspaceArena.taskPool};
+    const char *poolNames[] = {"note_nodes", "folder_nodes", "task_nodes"};
+    for (int i = 0; i < 3; i++){
+        pthread_mutex_lock(&pools[i]->lock);
+        usage[i] = (struct StructureUsage){poolNames[i], pools[i]->liveNodes, poolSlabBytes(pools[i])};
+        pthread_mutex_unlock(&pools[i]->lock);
+    }
+
+    pthread_mutex_lock(&namePool.lock);
+    usage[3] = (struct StructureUsage){"name_pool", namePool.count, namePool.used + namePool.capacity * sizeof(struct NameRef)};
+    pthread_mutex_unlock(&namePool.lock);
+
+    usage[4] = (struct StructureUsage){"name_indexes", 0, (size_t)atomic_load(&nameIndexBytes)};
+    usage[5] = (struct StructureUsage){"position_arrays", 0, (size_t)atomic_load(&positionArrayBytes)};
+
+    usage[6] = (struct StructureUsage){"task_queue", 0, 0};
+    for (int i = 0; i < queueCount; i++){
+        if (queueLocks != NULL){
+            pthread_mutex_lock(queueLocks[i]);
+        }
+        usage[6].count += queues[i]->count;
+        usage[6].bytes += (queues[i]->capacity + queues[i]->indexCapacity) * sizeof(struct TaskNode *);
+        if (queueLocks != NULL){
+            pthread_mutex_unlock(queueLocks[i]);
+        }
+    }
+
+    pthread_mutex_lock(&searchIndex.lock);
+    struct TermTable *table = &searchIndex.table;
+    usage[7] = (struct StructureUsage){"search_index", table->termCount,
+                                       table->termCapacity * sizeof(struct SearchTerm) + table->slotCapacity * sizeof(uint32_t) +
+                                       table->chunkCount * (SEARCH_TEXT_CHUNK + sizeof(char *)) + table->postingBytes};
+    pthread_mutex_unlock(&searchIndex.lock);
+
+    pthread_mutex_lock(&pathCache.lock);
+    usage[8] = (struct StructureUsage){"path_cache", pathCache.used, 0};
+    if (pathCache.entries != NULL){
+        usage[8].bytes = PATH_CACHE_ENTRIES * sizeof(struct PathCacheEntry) + PATH_CACHE_BUCKETS * sizeof(struct PathCacheEntry *) +
+                         pathCache.textBytes;
+    }
+    pthread_mutex_unlock(&pathCache.lock);
+
+    pthread_mutex_lock(&timerWheel.lock);
+    usage[9] = (struct StructureUsage){"timer_wheel", timerWheel.scheduled,
+                                       sizeof(timerWheel.slots) + timerWheel.alertCapacity * sizeof(struct DueAlert)};
+    pthread_mutex_unlock(&timerWheel.lock);
+
+    pthread_mutex_lock(&noteStore.lock);
+    usage[10] = (struct StructureUsage){"note_store", noteStore.liveNotes,
+                                        noteStore.objectCapacity * sizeof(struct StoreObject) + noteStore.slotCapacity * sizeof(uint32_t) +
+                                        noteStore.noteSlots * sizeof(struct StoreNote)};
+    pthread_mutex_unlock(&noteStore.lock);
+    pthread_mutex_lock(&noteStore.cacheLock);
+    for (int i = 0; i < STORE_CACHE_CHUNKS; i++){
+        usage[10].bytes += noteStore.cache[i].length;
+    }
+    pthread_mutex_unlock(&noteStore.cacheLock);
+
+    pthread_mutex_lock(&nameFinder.lock);
+    usage[11] = (struct StructureUsage){"name_finder", nameFinder.listed,
+                                        nameFinder.nodeCapacity * sizeof(struct NameTrieNode) + nameFinder.nameCapacity * sizeof(struct NameFinderName) +
+                                        nameFinder.trigramCapacity * sizeof(struct NameTrigram) + nameFinder.listBytes};
+    pthread_mutex_unlock(&nameFinder.lock);
+}
+
+// Function to estimate a latency percentile from the histogram: the upper bound of the bucket it falls in
+uint64_t metricPercentile(struct MetricSlot *slot, double fraction){
+    unsigned long long count = atomic_load_explicit(&slot->count, memory_order_relaxed);
+    unsigned long long max = atomic_load_explicit(&slot->maxNanoseconds, memory_order_relaxed);
+    unsigned long long rank = (unsigned long long)(fraction * (double)count + 0.5);
+    unsigned long long seen = 0;
+    for (int b = 0; b < METRIC_BUCKETS - 1; b++){
+        seen += atomic_load_explicit(&slot->buckets[b], memory_order_relaxed);
+        if (seen >= rank && seen != 0){
+            uint64_t bound = (uint64_t)1 << b;
+            return bound < max ? bound : max;
+        }
+    }
+    return max;
+}
+
+// Function to write a duration in the largest unit that keeps it readable
+void formatNanoseconds(char *text, size_t size, uint64_t nanoseconds){
+    if (nanoseconds < 1000){
+        snprintf(text, size, "%llu ns", (unsigned long long)nanoseconds);
+    }
+    else if (nanoseconds < 1000000){
+        snprintf(text, size, "%.1f us", nanoseconds / 1e3);
+    }
+    else if (nanoseconds < 1000000000){
+        snprintf(text, size, "%.1f ms", nanoseconds / 1e6);
+    }
+    else{
+        snprintf(text, size, "%.2f s", nanoseconds / 1e9);
+    }
+}
+
+// Function to print the operation counts, latencies and structure sizes
+void printMetricsReport(FILE *output, struct TaskQueue **queues, pthread_mutex_t **queueLocks, int queueCount){
+    struct MetricsShard *totals = (struct MetricsShard *)malloc(sizeof(struct MetricsShard));
+    if (totals == NULL){
+        fprintf(stderr, "Memory allocation failed.\n");
+        exit(1);
+    }
+    collectMetrics(totals);
+    fprintf(output, " %-16s %10s %10s %10s %10s %10s\n", "Operation", "Count", "Average", "p50", "p99", "Max");
+    for (int m = 0; m < METRIC_COUNT; m++){
+        struct MetricSlot *slot = &totals->slots[m];
+        unsigned long long count = atomic_load_explicit(&slot->count, memory_order_relaxed);
+        if (count == 0){
+            continue;
+        }
+        char average[16], median[16], tail[16], max[16];
+        formatNanoseconds(average, sizeof(average), atomic_load_explicit(&slot->totalNanoseconds, memory_order_relaxed) / count);
+        formatNanoseconds(median, sizeof(median), metricPercentile(slot, 0.50));
+        formatNanoseconds(tail, sizeof(tail), metricPercentile(slot, 0.99));
+        formatNanoseconds(max, sizeof(max), atomic_load_explicit(&slot->maxNanoseconds, memory_order_relaxed));
+        fprintf(output, " %-16s %10llu %10s %10s %10s %10s\n", metricNames[m], count, average, median, tail, max);
+    }
+    free(totals);
+
+    struct StructureUsage usage[STRUCTURE_COUNT];
+    measureStructures(usage, queues, queueLocks, queueCount);
+    size_t totalBytes = 0;
+    fprintf(output, "\n %-16s %10s %12s\n", "Structure", "Count", "Bytes");
+    for (int i = 0; i < STRUCTURE_COUNT; i++){
+        fprintf(output, " %-16s %10zu %12zu\n", usage[i].name, usage[i].count, usage[i].bytes);
+        totalBytes += usage[i].bytes;
+    }
+    fprintf(output, " %-16s %10s %12zu\n", "total", "", totalBytes);
+    pthread_mutex_lock(&pathCache.lock);
+    fprintf(output, " Path cache: %zu hits, %zu misses.\n", pathCache.hits, pathCache.misses);
+    pthread_mutex_unlock(&pathCache.lock);
+    if (noteStoreActive()){
+        printNoteStoreReport(output);
+    }
+}
+
+// Function to write the metrics in the Prometheus text format, replacing the file in one rename; returns 0 on success
+int writeMetricsFile(struct TaskQueue **queues, pthread_mutex_t **queueLocks, int queueCount){
+    const char *path = getenv("NOTEMAKER_METRICS_FILE");
+    if (path == NULL || path[0] == '\0'){
+        path = METRICS_FILE;
+    }
+    size_t pathLength = strlen(path);
+    char *tempPath = (char *)malloc(pathLength + 5);
+    struct MetricsShard *totals = (struct MetricsShard *)malloc(sizeof(struct MetricsShard));
+    if (tempPath == NULL || totals == NULL){
+        fprintf(stderr, "Memory allocation failed.\n");
+        exit(1);
+    }
+    memcpy(tempPath, path, pathLength);
+    memcpy(tempPath + pathLength, ".tmp", 5);
+    FILE *file = fopen(tempPath, "w");
+    if (file == NULL){
+        free(tempPath);
+        free(totals);
+        return -1;
+    }
+
+    collectMetrics(totals);
+    fprintf(file, "# HELP notemaker_operation_seconds Time spent in each workspace operation.\n");
+    fprintf(file, "# TYPE notemaker_operation_seconds histogram\n");
+    for (int m = 0; m < METRIC_COUNT; m++){
+        struct MetricSlot *slot = &totals->slots[m];
+        unsigned long long cumulative = 0;
+        for (int b = 0; b < METRIC_BUCKETS - 1; b++){
+            cumulative += atomic_load_explicit(&slot->buckets[b], memory_order_relaxed);
+            fprintf(file, "notemaker_operation_seconds_bucket{operation=\"%s\",le=\"%.9g\"} %llu\n",
+                    metricNames[m], (double)((uint64_t)1 << b) / 1e9, cumulative);
+        }
+        unsigned long long count = atomic_load_explicit(&slot->count, memory_order_relaxed);
+        fprintf(file, "notemaker_operation_seconds_bucket{operation=\"%s\",le=\"+Inf\"} %llu\n", metricNames[m], count);
+        fprintf(file, "notemaker_operation_seconds_sum{operation=\"%s\"} %.9f\n", metricNames[m],
+                atomic_load_explicit(&slot->totalNanoseconds, memory_order_relaxed) / 1e9);
+        fprintf(file, "notemaker_operation_seconds_count{operation=\"%s\"} %llu\n", metricNames[m], count);
+    }
+    free(totals);
+
+    struct StructureUsage usage[STRUCTURE_COUNT];
+    measureStructures(usage, queues, queueLocks, queueCount);
+    fprintf(file, "# HELP notemaker_entries Nodes, names, entries or terms held by each structure.\n");
+    fprintf(file, "# TYPE notemaker_entries gauge\n");
+    for (int i = 0; i < STRUCTURE_COUNT; i++){
+        fprintf(file, "notemaker_entries{structure=\"%s\"} %zu\n", usage[i].name, usage[i].count);
+    }
+    fprintf(file, "# HELP notemaker_memory_bytes Approximate bytes owned by each structure.\n");
+    fprintf(file, "# TYPE notemaker_memory_bytes gauge\n");
+    for (int i = 0; i < STRUCTURE_COUNT; i++){
+        fprintf(file, "notemaker_memory_bytes{structure=\"%s\"} %zu\n", usage[i].name, usage[i].bytes);
+    }
+    pthread_mutex_lock(&pathCache.lock);
+    size_t hits = pathCache.hits;
+    size_t misses = pathCache.misses;
+    pthread_mutex_unlock(&pathCache.lock);
+    fprintf(file, "# HELP notemaker_path_cache_lookups_total Absolute path lookups by whether the whole path was cached.\n");
+    fprintf(file, "# TYPE notemaker_path_cache_lookups_total counter\n");
+    fprintf(file, "notemaker_path_cache_lookups_total{result=\"hit\"} %zu\n", hits);
+    fprintf(file, "notemaker_path_cache_lookups_total{result=\"miss\"} %zu\n", misses);
+
+    int result = ferror(file) ? -1 : 0;
+    if (fclose(file) != 0){
+        result = -1;
+    }
+    if (result == 0 && rename(tempPath, path) != 0){
+        result = -1;
+    }
+    if (result != 0){
+        unlink(tempPath);
+    }
+    free(tempPath);
+    return result;
+}
+
+// Function to print the report and refresh the metrics file, as menu option 16 and the stats command do
+void showMetrics(FILE *output, struct TaskQueue **queues, pthread_mutex_t **queueLocks, int queueCount){
+    printMetricsReport(output, queues, queueLocks, queueCount);
+    if (writeMetricsFile(queues, queueLocks, queueCount) != 0){
+        fprintf(output, " Could not write the metrics file: %s\n", strerror(errno));
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/*JOURNAL REPLAY AND COMPACTION*/
+// Structure to represent a snapshot image handed to the background compaction thread
+struct CompactionJob{
+    unsigned char *image;
+    size_t imageSize;
+};
+
+// Structure to represent what replayed deletes took out of the tree. An undo may still put a deleted folder back, so
+// nothing is freed until the whole journal has been read.
+struct ReplayTrash{
+    struct FolderNode *folders; // Chained through nextFolder and prevFolder
+    struct FileNode *notes;     // Chained through next
+};
+
+struct ReplayTrash replayTrash = {NULL, NULL};
+
+// Function to free what replayed deletes took out and nothing put back. Their files were kept while the deletes could
+// be undone, so each is removed now unless a note in the tree still has its name.
+void emptyReplayTrash(void){
+    while (replayTrash.notes != NULL){
+        struct FileNode *note = replayTrash.notes;
+        replayTrash.notes = note->next;
+        struct NameRef name = note->filename;
+        if (releaseFileNode(note)){
+            submitFileIo(FILE_IO_UNLINK, name);
+        }
+    }
+    while (replayTrash.folders != NULL){
+        struct FolderNode *folder = replayTrash.folders;
+        replayTrash.folders = folder->nextFolder;
+        destroyFolderSubtree(folder, 1);
+    }
+}
+
+// Function to apply one journal record to the workspace without journaling it again or touching the file system
+void applyJournalRecord(const struct JournalRecord *record, const char *name, struct TaskQueue *queue){
+    struct FolderNode *folder = findFolderById(record->folderId);
+    switch (record->type){
+    case JOURNAL_ADD_NOTE:
+        if (folder != NULL && findInNameIndex(&folder->fileList.index, name) == NULL){
+            appendFileNode(folder, createFileNode(internName(name)));
+        }
+        break;
+    case JOURNAL_DELETE_NOTE:
+        if (folder != NULL){
+            struct FileNode *file = (struct FileNode *)findInNameIndex(&folder->fileList.index, name);
+            if (file != NULL){
+                unlinkFileNode(&folder->fileList, file);
+                retireNoteId(file);
+                file->next = replayTrash.notes;
+                replayTrash.notes = file;
+            }
+        }
+        break;
+    case JOURNAL_ADD_FOLDER:
+        if (folder != NULL && findInNameIndex(&folder->childIndex, name) == NULL){
+            linkChildFolder(folder, record->taskSeq != 0 ? createFolderNodeWithId(internName(name), folder, (uint32_t)(record->taskSeq - 1))
+                                                        : createFolderNode(internName(name), folder));
+        }
+        break;
+    case JOURNAL_DELETE_FOLDER:
+        if (folder != NULL){
+            struct FolderNode *child = navigateToChildFolder(folder, name);
+            if (child != NULL){
+                detachFolderFromParent(child);
+                trashFolder(child);
+                child->nextFolder = replayTrash.folders;
+                if (replayTrash.folders != NULL){
+                    replayTrash.folders->prevFolder = child;
+                }
+                replayTrash.folders = child;
+            }
+        }
+        break;
+    case JOURNAL_RESTORE_FOLDER:{
+        struct FolderNode *restored = findFolderById((uint32_t)record->taskSeq);
+        if (folder != NULL && restored != NULL && restored->inTrash && restored->parentFolder == folder &&
+            findInNameIndex(&folder->childIndex, name) == NULL){
+            if (restored->prevFolder != NULL){
+                restored->prevFolder->nextFolder = restored->nextFolder;
+            }
+            else{
+                replayTrash.folders = restored->nextFolder;
+            }
+            if (restored->nextFolder != NULL){
+                restored->nextFolder->prevFolder = restored->prevFolder;
+            }
+            restored->nextFolder = restored->prevFolder = NULL;
+            restored->inTrash = 0;
+            linkChildFolder(folder, restored);
+        }
+        break;
+    }
+    case JOURNAL_CLONE_FOLDER:{
+        struct FolderNode *source = findFolderById((uint32_t)record->taskSeq);
+        if (folder != NULL && source != NULL && findInNameIndex(&folder->childIndex, name) == NULL){
+            linkChildFolder(folder, copyFolderSubtree(source, internName(name), folder));
+        }
+        break;
+    }
+    case JOURNAL_ADD_TASK:
+        if (record->taskSeq == 0 || findTaskBySeq(queue, record->taskSeq) == NULL){
+            struct TaskNode *task = createTaskNode(internName(name), record->priority, record->dueTime, record->repeatSeconds, record->taskSeq);
+            pushTaskNode(queue, task);
+            scheduleTaskTimer(task);
+        }
+        break;
+    case JOURNAL_EXECUTE_TASK:{
+        // Version 1 records name no task: they always executed the front of the queue
+        struct TaskNode *task = record->taskSeq != 0 ? findTaskBySeq(queue, record->taskSeq) : (queue->count != 0 ? queue->heap[0] : NULL);
+        if (task == NULL){
+            break;
+        }
+        cancelTaskTimer(task);
+        if (record->taskSeq != 0 && task->repeatSeconds != 0 && record->dueTime != TASK_NO_DEADLINE){
+            task->dueTime = record->dueTime;
+            siftTaskDown(queue, task->heapIndex);
+            siftTaskUp(queue, task->heapIndex);
+            scheduleTaskTimer(task);
+        }
+        else{
+            releaseToPool(&workspaceArena.taskPool, removeTaskAt(queue, task->heapIndex));
+        }
+        break;
+    }
+    case JOURNAL_DELETE_TASK:{
+        struct TaskNode *task = NULL;
+        if (record->taskSeq != 0){
+            task = findTaskBySeq(queue, record->taskSeq);
+        }
+        else{
+            // Version 1 records name the task by its priority, which was unique then
+            for (size_t i = 0; i < queue->count && task == NULL; i++){
+                if (queue->heap[i]->priority == record->priority){
+                    task = queue->heap[i];
+                }
+            }
+        }
+        if (task != NULL){
+            cancelTaskTimer(task);
+            releaseToPool(&workspaceArena.taskPool, removeTaskAt(queue, task->heapIndex));
+        }
+        break;
+    }
+    }
+}
+
+// Function to replay a journal file of the given generation or later; returns the records applied, or -1 if the file is
+// missing or older. validEnd receives the offset just past the last intact record, where appending may resume, and
+// version the file's format version.
+long replayJournal(const char *path, uint64_t minimumGeneration, struct TaskQueue *queue, uint64_t *generation, uint64_t *validEnd, uint32_t *version){
+    int fd = open(path, O_RDONLY);
+    if (fd < 0){
+        return -1;
+    }
+    struct stat info;
+    struct JournalHeader header;
+    if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(header)){
+        close(fd);
+        return -1;
+    }
+    size_t fileSize = (size_t)info.st_size;
+    unsigned char *file = (unsigned char *)mmap(NULL, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (file == MAP_FAILED){
+        return -1;
+    }
+    memcpy(&header, file, sizeof(header));
+    if (memcmp(header.magic, JOURNAL_MAGIC, sizeof(header.magic)) != 0 || header.version < 1 || header.version > JOURNAL_VERSION ||
+        header.generation < minimumGeneration){
+        munmap(file, fileSize);
+        return -1;
+    }
+
+    long applied = 0;
+    size_t offset = sizeof(header);
+    char *name = NULL;
+    size_t nameCapacity = 0;
+    // Stop at the first torn or corrupt record: everything after it was never acknowledged as durable
+    size_t fixedSize = header.version == JOURNAL_VERSION ? sizeof(struct JournalRecord) : sizeof(struct JournalRecordV1);
+    while (offset + fixedSize + sizeof(uint64_t) <= fileSize){
+        struct JournalRecord record;
+        memset(&record, 0, sizeof(record));
+        memcpy(&record, file + offset, fixedSize); // A version 1 record is a prefix of the current one
+        if (header.version != JOURNAL_VERSION){
+            record.dueTime = TASK_NO_DEADLINE;
+        }
+        size_t recordSize = fixedSize + (size_t)record.nameLength + sizeof(uint64_t);
+        if (record.nameLength > fileSize || offset + recordSize > fileSize){
+            break;
+        }
+        uint64_t checksum;
+        memcpy(&checksum, file + offset + fixedSize + record.nameLength, sizeof(checksum));
+        if (checksum != checksumBytes(file + offset, fixedSize + record.nameLength)){
+            break;
+        }
+        if (record.nameLength + 1 > nameCapacity){
+            nameCapacity = record.nameLength + 1;
+            char *newName = (char *)realloc(name, nameCapacity);
+            if (newName == NULL){
+                fprintf(stderr, "Memory allocation failed.\n");
+                exit(1);
+            }
+            name = newName;
+        }
+        memcpy(name, file + offset + fixedSize, record.nameLength);
+        name[record.nameLength] = '\0';
+        applyJournalRecord(&record, name, queue);
+        applied++;
+        offset += recordSize;
+    }
+    free(name);
+    munmap(file, fileSize);
+    *generation = header.generation;
+    *validEnd = offset;
+    *version = header.version;
+    return applied;
+}
+
+// Function to start a journal file of a new generation, replacing any file at that path
+int createJournalFile(struct Journal *journal, uint64_t generation){
+    int fd = open(JOURNAL_PATH, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0){
+        return -1;
+    }
+    struct JournalHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, JOURNAL_MAGIC, sizeof(header.magic));
+    header.version = JOURNAL_VERSION;
+    header.generation = generation;
+    if (writeAllBytes(fd, &header, sizeof(header)) != 0 || fsync(fd) != 0){
+        close(fd);
+        return -1;
+    }
+    journal->fd = fd;
+    journal->generation = generation;
+    journal->fileSize = sizeof(header);
+    return 0;
+}
+
+// Function to write a compaction snapshot and retire the folded journal, off the main thread
+void *runCompaction(void *argument){
+    struct CompactionJob *job = (struct CompactionJob *)argument;
+    // Only once the snapshot is durable may the journal generation it replaces go away
+    if (writeSnapshotImage(SNAPSHOT_PATH, job->image, job->imageSize) == 0){
+        unlink(JOURNAL_OLD_PATH);
+    }
+    free(job->image);
+    free(job);
+    atomic_store(&workspaceJournal.compactionState, 2);
+    return NULL;
+}
+
+// Function to wait for a background compaction, if one was started
+void waitForCompaction(struct Journal *journal){
+    if (atomic_load(&journal->compactionState) != 0){
+        pthread_join(journal->compactionThread, NULL);
+        atomic_store(&journal->compactionState, 0);
+    }
+}
+
+// Function to fold the journal into a fresh snapshot once it passes the size threshold (or at once if force is set).
+// The image is laid out here, the journal is rotated to a new generation, and the slow write, fsync and rename happen
+// on a background thread.
+void compactJournal(struct Journal *journal, struct FolderNode *root, struct TaskQueue *queue, int force){
+    pthread_mutex_lock(&journal->lock); // Server clients commit without the server lock, so rotation must exclude them
+    if (journal->fd < 0 || (!force && journal->fileSize < journal->compactBytes)){
+        pthread_mutex_unlock(&journal->lock);
+        return;
+    }
+    if (atomic_load(&journal->compactionState) == 1){
+        pthread_mutex_unlock(&journal->lock);
+        return; // The previous compaction is still writing; the journal simply keeps growing until it is done
+    }
+    waitForCompaction(journal);
+    commitJournalGroup(journal);
+    fdatasync(journal->fd);
+
+    struct CompactionJob *job = (struct CompactionJob *)malloc(sizeof(struct CompactionJob));
+    if (job == NULL){
+        fprintf(stderr, "Memory allocation failed.\n");
+        exit(1);
+    }
+    uint64_t nextGeneration = journal->generation + 1;
+    job->image = buildWorkspaceSnapshot(root, queue, nextGeneration, &job->imageSize);
+    close(journal->fd);
+    journal->fd = -1;
+    if (rename(JOURNAL_PATH, JOURNAL_OLD_PATH) != 0 || createJournalFile(journal, nextGeneration) != 0){
+        fprintf(stderr, "Could not rotate the journal: %s\n", strerror(errno));
+        exit(1);
+    }
+    atomic_store(&journal->compactionState, 1);
+    if (pthread_create(&journal->compactionThread, NULL, runCompaction, job) != 0){
+        runCompaction(job);
+    }
+    pthread_mutex_unlock(&journal->lock);
+}
+
+void maybeCompactJournal(struct Journal *journal, struct FolderNode *root, struct TaskQueue *queue){
+    compactJournal(journal, root, queue, 0);
+}
+
+// Function to fold the journal into a snapshot now and wait until it is durable, for changes too large to journal
+// record by record (such as a directory import). Nothing may append to the journal meanwhile, or those records could
+// refer to folders the previous snapshot does not have.
+void checkpointWorkspace(struct Journal *journal, struct FolderNode *root, struct TaskQueue *queue){
+    waitForCompaction(journal); // A compaction still writing would make compactJournal() skip this one
+    compactJournal(journal, root, queue, 1);
+    waitForCompaction(journal);
+}
+
+// Function to open the workspace: load the snapshot, replay the journal generations after it, and start journaling
+struct FolderNode *openWorkspace(struct TaskQueue *queue){
+    struct Journal *journal = &workspaceJournal;
+    journal->fsyncEveryRecords = (size_t)journalSetting("NOTEMAKER_FSYNC_RECORDS", JOURNAL_FSYNC_RECORDS);
+    journal->fsyncIntervalMs = journalSetting("NOTEMAKER_FSYNC_MS", JOURNAL_FSYNC_INTERVAL_MS);
+    journal->compactBytes = (uint64_t)journalSetting("NOTEMAKER_COMPACT_BYTES", JOURNAL_COMPACT_BYTES);
+    clock_gettime(CLOCK_MONOTONIC, &journal->lastSync);
+
+    uint64_t snapshotGeneration = 0;
+    struct FolderNode *root = loadWorkspaceSnapshot(SNAPSHOT_PATH, queue, &snapshotGeneration);
+    if (root == NULL){
+        root = createFolderNode(internName("Root"), NULL);
+    }
+
+    // A leftover older generation means a compaction was interrupted before its snapshot landed
+    uint64_t generation = 0;
+    uint64_t validEnd = 0;
+    uint32_t version = JOURNAL_VERSION;
+    long recovered = replayJournal(JOURNAL_OLD_PATH, snapshotGeneration, queue, &generation, &validEnd, &version);
+    int foldedOld = recovered >= 0;
+    if (foldedOld){
+        renumberFolders(root); // The newer generation was written against the preorder numbering of this state
+    }
+    else{
+        recovered = 0;
+        unlink(JOURNAL_OLD_PATH);
+    }
+    long replayed = replayJournal(JOURNAL_PATH, snapshotGeneration, queue, &generation, &validEnd, &version);
+    int olderFormat = replayed >= 0 && version != JOURNAL_VERSION;
+    if (replayed >= 0){
+        recovered += replayed;
+        journal->fd = open(JOURNAL_PATH, O_WRONLY);
+        if (journal->fd >= 0 && ftruncate(journal->fd, (off_t)validEnd) == 0 && lseek(journal->fd, 0, SEEK_END) >= 0){
+            journal->generation = generation;
+            journal->fileSize = validEnd;
+        }
+        else{
+            fprintf(stderr, "Could not reopen the journal: %s\n", strerror(errno));
+            exit(1);
+        }
+    }
+    else if (createJournalFile(journal, snapshotGeneration) != 0){
+        fprintf(stderr, "Could not create the journal: %s\n", strerror(errno));
+        exit(1);
+    }
+    if (recovered > 0){
+        printf(" Recovered %ld journal records.\n", recovered);
+    }
+    if (foldedOld || olderFormat){
+        journal->compactBytes = 0; // Fold the recovered generations right away; new records never go into an older format
+        maybeCompactJournal(journal, root, queue);
+        journal->compactBytes = (uint64_t)journalSetting("NOTEMAKER_COMPACT_BYTES", JOURNAL_COMPACT_BYTES);
+    }
+    openNoteStore(&noteStore, 0); // Only if the store command has made one
+    emptyReplayTrash();
+    rebuildFolderStats(root, 1);
+    return root;
+}
+
+// Function to close the workspace: write a final snapshot and drop the journal it makes redundant
+void closeWorkspace(struct FolderNode *root, struct TaskQueue *queue){
+    struct Journal *journal = &workspaceJournal;
+    waitForCompaction(journal);
+    journalCommit(journal);
+    if (journal->fd >= 0){
+        fdatasync(journal->fd);
+    }
+    if (saveWorkspaceSnapshot(SNAPSHOT_PATH, root, queue, journal->generation + 1) == 0){
+        unlink(JOURNAL_PATH);
+        unlink(JOURNAL_OLD_PATH);
+        printf("\n");
+        printf(" Workspace saved to %s.\n", SNAPSHOT_PATH);
+    }
+    if (journal->fd >= 0){
+        close(journal->fd);
+        journal->fd = -1;
+    }
+    free(journal->buffer);
+    journal->buffer = NULL;
+    journal->used = journal->capacity = 0;
+}
+
+// Function to save the workspace and release all of its memory: the side tables go first, then every node at once with the arena
+void tearDownWorkspace(struct FolderNode *root, struct TaskQueue *queue){
+    clearUndoLog(); // Before the file I/O workers stop, so the files of notes deleted for good still go
+    stopFileIo();
+    closeWorkspace(root, queue);
+    clearTimerWheel();
+    freePathCache();
+    free(queue->heap);
+    free(queue->seqIndex);
+    freeFolderTables(root);
+    printf("\n");
+    printPoolSavings(&workspaceArena);
+    releaseWorkspaceArena(&workspaceArena);
+    closeNoteStore(&noteStore);
+    releaseNamePool(&namePool);
+    freeTermTable(&searchIndex.table);
+    freeNameFinder(&nameFinder);
+    free(folderRegistry.byId);
+    free(noteRegistry.byId);
+    free(noteNameUses.slots);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/*DIRECTORY IMPORT*/
+// import <directory> adds a Topic Folder holding the shape of a directory tree: a folder for every directory and a note
+// for every regular file, named as on disk. Hidden entries, symbolic links and special files are skipped, and only the
+// names are imported. Workers read directories with openat() and getdents64(); each keeps its pending directories in
+// its own deque and steals from the others' when it runs dry. A worker builds its part of the new subtree from its own
+// node pools without taking any lock, and the finished subtree is linked into the workspace in one step at the end.
+#define IMPORT_MAX_THREADS 64
+#define IMPORT_DIRENT_BYTES 65536 // getdents64 buffer of each worker
+#define IMPORT_NAME_BATCH 256     // Names interned per acquisition of the name pool lock
+
+// Structure to represent one record returned by getdents64
+struct ImportDirent{
+    uint64_t inode;
+    int64_t offset;
+    unsigned short recordLength;
+    unsigned char type;
+    char name[];
+};
+
+// Structure to represent a directory waiting to be read
+struct ImportJob{
+    struct FolderNode *folder; // Folder created for it; its notes and child folders are still to be added
+    char *path;                // Relative to the imported directory ("." for itself); owned by the job
+};
+
+// Structure to represent a worker's deque: the owner pushes and pops at the bottom, thieves take from the top
+struct ImportDeque{
+    struct ImportJob *jobs;    // Ring buffer
+    size_t top;
+    size_t count;
+    size_t capacity;
+    pthread_mutex_t lock;
+};
+
+// Structure to represent an entry of the directory being read, kept until its name is interned
+struct ImportEntry{
+    const char *name;
+    size_t length;
+    uint32_t hash;
+    int isDirectory;
+};
+
+struct DirectoryImport;
+
+// Structure to represent one import worker and the nodes it has built
+struct ImportWorker{
+    struct ImportDeque deque;
+    struct NodePool filePool;
+    struct NodePool folderPool;
+    char *buffer;
+    struct ImportEntry entries[IMPORT_NAME_BATCH];
+    size_t entryCount;
+    size_t notes;
+    size_t folders;
+    size_t skipped;
+    size_t unreadable;
+    struct DirectoryImport *import;
+    size_t index;
+    pthread_t thread;
+};
+
+// Structure to represent one import run
+struct DirectoryImport{
+    int rootFd;
+    struct ImportWorker *workers;
+    size_t workerCount;
+    atomic_size_t pendingJobs; // Queued or being read; the run is over when it drops to 0
+};
+
+// Function to push a job at the bottom of a deque
+void pushImportJob(struct ImportDeque *deque, struct ImportJob job){
+    pthread_mutex_lock(&deque->lock);
+    if (deque->count == deque->capacity){
+        size_t newCapacity = deque->capacity == 0 ? 64 : deque->capacity * 2;
+        struct ImportJob *newJobs = (struct ImportJob *)malloc(newCapacity * sizeof(struct ImportJob));
+        if (newJobs == NULL){
+            fprintf(stderr, "Memory allocation failed.\n");
+            exit(1);
+        }
+        for (size_t i = 0; i < deque->count; i++){
+            newJobs[i] = deque->jobs[(deque->top + i) % deque->capacity];
+        }
+        free(deque->jobs);
+        deque->jobs = newJobs;
+        deque->top = 0;
+        deque->capacity = newCapacity;
+    }
+    deque->jobs[(deque->top + deque->count) % deque->capacity] = job;
+    deque->count++;
+    pthread_mutex_unlock(&deque->lock);
+}
+
+// Function to take a job from a deque: the newest one for its owner (depth first, close in the cache), the oldest one
+// for a thief (nearest the imported directory, so it likely carries a large subtree with it). Returns 0 if it is empty.
+int takeImportJob(struct ImportDeque *deque, int steal, struct ImportJob *job){
+    pthread_mutex_lock(&deque->lock);
+    if (deque->count == 0){
+        pthread_mutex_unlock(&deque->lock);
+        return 0;
+    }
+    if (steal){
+        *job = deque->jobs[deque->top];
+        deque->top = (deque->top + 1) % deque->capacity;
+    }
+    else{
+        *job = deque->jobs[(deque->top + deque->count - 1) % deque->capacity];
+    }
+    deque->count--;
+    pthread_mutex_unlock(&deque->lock);
+    return 1;
+}
+
+// Function to build the path of a child directory relative to the imported directory
+char *joinImportPath(const char *path, const char *name, size_t length){
+    size_t pathLength = strcmp(path, ".") == 0 ? 0 : strlen(path);
+    char *joined = (char *)malloc(pathLength + length + 2);
+    if (joined == NULL){
+        fprintf(stderr, "Memory allocation failed.\n");
+        exit(1);
+    }
+    if (pathLength != 0){
+        memcpy(joined, path, pathLength);
+        joined[pathLength++] = '/';
+    }
+    memcpy(joined + pathLength, name, length + 1);
+    return joined;
+}
+
+// Function to create the nodes for the collected entries of a directory: their names are interned under one lock,
+// then the nodes come from the worker's own pools, and each child directory is queued for reading
+void flushImportEntries(struct ImportWorker *worker, struct ImportJob *job){
+    struct NameRef names[IMPORT_NAME_BATCH];
+    pthread_mutex_lock(&namePool.lock);
+    for (size_t i = 0; i < worker->entryCount; i++){
+        struct ImportEntry *entry = &worker->entries[i];
+        names[i] = internNameLocked(&namePool, entry->name, entry->length, entry->hash);
+    }
+    pthread_mutex_unlock(&namePool.lock);
+
+    for (size_t i = 0; i < worker->entryCount; i++){
+        struct ImportEntry *entry = &worker->entries[i];
+        if (entry->isDirectory){
+            struct FolderNode *child = (struct FolderNode *)allocateFromPool(&worker->folderPool);
+            initFolderNode(child, names[i], job->folder);
+            linkChildFolder(job->folder, child);
+            struct ImportJob childJob = {child, joinImportPath(job->path, entry->name, entry->length)};
+            atomic_fetch_add(&worker->import->pendingJobs, 1);
+            pushImportJob(&worker->deque, childJob);
+            worker->folders++;
+        }
+        else{
+            struct FileNode *note = (struct FileNode *)allocateFromPool(&worker->filePool);
+            initFileNode(note, names[i]);
+            appendFileNode(job->folder, note);
+            worker->notes++;
+        }
+    }
+    worker->entryCount = 0;
+}
+
+// Function to read one directory and add its notes and child folders to the folder made for it
+void importDirectory(struct ImportWorker *worker, struct ImportJob *job){
+    int fd = openat(worker->import->rootFd, job->path, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd < 0){
+        worker->unreadable++;
+        return;
+    }
+    long bytes;
+    while ((bytes = syscall(SYS_getdents64, fd, worker->buffer, IMPORT_DIRENT_BYTES)) > 0){
+        for (long offset = 0; offset < bytes;){
+            struct ImportDirent *record = (struct ImportDirent *)(worker->buffer + offset);
+            offset += record->recordLength;
+            const char *name = record->name;
+            if (name[0] == '.'){
+                if (name[1] != '\0' && (name[1] != '.' || name[2] != '\0')){
+                    worker->skipped++; // Hidden entry
+                }
+                continue;
+            }
+            unsigned char type = record->type;
+            if (type == DT_UNKNOWN){
+                struct stat info;
+                if (fstatat(fd, name, &info, AT_SYMLINK_NOFOLLOW) == 0){
+                    type = S_ISDIR(info.st_mode) ? DT_DIR : S_ISREG(info.st_mode) ? DT_REG : DT_UNKNOWN;
+                }
+            }
+            if (type != DT_DIR && type != DT_REG){
+                worker->skipped++;
+                continue;
+            }
+            struct ImportEntry *entry = &worker->entries[worker->entryCount++];
+            entry->name = name;
+            entry->length = strlen(name);
+            entry->hash = hashName(name, entry->length);
+            entry->isDirectory = type == DT_DIR;
+            if (worker->entryCount == IMPORT_NAME_BATCH){
+                flushImportEntries(worker, job);
+            }
+        }
+        flushImportEntries(worker, job); // The names point into the buffer the next read overwrites
+    }
+    if (bytes < 0){
+        worker->unreadable++;
+    }
+    close(fd);
+}
+
+void *runImportWorker(void *argument){
+    struct ImportWorker *worker = (struct ImportWorker *)argument;
+    struct DirectoryImport *import = worker->import;
+    while (1){
+        struct ImportJob job;
+        int found = takeImportJob(&worker->deque, 0, &job);
+        for (size_t i = 1; !found && i < import->workerCount; i++){
+            found = takeImportJob(&import->workers[(worker->index + i) % import->workerCount].deque, 1, &job);
+        }
+        if (found){
+            importDirectory(worker, &job);
+            free(job.path);
+            atomic_fetch_sub(&import->pendingJobs, 1); // Its child directories were counted before this
+            continue;
+        }
+        if (atomic_load(&import->pendingJobs) == 0){
+            break;
+        }
+        struct timespec pause = {0, 20000}; // Every pending directory is being read; wait for one to turn up more
+        nanosleep(&pause, NULL);
+    }
+    return NULL;
+}
+
+// Function to give the imported folders and notes their ids
+void registerImportedSubtree(struct FolderNode *folder){
+    registerFolder(folder);
+    for (struct FileNode *note = folder->fileList.head; note != NULL; note = note->next){
+        registerNote(note);
+    }
+    for (struct FolderNode *child = folder->firstChild; child != NULL; child = child->nextFolder){
+        registerImportedSubtree(child);
+    }
+}
+
+// Function to import a directory tree as a new child of the target folder, named after the directory. Returns the new
+// folder, or NULL if the directory cannot be read or the target already has a folder of that name. The import is not
+// journaled: the caller takes a checkpoint afterwards, with every other writer still shut out.
+struct FolderNode *importDirectoryTree(struct FolderNode *target, const char *directory){
+    uint64_t started = metricsNow();
+    char *fullPath = realpath(directory, NULL);
+    int rootFd = fullPath != NULL ? open(fullPath, O_RDONLY | O_DIRECTORY | O_CLOEXEC) : -1;
+    if (rootFd < 0){
+        fprintf(sessionStream(), " Could not open the directory %s: %s\n", directory, strerror(errno));
+        free(fullPath);
+        return NULL;
+    }
+    const char *foldername = strrchr(fullPath, '/') + 1;
+    if (foldername[0] == '\0'){
+        foldername = "Root"; // The file system root
+    }
+    if (findInNameIndex(&target->childIndex, foldername) != NULL){
+        fprintf(sessionStream(), " Topic Folder %s already exists here.\n", foldername);
+        close(rootFd);
+        free(fullPath);
+        return NULL;
+    }
+
+    struct DirectoryImport import;
+    import.rootFd = rootFd;
+    long threads = journalSetting("NOTEMAKER_IMPORT_THREADS", sysconf(_SC_NPROCESSORS_ONLN));
+    import.workerCount = threads < 1 ? 1 : threads > IMPORT_MAX_THREADS ? IMPORT_MAX_THREADS : (size_t)threads;
+    import.workers = (struct ImportWorker *)calloc(import.workerCount, sizeof(struct ImportWorker));
+    if (import.workers == NULL){
+        fprintf(stderr, "Memory allocation failed.\n");
+        exit(1);
+    }
+    for (size_t i = 0; i < import.workerCount; i++){
+        struct ImportWorker *worker = &import.workers[i];
+        worker->import = &import;
+        worker->index = i;
+        worker->filePool.typeName = "FileNode";
+        worker->filePool.nodeSize = sizeof(struct FileNode);
+        worker->folderPool.typeName = "FolderNode";
+        worker->folderPool.nodeSize = sizeof(struct FolderNode);
+        pthread_mutex_init(&worker->filePool.lock, NULL);
+        pthread_mutex_init(&worker->folderPool.lock, NULL);
+        pthread_mutex_init(&worker->deque.lock, NULL);
+        worker->buffer = (char *)malloc(IMPORT_DIRENT_BYTES);
+        if (worker->buffer == NULL){
+            fprintf(stderr, "Memory allocation failed.\n");
+            exit(1);
+        }
+    }
+
+    // The new folder stays detached until every worker is done, so nothing else can see a half-built subtree
+    struct FolderNode *imported = (struct FolderNode *)allocateFromPool(&workspaceArena.folderPool);
+    initFolderNode(imported, internName(foldername), target);
+    struct ImportJob first = {imported, joinImportPath("", ".", 1)}; // "." is the imported directory itself
+    atomic_init(&import.pendingJobs, 1);
+    pushImportJob(&import.workers[0].deque, first);
+    size_t running = 0;
+    for (size_t i = 1; i < import.workerCount; i++){
+        if (pthread_create(&import.workers[i].thread, NULL, runImportWorker, &import.workers[i]) != 0){
+            break;
+        }
+        running++;
+    }
+    runImportWorker(&import.workers[0]);
+    for (size_t i = 1; i <= running; i++){
+        pthread_join(import.workers[i].thread, NULL);
+    }
+    close(rootFd);
+
+    size_t notes = 0, folders = 0, skipped = 0, unreadable = 0;
+    for (size_t i = 0; i < import.workerCount; i++){
+        struct ImportWorker *worker = &import.workers[i];
+        adoptPoolSlabs(&workspaceArena.filePool, &worker->filePool);
+        adoptPoolSlabs(&workspaceArena.folderPool, &worker->folderPool);
+        notes += worker->notes;
+        folders += worker->folders;
+        skipped += worker->skipped;
+        unreadable += worker->unreadable;
+        pthread_mutex_destroy(&worker->filePool.lock);
+        pthread_mutex_destroy(&worker->folderPool.lock);
+        pthread_mutex_destroy(&worker->deque.lock);
+        free(worker->deque.jobs);
+        free(worker->buffer);
+    }
+    free(import.workers);
+
+    registerImportedSubtree(imported);
+    rebuildFolderStats(imported, 0); // The note files are not in the working directory, so there is nothing to measure
+    touchFolderStats(&imported->stats, (int64_t)time(NULL));
+    linkChildFolder(target, imported);
+    propagateFolderAdded(imported);
+    updateNameFinderSubtree(imported, 1);
+    if (undoLog.enabled){
+        pushUndo(UNDO_ADD_FOLDER, target, imported, NULL, 0);
+    }
+    if (searchIndex.built){
+        resetSearchIndex(&searchIndex);
+    }
+    recordMetric(METRIC_IMPORT, started);
+
+    double seconds = (double)(metricsNow() - started) / 1e9;
+    fprintf(sessionStream(), " Imported %zu notes and %zu Topic Folders from %s in %.3f s (%.0f notes/s) with %zu threads.\n",
+            notes, folders + 1, fullPath, seconds, seconds > 0 ? notes / seconds : 0.0, running + 1);
+    if (skipped != 0 || unreadable != 0){
+        fprintf(sessionStream(), " Skipped %zu hidden or special entries; %zu directories could not be read.\n", skipped, unreadable);
+    }
+    free(fullPath);
+    return imported;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/*READING NAMES OF ANY LENGTH*/
+// Structure to represent a growable input buffer
+struct InputBuffer{
+    char *text;
+    size_t capacity;
+};
+
+// Function to append one character to an input buffer, growing it as needed
+void appendInputChar(struct InputBuffer *buffer, size_t length, char c){
+    if (length + 1 >= buffer->capacity){
+        size_t newCapacity = buffer->capacity == 0 ? 256 : buffer->capacity * 2;
+        char *newText = (char *)realloc(buffer->text, newCapacity);
+        if (newText == NULL){
+            fprintf(stderr, "Memory allocation failed.\n");
+            exit(1);
+        }
+        buffer->text = newText;
+        buffer->capacity = newCapacity;
+    }
+    buffer->text[length] = c;
+    buffer->text[length + 1] = '\0';
+}
+
+// Function to read the next whitespace-delimited word from stdin (or the rest of the line when wholeLine is set)
+int readInput(struct InputBuffer *buffer, int wholeLine){
+    appendInputChar(buffer, 0, '\0');
+    int c = getchar();
+    while (c == ' ' || c == '\t' || c == '\n' || c == '\r'){
+        c = getchar();
+    }
+    if (c == EOF){
+        return 0;
+    }
+    size_t length = 0;
+    while (c != EOF && c != '\n' && (wholeLine || (c != ' ' && c != '\t' && c != '\r'))){
+        appendInputChar(buffer, length++, (char)c);
+        c = getchar();
+    }
+    if (c != EOF){
+        ungetc(c, stdin);
+    }
+    // Keep a whole-line answer free of trailing whitespace and carriage returns
+    while (wholeLine && length > 0 && (buffer->text[length - 1] == ' ' || buffer->text[length - 1] == '\r')){
+        buffer->text[--length] = '\0';
+    }
+    return 1;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/*BATCH MODE*/
+// One command per line; blank lines and lines starting with # are skipped:
+//   add-note <path>   delete-note <path>   ls [path]
+//   mkdir <path>      rmdir <path>         cd <path>
+// A path is a plain name in the current folder, a relative path such as ../drafts/plan or an absolute one such as
+// /projects/q3/design/notes1.
+//   add-task <priority> [due:<minutes>] [every:<minutes>] <description>
+//   pop-task   delete-task <index>   tasks   next [count]
+//   search <words>   find <name>   stats   summary [path]
+//   import <directory>   (adds the directory tree as a Topic Folder of the current folder)
+//   store   clone <path> <path>   undo   redo
+#define BATCH_READ_BYTES (1 << 20)    // Input is read in blocks of this size
+#define BATCH_COMMIT_COMMANDS 1024    // Journal commit group size in batch mode
+#define BATCH_NEXT_DUE_COUNT 10       // Tasks shown by next without a count
+
+// Kinds of batch commands
+enum BatchCommand{
+    BATCH_ADD_NOTE,
+    BATCH_DELETE_NOTE,
+    BATCH_LIST_NOTES,
+    BATCH_MKDIR,
+    BATCH_RMDIR,
+    BATCH_CD,
+    BATCH_ADD_TASK,
+    BATCH_POP_TASK,
+    BATCH_DELETE_TASK,
+    BATCH_LIST_TASKS,
+    BATCH_NEXT_DUE,
+    BATCH_SEARCH,
+    BATCH_STATS,
+    BATCH_SUMMARY,
+    BATCH_IMPORT,
+    BATCH_STORE,
+    BATCH_CLONE,
+    BATCH_UNDO,
+    BATCH_REDO,
+    BATCH_FIND,
+    BATCH_COMMAND_COUNT
+};
+
+const char *batchCommandNames[BATCH_COMMAND_COUNT] = {
+    "add-note", "delete-note", "ls", "mkdir", "rmdir", "cd", "add-task", "pop-task", "delete-task", "tasks", "next", "search", "stats", "summary", "import", "store", "clone",
+    "undo", "redo", "find"
+};
+
+// Structure to represent the latency totals of one batch command
+struct BatchCommandStats{
+    size_t count;
+    uint64_t totalNanoseconds;
+    uint64_t maxNanoseconds;
+};
+
+// Structure to represent a block-buffered line reader over a file, pipe or socket
+struct LineReader{
+    int fd;
+    char *buffer;
+    size_t capacity;
+    size_t start;  // First unread byte
+    size_t end;    // One past the last byte read
+    int finished;
+};
+
+// Structure to represent the state of a batch run
+struct BatchSession{
+    struct FolderNode *rootFolder;
+    struct FolderNode *currentFolder;
+    struct TaskQueue *queue;
+    size_t lineNumber;
+    size_t failedCommands;
+    struct BatchCommandStats stats[BATCH_COMMAND_COUNT];
+};
+
+// Function to get the next line (without its newline) from a line reader, or NULL at the end of the input
+char *readBatchLine(struct LineReader *reader){
+    while (1){
+        char *newline = (char *)memchr(reader->buffer + reader->start, '\n', reader->end - reader->start);
+        if (newline != NULL || (reader->finished && reader->start < reader->end)){
+            char *line = reader->buffer + reader->start;
+            if (newline == NULL){
+                newline = reader->buffer + reader->end; // Last line without a newline; the spare byte holds the '\0'
+            }
+            *newline = '\0';
+            reader->start = (size_t)(newline - reader->buffer) + 1;
+            if (reader->start > reader->end){
+                reader->start = reader->end;
+            }
+            if (newline > line && newline[-1] == '\r'){
+                newline[-1] = '\0';
+            }
+            return line;
+        }
+        if (reader->finished){
+            return NULL;
+        }
+        // Slide the partial line to the front and read another block behind it
+        memmove(reader->buffer, reader->buffer + reader->start, reader->end - reader->start);
+        reader->end -= reader->start;
+        reader->start = 0;
+        if (reader->capacity - reader->end < BATCH_READ_BYTES + 1){
+            size_t newCapacity = reader->end + BATCH_READ_BYTES + 1;
+            char *newBuffer = (char *)realloc(reader->buffer, newCapacity);
+            if (newBuffer == NULL){
+                fprintf(stderr, "Memory allocation failed.\n");
+                exit(1);
+            }
+            reader->buffer = newBuffer;
+            reader->capacity = newCapacity;
+        }
+        ssize_t got = read(reader->fd, reader->buffer + reader->end, BATCH_READ_BYTES);
+        if (got < 0 && errno == EINTR){
+            continue;
+        }
+        if (got <= 0){
+            reader->finished = 1;
+        }
+        else{
+            reader->end += (size_t)got;
+        }
+    }
+}
+
+// Function to skip leading blanks
+char *skipBlanks(char *text){
+    while (*text == ' ' || *text == '\t'){
+        text++;
+    }
+    return text;
+}
+
+// Function to report a batch command that could not be carried out
+void reportBatchFailure(struct BatchSession *session, const char *message, const char *argument){
+    fprintf(sessionStream(), " line %zu: %s%s%s\n", session->lineNumber, message, argument[0] != '\0' ? ": " : "", argument);
+    session->failedCommands++;
+}
+
+// Function to split a line into a command and its argument; returns -1 for lines to skip and for reported errors
+int parseBatchCommand(struct BatchSession *session, char *line, char **argumentOut){
+    line = skipBlanks(line);
+    if (line[0] == '\0' || line[0] == '#'){
+        return -1;
+    }
+    char *argument = line;
+    while (*argument != '\0' && *argument != ' ' && *argument != '\t'){
+        argument++;
+    }
+    if (*argument != '\0'){
+        *argument++ = '\0';
+    }
+    argument = skipBlanks(argument);
+    size_t argumentLength = strlen(argument);
+    while (argumentLength > 0 && (argument[argumentLength - 1] == ' ' || argument[argumentLength - 1] == '\t')){
+        argument[--argumentLength] = '\0';
+    }
+
+    int command = 0;
+    while (command < BATCH_COMMAND_COUNT && strcmp(batchCommandNames[command], line) != 0){
+        command++;
+    }
+    if (command == BATCH_COMMAND_COUNT){
+        reportBatchFailure(session, "unknown command", line);
+        return -1;
+    }
+    int needsArgument = command != BATCH_LIST_NOTES && command != BATCH_POP_TASK && command != BATCH_LIST_TASKS &&
+                        command != BATCH_NEXT_DUE && command != BATCH_STATS && command != BATCH_SUMMARY &&
+                        command != BATCH_STORE && command != BATCH_UNDO && command != BATCH_REDO;
+    if (needsArgument && argument[0] == '\0'){
+        reportBatchFailure(session, "missing argument for", line);
+        return -1;
+    }
+    *argumentOut = argument;
+    return command;
+}
+
+// Function to read the options of add-task after the priority: due:<minutes from now> and every:<minutes>. Returns the
+// description that follows them, or NULL (with the bad option in badOption) if an option has no valid number.
+char *parseTaskOptions(char *text, int64_t *dueTime, uint32_t *repeatSeconds, char **badOption){
+    *dueTime = TASK_NO_DEADLINE;
+    *repeatSeconds = 0;
+    text = skipBlanks(text);
+    while (strncmp(text, "due:", 4) == 0 || strncmp(text, "every:", 6) == 0){
+        int isDue = text[0] == 'd';
+        char *number = text + (isDue ? 4 : 6);
+        char *end;
+        long minutes = strtol(number, &end, 10);
+        if (end == number || (*end != ' ' && *end != '\t' && *end != '\0') || minutes < 0 || minutes > UINT32_MAX / 60 ||
+            (!isDue && minutes == 0)){
+            *badOption = text;
+            return NULL;
+        }
+        if (isDue){
+            *dueTime = (int64_t)time(NULL) + minutes * 60;
+        }
+        else{
+            *repeatSeconds = (uint32_t)minutes * 60;
+        }
+        text = skipBlanks(end);
+    }
+    return text;
+}
+
+// Function to read the count of the next command, defaulting when there is none and capped at NEXT_DUE_MAX_COUNT;
+// returns 0 if the argument is not a positive number
+size_t parseNextDueCount(const char *argument){
+    if (argument[0] == '\0'){
+        return BATCH_NEXT_DUE_COUNT;
+    }
+    char *end;
+    errno = 0;
+    long long count = strtoll(argument, &end, 10);
+    if (end == argument || *end != '\0' || count <= 0){
+        return 0;
+    }
+    return errno == ERANGE || count > NEXT_DUE_MAX_COUNT ? NEXT_DUE_MAX_COUNT : (size_t)count;
+}
+
+// Function to find the folder a note or folder command works in: the folder named by the argument for ls and cd,
+// the folder holding the argument's last component for the others (leaf receives that component). Reports and returns
+// NULL when the folder does not exist.
+struct FolderNode *resolveCommandFolder(struct BatchSession *session, enum BatchCommand command, char *argument, const char **leaf){
+    struct FolderNode *folder;
+    *leaf = argument;
+    if (command == BATCH_LIST_NOTES || command == BATCH_CD || command == BATCH_SUMMARY){
+        folder = argument[0] == '\0' ? session->currentFolder : resolveFolderPath(session->currentFolder, argument);
+    }
+    else{
+        folder = resolveParentPath(session->currentFolder, argument, leaf);
+    }
+    if (folder == NULL){
+        reportBatchFailure(session, "no such folder", argument);
+    }
+    else if ((command == BATCH_ADD_NOTE || command == BATCH_MKDIR) && !isValidName(*leaf)){
+        reportBatchFailure(session, "not a valid name", argument);
+        folder = NULL;
+    }
+    return folder;
+}
+
+// Function to carry out a note or folder command in the folder resolveCommandFolder() picked
+void runFolderCommand(struct BatchSession *session, enum BatchCommand command, struct FolderNode *folder, const char *leaf){
+    switch (command){
+    case BATCH_ADD_NOTE:
+        addFileToList(folder, leaf);
+        break;
+    case BATCH_DELETE_NOTE:
+        if (findInNameIndex(&folder->fileList.index, leaf) == NULL){
+            reportBatchFailure(session, "no such note", leaf);
+        }
+        else{
+            deleteFile(folder, leaf);
+        }
+        break;
+    case BATCH_LIST_NOTES:
+        printFileList(&folder->fileList);
+        break;
+    case BATCH_SUMMARY:
+        printFolderSummary(sessionStream(), folder);
+        break;
+    case BATCH_MKDIR:
+        addFolderToTree(folder, leaf);
+        break;
+    case BATCH_RMDIR:{
+        struct FolderNode *target = navigateToChildFolder(folder, leaf);
+        if (target == NULL){
+            reportBatchFailure(session, "no such folder", leaf);
+            break;
+        }
+        if (folderIsWithin(session->currentFolder, target)){
+            session->currentFolder = folder; // The current folder is going away with it
+        }
+        deleteFolder(folder, leaf);
+        break;
+    }
+    case BATCH_CD:
+        session->currentFolder = folder;
+        break;
+    default:
+        break;
+    }
+}
+
+// Function to clone the folder named by the first path of the argument as the folder named by the second
+void runCloneCommand(struct BatchSession *session, char *argument){
+    char *destination = argument;
+    while (*destination != '\0' && *destination != ' ' && *destination != '\t'){
+        destination++;
+    }
+    if (*destination != '\0'){
+        *destination++ = '\0';
+    }
+    destination = skipBlanks(destination);
+    if (destination[0] == '\0'){
+        reportBatchFailure(session, "expected the path of the clone after", argument);
+        return;
+    }
+    struct FolderNode *source = resolveFolderPath(session->currentFolder, argument);
+    if (source == NULL){
+        reportBatchFailure(session, "no such folder", argument);
+        return;
+    }
+    const char *leaf;
+    struct FolderNode *parentFolder = resolveParentPath(session->currentFolder, destination, &leaf);
+    if (parentFolder == NULL){
+        reportBatchFailure(session, "no such folder", destination);
+    }
+    else if (!isValidName(leaf)){
+        reportBatchFailure(session, "not a valid name", destination);
+    }
+    else if (cloneFolder(source, parentFolder, leaf) == NULL){
+        session->failedCommands++;
+    }
+}
+
+// Function to carry out one batch command against the session's current folder
+void runBatchCommand(struct BatchSession *session, enum BatchCommand command, char *argument){
+    switch (command){
+    case BATCH_ADD_NOTE:
+    case BATCH_DELETE_NOTE:
+    case BATCH_LIST_NOTES:
+    case BATCH_SUMMARY:
+    case BATCH_MKDIR:
+    case BATCH_RMDIR:
+    case BATCH_CD:{
+        const char *leaf;
+        struct FolderNode *folder = resolveCommandFolder(session, command, argument, &leaf);
+        if (folder != NULL){
+            runFolderCommand(session, command, folder, leaf);
+        }
+        break;
+    }
+    case BATCH_ADD_TASK:{
+        char *description;
+        long priority = strtol(argument, &description, 10);
+        int64_t dueTime;
+        uint32_t repeatSeconds;
+        char *badOption;
+        if (description == argument){
+            reportBatchFailure(session, "expected a priority", argument);
+        }
+        else if ((description = parseTaskOptions(description, &dueTime, &repeatSeconds, &badOption)) == NULL){
+            reportBatchFailure(session, "bad task option", badOption);
+        }
+        else{
+            addTaskToQueue(session->queue, description, (int)priority, dueTime, repeatSeconds);
+        }
+        break;
+    }
+    case BATCH_POP_TASK:
+        executeHighestPriorityTask(session->queue);
+        break;
+    case BATCH_DELETE_TASK:
+        deleteTask(session->queue, atoi(argument));
+        break;
+    case BATCH_LIST_TASKS:
+        printTaskQueue(session->queue);
+        break;
+    case BATCH_NEXT_DUE:{
+        size_t count = parseNextDueCount(argument);
+        if (count == 0){
+            reportBatchFailure(session, "expected a count", argument);
+        }
+        else{
+            printNextDueTasks(sessionStream(), &session->queue, 1, count);
+        }
+        break;
+    }
+    case BATCH_SEARCH:
+        printSearchResults(&searchIndex, argument);
+        break;
+    case BATCH_FIND:
+        printNameMatches(sessionStream(), session->rootFolder, argument);
+        break;
+    case BATCH_STATS:
+        showMetrics(sessionStream(), &session->queue, NULL, 1);
+        break;
+    case BATCH_IMPORT:
+        if (importDirectoryTree(session->currentFolder, argument) == NULL){
+            reportBatchFailure(session, "could not import", argument);
+        }
+        else{
+            checkpointWorkspace(&workspaceJournal, session->rootFolder, session->queue);
+        }
+        break;
+    case BATCH_STORE:
+        moveNotesIntoStore(sessionStream(), session->rootFolder);
+        break;
+    case BATCH_CLONE:
+        runCloneCommand(session, argument);
+        break;
+    case BATCH_UNDO:
+    case BATCH_REDO:
+        if (!undoOrRedo(sessionStream(), command == BATCH_REDO, &session->currentFolder)){
+            session->failedCommands++;
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+// Function to run commands from a file (or stdin) without the menu, then report per-command latency and throughput
+void runBatch(FILE *input, struct FolderNode *rootFolder, struct TaskQueue *queue){
+    static char outputBuffer[1 << 20];
+    setvbuf(stdout, outputBuffer, _IOFBF, sizeof(outputBuffer));
+
+    struct BatchSession session;
+    memset(&session, 0, sizeof(session));
+    session.rootFolder = rootFolder;
+    session.currentFolder = rootFolder;
+    session.queue = queue;
+    struct LineReader reader = {fileno(input), (char *)malloc(BATCH_READ_BYTES + 1), BATCH_READ_BYTES + 1, 0, 0, 0};
+    if (reader.buffer == NULL){
+        fprintf(stderr, "Memory allocation failed.\n");
+        exit(1);
+    }
+    size_t commands = 0;
+    struct timespec batchStart;
+    clock_gettime(CLOCK_MONOTONIC, &batchStart);
+
+    char *line;
+    while ((line = readBatchLine(&reader)) != NULL){
+        session.lineNumber++;
+        char *argument;
+        int command = parseBatchCommand(&session, line, &argument);
+        if (command < 0){
+            continue;
+        }
+
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        runBatchCommand(&session, (enum BatchCommand)command, argument);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        uint64_t elapsed = (uint64_t)(end.tv_sec - start.tv_sec) * 1000000000u + (uint64_t)(end.tv_nsec - start.tv_nsec);
+        struct BatchCommandStats *stats = &session.stats[command];
+        stats->count++;
+        stats->totalNanoseconds += elapsed;
+        if (elapsed > stats->maxNanoseconds){
+            stats->maxNanoseconds = elapsed;
+        }
+
+        if (++commands % BATCH_COMMIT_COMMANDS == 0){
+            reportFileIoFailures();
+            journalCommit(&workspaceJournal);
+            maybeCompactJournal(&workspaceJournal, rootFolder, queue);
+        }
+    }
+    journalCommit(&workspaceJournal);
+    free(reader.buffer);
+
+    struct timespec batchEnd;
+    clock_gettime(CLOCK_MONOTONIC, &batchEnd);
+    double seconds = (double)(batchEnd.tv_sec - batchStart.tv_sec) + (double)(batchEnd.tv_nsec - batchStart.tv_nsec) / 1e9;
+    printf("\n");
+    printf(" %-12s %10s %12s %12s\n", "command", "count", "avg (us)", "max (us)");
+    for (int command = 0; command < BATCH_COMMAND_COUNT; command++){
+        struct BatchCommandStats *stats = &session.stats[command];
+        if (stats->count != 0){
+            printf(" %-12s %10zu %12.2f %12.2f\n", batchCommandNames[command], stats->count,
+                   (double)stats->totalNanoseconds / (double)stats->count / 1000.0, (double)stats->maxNanoseconds / 1000.0);
+        }
+    }
+    printf(" %zu commands (%zu failed) in %.3f s: %.0f commands/s\n", commands, session.failedCommands, seconds,
+           seconds > 0 ? (double)commands / seconds : 0.0);
+    fflush(stdout);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/*WORKSPACE SERVER*/
+// ./a.out --serve [socket] lets several local clients work on one workspace at once. Each client has its own
+// current folder, sends batch mode commands one per line, and gets every reply terminated by a line holding ".".
+// Folder commands hold the server lock shared and then the folder's own lock (shared to read, exclusive to change
+// it); rmdir, search and compaction hold the server lock exclusively. Tasks live in shards picked by sequence number,
+// each behind its own mutex, so task commands never take the server lock.
+#define SERVER_SOCKET_PATH "notemaker.sock"
+#define SERVER_METRICS_SECONDS 10 // Interval between refreshes of the metrics file
+#define TASK_SHARD_BITS 4
+#define TASK_SHARDS (1 << TASK_SHARD_BITS)
+
+// Structure to represent one shard of the server's task queue
+struct TaskShard{
+    pthread_mutex_t lock;
+    struct TaskQueue queue;
+    // Queue key of the task at the top of the shard's heap, read without the lock; topSeq is 0 while the shard is empty
+    atomic_llong topDue;
+    atomic_int topPriority;
+    atomic_ullong topSeq;
+};
+
+// Structure to represent a connected client
+struct ServerClient{
+    int fd;
+    FILE *output;
+    struct BatchSession session; // Its currentFolder is moved by other clients only under the exclusive server lock
+    int cursorMoved;             // Set when another client's rmdir removed the folder this client was in
+    struct ServerClient *next;
+};
+
+// Structure to represent the server and the workspace it shares
+struct WorkspaceServer{
+    pthread_rwlock_t lock;
+    struct FolderNode *rootFolder;
+    struct TaskShard shards[TASK_SHARDS];
+    struct ServerClient *clients; // Linked and unlinked only under the exclusive server lock
+    pthread_mutex_t clientCountLock;
+    pthread_cond_t clientsGone;
+    size_t clientCount;
+    int listenFd;
+};
+
+struct WorkspaceServer workspaceServer;
+
+// Function to pick a task's shard from its sequence number, so new tasks spread evenly whatever their priorities
+size_t taskShardOf(uint64_t seq){
+    return (size_t)(seq & (TASK_SHARDS - 1));
+}
+
+// Function to publish the key of a shard's top task after a change; the caller holds the shard's lock
+void publishShardTop(struct TaskShard *shard){
+    struct TaskNode *top = shard->queue.count != 0 ? shard->queue.heap[0] : NULL;
+    atomic_store(&shard->topDue, top != NULL ? top->dueTime : TASK_NO_DEADLINE);
+    atomic_store(&shard->topPriority, top != NULL ? top->priority : 0);
+    atomic_store(&shard->topSeq, top != NULL ? top->seq : 0);
+}
+
+void lockAllShards(struct WorkspaceServer *server){
+    for (int i = 0; i < TASK_SHARDS; i++){
+        pthread_mutex_lock(&server->shards[i].lock);
+    }
+}
+
+void unlockAllShards(struct WorkspaceServer *server){
+    for (int i = TASK_SHARDS - 1; i >= 0; i--){
+        pthread_mutex_unlock(&server->shards[i].lock);
+    }
+}
+
+// Function to gather every shard's tasks into one heap-ordered-per-shard array; the caller holds all shard locks
+struct TaskQueue gatherShardTasks(struct WorkspaceServer *server){
+    struct TaskQueue all = {0};
+    for (int i = 0; i < TASK_SHARDS; i++){
+        all.count += server->shards[i].queue.count;
+    }
+    all.heap = (struct TaskNode **)malloc((all.count + 1) * sizeof(struct TaskNode *));
+    if (all.heap == NULL){
+        fprintf(stderr, "Memory allocation failed.\n");
+        exit(1);
+    }
+    size_t used = 0;
+    for (int i = 0; i < TASK_SHARDS; i++){
+        struct TaskQueue *queue = &server->shards[i].queue;
+        if (queue->count != 0){
+            memcpy(all.heap + used, queue->heap, queue->count * sizeof(struct TaskNode *));
+            used += queue->count;
+        }
+    }
+    all.capacity = all.count;
+    return all;
+}
+
+void serverAddTask(struct WorkspaceServer *server, const char *taskname, int priority, int64_t dueTime, uint32_t repeatSeconds){
+    uint64_t started = metricsNow();
+    // The sequence number picks the shard, so it is drawn before the shard is locked
+    uint64_t seq = atomic_fetch_add(&nextTaskSeq, 1);
+    struct TaskShard *shard = &server->shards[taskShardOf(seq)];
+    pthread_mutex_lock(&shard->lock);
+    if (dueTime == TASK_NO_DEADLINE){
+        repeatSeconds = 0;
+    }
+    struct TaskNode *task = createTaskNode(internName(taskname), priority, dueTime, repeatSeconds, seq);
+    pushTaskNode(&shard->queue, task);
+    scheduleTaskTimer(task);
+    journalAppendTask(&workspaceJournal, JOURNAL_ADD_TASK, task, dueTime);
+    publishShardTop(shard);
+    pthread_mutex_unlock(&shard->lock);
+    recordMetric(METRIC_ADD_TASK, started);
+}
+
+// Function to execute the task that comes first among the published shard tops; retries when another client got there first
+void serverExecuteTask(struct WorkspaceServer *server, FILE *output){
+    uint64_t started = metricsNow();
+    while (1){
+        int best = -1;
+        struct TaskNode bestTop = {0};
+        for (int i = 0; i < TASK_SHARDS; i++){
+            struct TaskNode top = {0};
+            top.seq = atomic_load(&server->shards[i].topSeq);
+            top.dueTime = atomic_load(&server->shards[i].topDue);
+            top.priority = atomic_load(&server->shards[i].topPriority);
+            if (top.seq != 0 && (best < 0 || taskComesFirst(&top, &bestTop))){
+                bestTop = top;
+                best = i;
+            }
+        }
+        if (best < 0){
+            fprintf(output, "No tasks in the priority queue.\n");
+            recordMetric(METRIC_EXECUTE_TASK, started);
+            return;
+        }
+        struct TaskShard *shard = &server->shards[best];
+        pthread_mutex_lock(&shard->lock);
+        struct TaskNode *task = shard->queue.count != 0 ? shard->queue.heap[0] : NULL;
+        if (task != NULL && task->seq == bestTop.seq && task->dueTime == bestTop.dueTime && task->priority == bestTop.priority){
+            fprintf(output, "Executing task with priority %d: %s\n", task->priority, nameText(task->taskname));
+            rescheduleOrReleaseTask(&shard->queue, task);
+            publishShardTop(shard);
+            pthread_mutex_unlock(&shard->lock);
+            recordMetric(METRIC_EXECUTE_TASK, started);
+            return;
+        }
+        pthread_mutex_unlock(&shard->lock);
+    }
+}
+
+// Function to list the next due tasks across all shards
+void serverPrintNextDueTasks(struct WorkspaceServer *server, FILE *output, size_t limit){
+    struct TaskQueue *queues[TASK_SHARDS];
+    lockAllShards(server);
+    for (int i = 0; i < TASK_SHARDS; i++){
+        queues[i] = &server->shards[i].queue;
+    }
+    printNextDueTasks(output, queues, TASK_SHARDS, limit);
+    unlockAllShards(server);
+}
+
+// Function to list the tasks in queue order, or delete the taskIndex-th of them when taskIndex is not 0
+void serverListOrDeleteTask(struct WorkspaceServer *server, FILE *output, int taskIndex){
+    uint64_t started = metricsNow();
+    lockAllShards(server);
+    struct TaskQueue all = gatherShardTasks(server);
+    if (all.count > 1){
+        qsort(all.heap, all.count, sizeof(struct TaskNode *), compareTasksInQueueOrder);
+    }
+    if (taskIndex == 0){
+        int64_t now = (int64_t)time(NULL);
+        for (size_t i = 0; i < all.count; i++){
+            printTaskLine(output, i + 1, all.heap[i], now);
+        }
+    }
+    else if (taskIndex >= 1 && (size_t)taskIndex <= all.count){
+        struct TaskNode *task = all.heap[taskIndex - 1];
+        struct TaskShard *shard = &server->shards[taskShardOf(task->seq)];
+        journalAppendTask(&workspaceJournal, JOURNAL_DELETE_TASK, task, task->dueTime);
+        cancelTaskTimer(task);
+        releaseToPool(&workspaceArena.taskPool, removeTaskAt(&shard->queue, task->heapIndex));
+        publishShardTop(shard);
+        fprintf(output, " Task deleted.\n");
+    }
+    else{
+        fprintf(output, " Invalid task index.\n");
+    }
+    unlockAllShards(server);
+    free(all.heap);
+    recordMetric(taskIndex == 0 ? METRIC_LIST_TASKS : METRIC_DELETE_TASK, started);
+}
+
+// Function to print the metrics report to a client, or with output NULL only refresh the metrics file. Each structure
+// is read under its own lock, one at a time, so clients keep working meanwhile.
+void serverShowMetrics(struct WorkspaceServer *server, FILE *output){
+    struct TaskQueue *queues[TASK_SHARDS];
+    pthread_mutex_t *queueLocks[TASK_SHARDS];
+    for (int i = 0; i < TASK_SHARDS; i++){
+        queues[i] = &server->shards[i].queue;
+        queueLocks[i] = &server->shards[i].lock;
+    }
+    if (output != NULL){
+        showMetrics(output, queues, queueLocks, TASK_SHARDS);
+    }
+    else{
+        writeMetricsFile(queues, queueLocks, TASK_SHARDS);
+    }
+}
+
+// Function to import a directory tree into a client's current folder and checkpoint it, with every other client shut
+// out until the snapshot holding it is durable
+void serverImportDirectory(struct WorkspaceServer *server, struct ServerClient *client, char *directory){
+    pthread_rwlock_wrlock(&server->lock);
+    lockAllShards(server);
+    if (importDirectoryTree(client->session.currentFolder, directory) == NULL){
+        reportBatchFailure(&client->session, "could not import", directory);
+    }
+    else{
+        struct TaskQueue all = gatherShardTasks(server);
+        checkpointWorkspace(&workspaceJournal, server->rootFolder, &all);
+        free(all.heap);
+    }
+    unlockAllShards(server);
+    pthread_rwlock_unlock(&server->lock);
+}
+
+// Function to move every note file into the store, with every other client shut out so that no note comes or goes
+void serverMoveNotesIntoStore(struct WorkspaceServer *server, struct ServerClient *client){
+    pthread_rwlock_wrlock(&server->lock);
+    moveNotesIntoStore(client->output, server->rootFolder);
+    pthread_rwlock_unlock(&server->lock);
+}
+
+// Function to remove a folder given by path, first moving every client inside it up to the folder it is removed from
+void serverDeleteFolder(struct WorkspaceServer *server, struct ServerClient *client, char *path){
+    const char *foldername;
+    struct FolderNode *parentFolder = resolveCommandFolder(&client->session, BATCH_RMDIR, path, &foldername);
+    if (parentFolder == NULL){
+        return;
+    }
+    struct FolderNode *target = navigateToChildFolder(parentFolder, foldername);
+    if (target == NULL){
+        reportBatchFailure(&client->session, "no such folder", path);
+        return;
+    }
+    for (struct ServerClient *other = server->clients; other != NULL; other = other->next){
+        if (folderIsWithin(other->session.currentFolder, target)){
+            other->session.currentFolder = parentFolder;
+            other->cursorMoved = other != client;
+        }
+    }
+    deleteFolder(parentFolder, foldername);
+    fprintf(client->output, " Topic Folder deleted.\n");
+}
+
+// Function to carry out one command for a client under the locks it needs
+void runServerCommand(struct WorkspaceServer *server, struct ServerClient *client, enum BatchCommand command, char *argument){
+    switch (command){
+    case BATCH_ADD_TASK:{
+        char *description;
+        long priority = strtol(argument, &description, 10);
+        int64_t dueTime;
+        uint32_t repeatSeconds;
+        char *badOption;
+        if (description == argument){
+            reportBatchFailure(&client->session, "expected a priority", argument);
+        }
+        else if ((description = parseTaskOptions(description, &dueTime, &repeatSeconds, &badOption)) == NULL){
+            reportBatchFailure(&client->session, "bad task option", badOption);
+        }
+        else{
+            serverAddTask(server, description, (int)priority, dueTime, repeatSeconds);
+        }
+        return;
+    }
+    case BATCH_POP_TASK:
+        serverExecuteTask(server, client->output);
+        return;
+    case BATCH_LIST_TASKS:
+        serverListOrDeleteTask(server, client->output, 0);
+        return;
+    case BATCH_NEXT_DUE:{
+        size_t count = parseNextDueCount(argument);
+        if (count == 0){
+            reportBatchFailure(&client->session, "expected a count", argument);
+        }
+        else{
+            serverPrintNextDueTasks(server, client->output, count);
+        }
+        return;
+    }
+    case BATCH_DELETE_TASK:
+        serverListOrDeleteTask(server, client->output, atoi(argument) > 0 ? atoi(argument) : -1);
+        return;
+    case BATCH_STATS:
+        serverShowMetrics(server, client->output);
+        return;
+    case BATCH_IMPORT:
+        serverImportDirectory(server, client, argument);
+        return;
+    case BATCH_STORE:
+        serverMoveNotesIntoStore(server, client);
+        return;
+    case BATCH_CLONE:
+        pthread_rwlock_wrlock(&server->lock); // Replaying the clone must hand out the same folder ids, so it runs alone
+        runCloneCommand(&client->session, argument);
+        pthread_rwlock_unlock(&server->lock);
+        return;
+    case BATCH_UNDO:
+    case BATCH_REDO:
+        // Clients' changes interleave, so there is no one latest change of a client's to reverse
+        reportBatchFailure(&client->session, "not available in server mode", batchCommandNames[command]);
+        return;
+    case BATCH_RMDIR:
+    case BATCH_SEARCH:
+    case BATCH_FIND:
+        pthread_rwlock_wrlock(&server->lock);
+        if (command == BATCH_RMDIR){
+            serverDeleteFolder(server, client, argument);
+        }
+        else if (command == BATCH_FIND){
+            printNameMatches(client->output, client->session.rootFolder, argument);
+        }
+        else{
+            printSearchResults(&searchIndex, argument);
+        }
+        pthread_rwlock_unlock(&server->lock);
+        return;
+    default:
+        break;
+    }
+
+    pthread_rwlock_rdlock(&server->lock);
+    if (client->cursorMoved){
+        fprintf(client->output, " Your Topic Folder was deleted by another client; now in %s.\n",
+                nameText(client->session.currentFolder->foldername));
+        client->cursorMoved = 0;
+    }
+    // Resolving takes each folder's lock in turn on a cache miss, so it happens before the target's own lock is held
+    const char *leaf;
+    struct FolderNode *folder = resolveCommandFolder(&client->session, command, argument, &leaf);
+    if (folder == NULL){
+        pthread_rwlock_unlock(&server->lock);
+        return;
+    }
+    if (command == BATCH_CD){
+        client->session.currentFolder = folder;
+        pthread_rwlock_unlock(&server->lock);
+        return;
+    }
+    if (command == BATCH_LIST_NOTES || command == BATCH_SUMMARY){
+        pthread_rwlock_rdlock(&folder->lock);
+    }
+    else{
+        pthread_rwlock_wrlock(&folder->lock);
+    }
+    runFolderCommand(&client->session, command, folder, leaf);
+    pthread_rwlock_unlock(&folder->lock);
+    pthread_rwlock_unlock(&server->lock);
+}
+
+// Function to commit the journal after a command and fold it into a snapshot once it is large enough
+void serverCommitJournal(struct WorkspaceServer *server){
+    struct Journal *journal = &workspaceJournal;
+    pthread_mutex_lock(&journal->lock);
+    commitJournalGroup(journal);
+    int compact = journal->fd >= 0 && journal->fileSize >= journal->compactBytes;
+    pthread_mutex_unlock(&journal->lock);
+    if (!compact){
+        return;
+    }
+    pthread_rwlock_wrlock(&server->lock);
+    lockAllShards(server);
+    struct TaskQueue all = gatherShardTasks(server);
+    maybeCompactJournal(journal, server->rootFolder, &all); // Rechecks the size: another client may have compacted first
+    unlockAllShards(server);
+    pthread_rwlock_unlock(&server->lock);
+    free(all.heap);
+}
+
+void *runServerClient(void *argument){
+    struct ServerClient *client = (struct ServerClient *)argument;
+    struct WorkspaceServer *server = &workspaceServer;
+    sessionOutput = client->output;
+    struct LineReader reader = {client->fd, (char *)malloc(BATCH_READ_BYTES + 1), BATCH_READ_BYTES + 1, 0, 0, 0};
+    if (reader.buffer == NULL){
+        fprintf(stderr, "Memory allocation failed.\n");
+        exit(1);
+    }
+    fprintf(client->output, "notemaker ready\n.\n");
+    fflush(client->output);
+
+    char *line;
+    while ((line = readBatchLine(&reader)) != NULL){
+        client->session.lineNumber++;
+        char *argument;
+        int command = parseBatchCommand(&client->session, line, &argument);
+        if (command >= 0){
+            runServerCommand(server, client, (enum BatchCommand)command, argument);
+        }
+        fprintf(client->output, ".\n");
+        fflush(client->output);
+        serverCommitJournal(server);
+    }
+    free(reader.buffer);
+
+    pthread_rwlock_wrlock(&server->lock);
+    struct ServerClient **link = &server->clients;
+    while (*link != client){
+        link = &(*link)->next;
+    }
+    *link = client->next;
+    pthread_rwlock_unlock(&server->lock);
+    fclose(client->output);
+    close(client->fd);
+    free(client);
+
+    pthread_mutex_lock(&server->clientCountLock);
+    server->clientCount--;
+    pthread_cond_signal(&server->clientsGone);
+    pthread_mutex_unlock(&server->clientCountLock);
+    return NULL;
+}
+
+void *runServerAcceptLoop(void *argument){
+    struct WorkspaceServer *server = (struct WorkspaceServer *)argument;
+    while (1){
+        int fd = accept(server->listenFd, NULL, NULL);
+        if (fd < 0){
+            if (errno == EINVAL || errno == EBADF){
+                break; // The listening socket was shut down
+            }
+            continue;
+        }
+        struct ServerClient *client = (struct ServerClient *)calloc(1, sizeof(struct ServerClient));
+        int outputFd = dup(fd);
+        if (client == NULL || outputFd < 0 || (client->output = fdopen(outputFd, "w")) == NULL){
+            if (outputFd >= 0){
+                close(outputFd);
+            }
+            free(client);
+            close(fd);
+            continue;
+        }
+        client->fd = fd;
+        client->session.rootFolder = server->rootFolder;
+        client->session.currentFolder = server->rootFolder;
+
+        pthread_rwlock_wrlock(&server->lock);
+        client->next = server->clients;
+        server->clients = client;
+        pthread_rwlock_unlock(&server->lock);
+        pthread_mutex_lock(&server->clientCountLock);
+        server->clientCount++;
+        pthread_mutex_unlock(&server->clientCountLock);
+
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, runServerClient, client) != 0){
+            shutdown(fd, SHUT_RDWR);
+            runServerClient(client); // Reads end of input at once and unregisters the client
+        }
+        else{
+            pthread_detach(thread);
+        }
+    }
+    return NULL;
+}
+
+// Function to serve the workspace on a Unix domain socket until SIGINT or SIGTERM; the tasks are handed back to queue
+int runServer(const char *path, struct FolderNode *rootFolder, struct TaskQueue *queue){
+    struct WorkspaceServer *server = &workspaceServer;
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address.sun_path)){
+        fprintf(stderr, "Socket path too long: %s\n", path);
+        return 1;
+    }
+    strcpy(address.sun_path, path);
+    struct stat existing;
+    if (lstat(path, &existing) == 0 && S_ISSOCK(existing.st_mode)){
+        unlink(path); // Left behind by a server that did not shut down cleanly
+    }
+    server->listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (server->listenFd < 0 || bind(server->listenFd, (struct sockaddr *)&address, sizeof(address)) != 0 ||
+        listen(server->listenFd, SOMAXCONN) != 0){
+        fprintf(stderr, "Could not listen on %s: %s\n", path, strerror(errno));
+        if (server->listenFd >= 0){
+            close(server->listenFd);
+        }
+        return 1;
+    }
+
+    pthread_rwlock_init(&server->lock, NULL);
+    pthread_mutex_init(&server->clientCountLock, NULL);
+    pthread_cond_init(&server->clientsGone, NULL);
+    server->rootFolder = rootFolder;
+    server->clients = NULL;
+    server->clientCount = 0;
+    for (int i = 0; i < TASK_SHARDS; i++){
+        pthread_mutex_init(&server->shards[i].lock, NULL);
+        memset(&server->shards[i].queue, 0, sizeof(struct TaskQueue));
+    }
+    while (queue->count != 0){
+        struct TaskNode *task = removeTaskAt(queue, queue->count - 1);
+        pushTaskNode(&server->shards[taskShardOf(task->seq)].queue, task);
+    }
+    for (int i = 0; i < TASK_SHARDS; i++){
+        publishShardTop(&server->shards[i]);
+    }
+
+    // Signals are taken by sigwait here rather than by a handler; writes to departed clients must not kill the server
+    sigset_t stopSignals;
+    sigemptyset(&stopSignals);
+    sigaddset(&stopSignals, SIGINT);
+    sigaddset(&stopSignals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stopSignals, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    pthread_t acceptThread;
+    if (pthread_create(&acceptThread, NULL, runServerAcceptLoop, server) != 0){
+        fprintf(stderr, "Could not start the server: %s\n", strerror(errno));
+        exit(1);
+    }
+    printf(" Serving the workspace on %s (Ctrl+C to stop).\n", path);
+    fflush(stdout);
+    // Wake once a second to announce tasks that fell due, and refresh the metrics file every few seconds
+    struct timespec tick = {1, 0};
+    unsigned ticks = 0;
+    while (sigtimedwait(&stopSignals, NULL, &tick) < 0){
+        reportDueTasks(stdout);
+        fflush(stdout);
+        if (++ticks % SERVER_METRICS_SECONDS == 0){
+            serverShowMetrics(server, NULL);
+        }
+    }
+
+    // Stop accepting, then wake every client blocked on a read and wait for them to finish their command
+    shutdown(server->listenFd, SHUT_RDWR);
+    pthread_join(acceptThread, NULL);
+    close(server->listenFd);
+    unlink(path);
+    pthread_rwlock_wrlock(&server->lock);
+    for (struct ServerClient *client = server->clients; client != NULL; client = client->next){
+        shutdown(client->fd, SHUT_RDWR);
+    }
+    pthread_rwlock_unlock(&server->lock);
+    pthread_mutex_lock(&server->clientCountLock);
+    while (server->clientCount != 0){
+        pthread_cond_wait(&server->clientsGone, &server->clientCountLock);
+    }
+    pthread_mutex_unlock(&server->clientCountLock);
+
+    for (int i = 0; i < TASK_SHARDS; i++){
+        struct TaskQueue *shardQueue = &server->shards[i].queue;
+        while (shardQueue->count != 0){
+            pushTaskNode(queue, removeTaskAt(shardQueue, shardQueue->count - 1));
+        }
+        free(shardQueue->heap);
+        free(shardQueue->seqIndex);
+        pthread_mutex_destroy(&server->shards[i].lock);
+    }
+    pthread_cond_destroy(&server->clientsGone);
+    pthread_mutex_destroy(&server->clientCountLock);
+    pthread_rwlock_destroy(&server->lock);
+    return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/*MAIN FUNCTION*/
+#ifndef NOTEMAKER_NO_MAIN // benchmark.c includes this file for everything but main
+int main(int argc, char **argv){
+    struct TaskQueue priorityQueue = {0};
+    struct FolderNode *rootFolder = openWorkspace(&priorityQueue);
+    if (argc == 3 && strcmp(argv[1], "--search") == 0){
+        // Non-interactive query: build the index, print the ranked notes and leave the workspace untouched
+        printSearchResults(&searchIndex, argv[2]);
+        close(workspaceJournal.fd);
+        return 0;
+    }
+    if ((argc == 2 || argc == 3) && strcmp(argv[1], "--batch") == 0){
+        // Batch mode: commands from a file (or stdin), no menu, saved on completion like option 13
+        FILE *input = (argc == 3 && strcmp(argv[2], "-") != 0) ? fopen(argv[2], "r") : stdin;
+        if (input == NULL){
+            fprintf(stderr, "Could not open %s: %s\n", argv[2], strerror(errno));
+            tearDownWorkspace(rootFolder, &priorityQueue);
+            return 1;
+        }
+        undoLog.enabled = 1;
+        runBatch(input, rootFolder, &priorityQueue);
+        if (input != stdin){
+            fclose(input);
+        }
+        tearDownWorkspace(rootFolder, &priorityQueue);
+        return 0;
+    }
+    if ((argc == 3 || argc == 4) && strcmp(argv[1], "--import") == 0){
+        // Import mode: add a directory tree under the given Topic Folder (the root by default) and save
+        struct FolderNode *target = argc == 4 ? resolveFolderPath(rootFolder, argv[3]) : rootFolder;
+        int status = 1;
+        if (target == NULL){
+            fprintf(stderr, "Topic Folder not found: %s\n", argv[3]);
+        }
+        else if (importDirectoryTree(target, argv[2]) != NULL){
+            status = 0;
+        }
+        tearDownWorkspace(rootFolder, &priorityQueue);
+        return status;
+    }
+    if ((argc == 2 || argc == 3) && strcmp(argv[1], "--serve") == 0){
+        // Server mode: clients share the workspace until SIGINT or SIGTERM, then it is saved like option 13
+        int status = runServer(argc == 3 ? argv[2] : SERVER_SOCKET_PATH, rootFolder, &priorityQueue);
+        tearDownWorkspace(rootFolder, &priorityQueue);
+        return status;
+    }
+    struct FolderNode *currentFolder = rootFolder;
+    undoLog.enabled = 1;
+
+    int choice;
+    struct InputBuffer filename = {NULL, 0};
+    struct InputBuffer foldername = {NULL, 0};
+    struct InputBuffer taskname = {NULL, 0};
+    struct InputBuffer searchQuery = {NULL, 0};
+    int priority;
+    while (1){
+        printf("\n");
+        printf("++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++\n");
+        printf("__________________________________________________________________\n");
+        printf("| NOTE MAKER APPLICATION                                         |\n");
+        printf("|----------------------------------------------------------------|\n");
+        printf("| Current Topic Folder: %s                                     |\n", nameText(currentFolder->foldername));
+        printf("|----------------------------------------------------------------|\n");
+        printf("| NOTES MANAGER                                                  |\n");
+        printf("|----------------------------------------------------------------|\n");
+        printf("| 1. Add a Note to the current Topic Folder                      |\n");
+        printf("| 2. Open a Note                                                 |\n");
+        printf("| 3. View all the Notes in the current Topic Folder              |\n");
+        printf("| 4. Delete a Note from the current Topic Folder                 |\n");
+        printf("|----------------------------------------------------------------|\n");
+        printf("| TOPIC FOLDER MANAGER                                           |\n");
+        printf("|----------------------------------------------------------------|\n");
+        printf("| 5. Create a new Topic Folder in the current Topic Folder       |\n");
+        printf("| 6. Navigate to a child Topic Folder                            |\n");
+        printf("| 7. Navigate to the parent Topic Folder                         |\n");
+        printf("| 8. Delete the Topic Folder of your choice                      |\n");
+        printf("| 17. View the summary of a Topic Folder                         |\n");
+        printf("| 18. Import a directory tree into the current Topic Folder      |\n");
+        printf("| 20. Clone a Topic Folder with everything in it                 |\n");
+        printf("|----------------------------------------------------------------|\n");
+        printf("| TASK MANAGER                                                   |\n");
+        printf("|----------------------------------------------------------------|\n");
+        printf("|  9. Add a Task                                                 |\n");
+        printf("| 10. Execute Highest Priority Task                              |\n");
+        printf("| 11. View Task List                                             |\n");
+        printf("| 12. Delete a Task                                              |\n");
+        printf("| 15. View the next due Tasks                                    |\n");
+        printf("|----------------------------------------------------------------|\n");
+        printf("| SEARCH AND STATISTICS                                          |\n");
+        printf("|----------------------------------------------------------------|\n");
+        printf("| 14. Search the contents of all Notes                           |\n");
+        printf("| 16. View Operation Statistics                                  |\n");
+        printf("| 23. Find Notes and Topic Folders by name                       |\n");
+        printf("|----------------------------------------------------------------|\n");
+        printf("| NOTE STORAGE                                                   |\n");
+        printf("|----------------------------------------------------------------|\n");
+        printf("| 19. Move all Notes into the deduplicated note store            |\n");
+        printf("|----------------------------------------------------------------|\n");
+        printf("| UNDO AND REDO                                                  |\n");
+        printf("|----------------------------------------------------------------|\n");
+        printf("| 21. Undo the last change                                       |\n");
+        printf("| 22. Redo the last undone change                                |\n");
+        printf("|----------------------------------------------------------------|\n");
+        printf("|----------------------------------------------------------------|\n");
+        printf("| 13. Exit                                                       |\n");
+        printf("__________________________________________________________________\n");
+        printf("++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++\n");
+        printf(" Choose an option: ");
+        scanf("%d", &choice);
+
+        switch (choice){
+        case 1:
+            printf("\n");
+            printf(" Enter the Note Title or path (e.g., mynote or /projects/q3/mynote): ");
+            readInput(&filename, 0);
+            const char *leaf;
+            struct FolderNode *noteFolder = resolveParentPath(currentFolder, filename.text, &leaf);
+            if (noteFolder == NULL){
+                printf("\n");
+                printf(" Topic Folder not found.\n");
+            }
+            else if (!isValidName(leaf)){
+                printf("\n");
+                printf(" Invalid Note Title.\n");
+            }
+            else{
+                addFileToList(noteFolder, leaf);
+            }
+            break;
+        case 2:
+            if (currentFolder->fileList.count != 0){
+                printFileList(&(currentFolder->fileList));
+            }
+            else{
+                printf("\n");
+                printf(" The Topic Folder is empty.\n");
+            }
+            printf("\n");
+            printf(" Enter the index or the path of the Note to open: ");
+            readInput(&filename, 0);
+            struct FileNode *noteToOpen = findNoteFromAnswer(currentFolder, filename.text, &noteFolder);
+            if (noteToOpen != NULL){
+                openFileInNotepad(nameText(noteToOpen->filename));
+                reindexEditedNote(noteToOpen);
+                remeasureNote(noteToOpen);
+            }
+            else{
+                printf("\n");
+                printf(" Note not found.\n");
+            }
+            break;
+        case 3:
+            if (currentFolder->fileList.count != 0){
+                printf("\n");
+                printf(" List of Notes in %s:\n", nameText(currentFolder->foldername));
+                printFileList(&(currentFolder->fileList));
+            }
+            else{
+                printf("\n");
+                printf(" The Topic Folder is empty.\n");
+            }
+            break;
+        case 4:
+            if (currentFolder->fileList.count != 0){
+                printFileList(&(currentFolder->fileList));
+            }
+            else{
+                printf("\n");
+                printf(" The Topic Folder is empty.\n");
+            }
+            printf("\n");
+            printf(" Enter the index or the path of the Note to delete: ");
+            readInput(&filename, 0);
+            struct FileNode *noteToDelete = findNoteFromAnswer(currentFolder, filename.text, &noteFolder);
+            if (noteToDelete != NULL){
+                deleteFile(noteFolder, nameText(noteToDelete->filename));
+                printf("\n");
+                printf(" Note deleted.\n");
+            }
+            else{
+                printf("\n");
+                printf(" Note not found.\n");
+            }
+            break;
+        case 5:
+            printf("\n");
+            printf(" Enter the name or path of the new Topic Folder: ");
+            readInput(&foldername, 0);
+            struct FolderNode *parentOfNew = resolveParentPath(currentFolder, foldername.text, &leaf);
+            if (parentOfNew == NULL){
+                printf("\n");
+                printf(" Topic Folder not found.\n");
+            }
+            else if (!isValidName(leaf)){
+                printf("\n");
+                printf(" Invalid Topic Folder name.\n");
+            }
+            else{
+                addFolderToTree(parentOfNew, leaf);
+            }
+            break;
+        case 6:
+            printf("\n");
+            printf(" Enter the name or path of the Topic Folder to navigate to: ");
+            readInput(&foldername, 0);
+            struct FolderNode *childFolder = resolveFolderPath(currentFolder, foldername.text);
+            if (childFolder != NULL){
+                currentFolder = childFolder;
+            }
+            else{
+                printf("\n");
+                printf(" Topic Folder not found.\n");
+            }
+            break;
+        case 7:;
+            struct FolderNode *parentFolder = navigateToParentFolder(currentFolder);
+            if (parentFolder != NULL){
+                currentFolder = parentFolder;
+            }
+            else{
+                printf("\n");
+                printf(" You are already in the Default Workspace.\n");
+            }
+            break;
+        case 8:
+            printf("\n");
+            printf(" Enter the name or path of the Topic Folder to delete: ");
+            readInput(&foldername, 0);
+            struct FolderNode *parentOfDeleted = resolveParentPath(currentFolder, foldername.text, &leaf);
+            struct FolderNode *folderToDelete = parentOfDeleted != NULL ? navigateToChildFolder(parentOfDeleted, leaf) : NULL;
+            if (folderToDelete != NULL){
+                if (folderIsWithin(currentFolder, folderToDelete)){
+                    currentFolder = parentOfDeleted; // Step out of the folder before it goes away
+                }
+                deleteFolder(parentOfDeleted, leaf);
+                printf(" Topic Folder deleted.\n");
+            }
+            else{
+                printf(" Topic Folder not found.\n");
+            }
+            break;
+        case 9:
+            printf("\n");
+            printf(" Enter the Task Name and Description: ");
+            readInput(&taskname, 1);
+            int w = 9;
+            printf(" Enter the Task Priority (an integer): ");
+            scanf("%d", &priority);
+            printf(" Enter the minutes until the Task is due (-1 for no deadline): ");
+            long dueMinutes = -1;
+            scanf("%ld", &dueMinutes);
+            long repeatMinutes = 0;
+            if (dueMinutes >= 0){
+                printf(" Enter the minutes between repeats (0 for a one-off Task): ");
+                scanf("%ld", &repeatMinutes);
+            }
+            addTaskToQueue(&priorityQueue, taskname.text, priority,
+                           dueMinutes >= 0 ? (int64_t)time(NULL) + (int64_t)dueMinutes * 60 : TASK_NO_DEADLINE,
+                           repeatMinutes > 0 && repeatMinutes <= UINT32_MAX / 60 ? (uint32_t)repeatMinutes * 60 : 0);
+            break;
+        case 10:
+            executeHighestPriorityTask(&priorityQueue);
+            break;
+        case 11:
+            if (priorityQueue.count != 0){
+                printf("\n");
+                printf(" Task List:\n");
+                printTaskQueue(&priorityQueue);
+            }
+            else{
+                printf("\n");
+                printf(" The Task List is empty.\n");
+            }
+            break;
+        case 12:
+            if (priorityQueue.count != 0){
+                printf("\n");
+                printf(" Task List:\n");
+                printTaskQueue(&priorityQueue);
+                printf(" Enter the index of the Task to delete: ");
+                int taskIndex;
+                scanf("%d", &taskIndex);
+                deleteTask(&priorityQueue, taskIndex);
+            }
+            else{
+                printf("\n");
+                printf(" The Task List is empty.\n");
+            }
+            break;
+
+        case 13:
+            // Save the workspace, free memory used by the tree and exit
+            tearDownWorkspace(rootFolder, &priorityQueue);
+            free(filename.text);
+            free(foldername.text);
+            free(taskname.text);
+            free(searchQuery.text);
+            exit(0);
+        case 14:
+            printf("\n");
+            printf(" Enter the words to search for (\"quoted\" for an exact phrase): ");
+            readInput(&searchQuery, 1);
+            printSearchResults(&searchIndex, searchQuery.text);
+            break;
+        case 15:{
+            struct TaskQueue *queues[1] = {&priorityQueue};
+            printf("\n");
+            printf(" Next due Tasks:\n");
+            printNextDueTasks(stdout, queues, 1, BATCH_NEXT_DUE_COUNT);
+            break;
+        }
+        case 16:{
+            struct TaskQueue *queues[1] = {&priorityQueue};
+            printf("\n");
+            showMetrics(stdout, queues, NULL, 1);
+            break;
+        }
+        case 17:{
+            printf("\n");
+            printf(" Enter the path of the Topic Folder (. for the current one): ");
+            readInput(&foldername, 0);
+            struct FolderNode *summaryFolder = resolveFolderPath(currentFolder, foldername.text);
+            printf("\n");
+            if (summaryFolder != NULL){
+                printFolderSummary(stdout, summaryFolder);
+            }
+            else{
+                printf(" Topic Folder not found.\n");
+            }
+            break;
+        }
+        case 18:
+            printf("\n");
+            printf(" Enter the directory to import: ");
+            readInput(&foldername, 1);
+            printf("\n");
+            if (importDirectoryTree(currentFolder, foldername.text) != NULL){
+                checkpointWorkspace(&workspaceJournal, rootFolder, &priorityQueue);
+            }
+            break;
+        case 19:
+            printf("\n");
+            moveNotesIntoStore(stdout, rootFolder);
+            break;
+        case 20:{
+            printf("\n");
+            printf(" Enter the name or path of the Topic Folder to clone: ");
+            readInput(&foldername, 0);
+            struct FolderNode *cloneSource = resolveFolderPath(currentFolder, foldername.text);
+            if (cloneSource == NULL){
+                printf(" Topic Folder not found.\n");
+                break;
+            }
+            printf(" Enter the name or path of the clone: ");
+            readInput(&foldername, 0);
+            struct FolderNode *cloneParent = resolveParentPath(currentFolder, foldername.text, &leaf);
+            if (cloneParent == NULL || !isValidName(leaf)){
+                printf(" Invalid Topic Folder path.\n");
+                break;
+            }
+            printf("\n");
+            cloneFolder(cloneSource, cloneParent, leaf);
+            break;
+        }
+        case 21:
+        case 22:
+            printf("\n");
+            undoOrRedo(stdout, choice == 22, &currentFolder);
+            break;
+        case 23:
+            printf("\n");
+            printf(" Enter the name or part of the name to find: ");
+            readInput(&searchQuery, 1);
+            printNameMatches(stdout, rootFolder, searchQuery.text);
+            break;
+        default:
+            printf("\n");
+            printf(" Invalid Menu Choice.\n");
+        }
+        // Each menu action is one commit group
+        reportDueTasks(stdout);
+        reportFileIoFailures();
+        journalCommit(&workspaceJournal);
+        maybeCompactJournal(&workspaceJournal, rootFolder, &priorityQueue);
+    }return 0;
+}
+#endif
+
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
\ No newline at end of file